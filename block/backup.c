@@ -492,6 +492,7 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
     job->perf = *perf;
 
     block_copy_set_copy_opts(bcs, perf->use_copy_range, compress);
+    block_copy_set_adaptive_chunk(bcs, perf->adaptive_chunk);
     block_copy_set_progress_meter(bcs, &job->common.job.progress);
     block_copy_set_speed(bcs, speed);
 
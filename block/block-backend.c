@@ -2908,6 +2908,55 @@ int coroutine_fn blk_co_copy_range(BlockBackend *blk_in, int64_t off_in,
                               bytes, read_flags, write_flags);
 }
 
+/* To be called between exactly one pair of blk_inc/dec_in_flight() */
+static int64_t coroutine_fn
+blk_co_do_splice_read(BlockBackend *blk, int64_t offset, int64_t bytes,
+                      int out_fd, QEMUIOVector *hdr)
+{
+    int64_t ret;
+    BlockDriverState *bs;
+    IO_CODE();
+
+    blk_wait_while_drained(blk);
+    GRAPH_RDLOCK_GUARD();
+
+    /* Call blk_bs() only after waiting, the graph may have changed */
+    bs = blk_bs(blk);
+    trace_blk_co_splice_read(blk, bs, offset, bytes, out_fd);
+
+    ret = blk_check_byte_request(blk, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /*
+     * Throttled requests would be charged twice if this falls back, and
+     * once more for every retry after a short send
+     */
+    if (blk->public.throttle_group_member.throttle_state) {
+        return -ENOTSUP;
+    }
+
+    bdrv_inc_in_flight(bs);
+    ret = bdrv_co_splice_read(blk->root, offset, bytes, out_fd, hdr);
+    bdrv_dec_in_flight(bs);
+    return ret;
+}
+
+int64_t coroutine_fn blk_co_splice_read(BlockBackend *blk, int64_t offset,
+                                        int64_t bytes, int out_fd,
+                                        QEMUIOVector *hdr)
+{
+    int64_t ret;
+    IO_OR_GS_CODE();
+
+    blk_inc_in_flight(blk);
+    ret = blk_co_do_splice_read(blk, offset, bytes, out_fd, hdr);
+    blk_dec_in_flight(blk);
+
+    return ret;
+}
+
 const BdrvChild *blk_root(BlockBackend *blk)
 {
     GLOBAL_STATE_CODE();
@@ -32,6 +32,10 @@
 #define BLOCK_COPY_MAX_COPY_RANGE (16 * MiB)
 #define BLOCK_COPY_MAX_BUFFER (1 * MiB)
 #define BLOCK_COPY_MAX_MEM (128 * MiB)
+/* Part of BLOCK_COPY_MAX_MEM that background copying can never take */
+#define BLOCK_COPY_PRIORITY_MEM (32 * MiB)
+/* Upper limit of the adaptive chunk size of background copying */
+#define BLOCK_COPY_MAX_ADAPTIVE_CHUNK (16 * MiB)
 #define BLOCK_COPY_MAX_WORKERS 64
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
@@ -54,6 +58,11 @@ typedef struct BlockCopyCallState {
     int max_workers;
     int64_t max_chunk;
     bool ignore_ratelimit;
+    /*
+     * Call made by block_copy() on behalf of a guest write, as opposed to
+     * the background copying of block_copy_async().
+     */
+    bool priority;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
     /* Coroutine where async block-copy is running */
@@ -98,6 +107,12 @@ typedef struct BlockCopyTask {
      */
     BlockCopyMethod method;
 
+    /*
+     * Set (under lock in BlockCopyState) when a priority call had to wait for
+     * this background task.
+     */
+    bool stalled_priority;
+
     /*
      * Generally, req is protected by lock in BlockCopyState, Still req.offset
      * is only set on task creation, so may be read concurrently after creation.
@@ -137,6 +152,13 @@ typedef struct BlockCopyState {
     CoMutex lock;
     int64_t in_flight_bytes;
     BlockCopyMethod method;
+    /*
+     * Chunk size of background copying when @adaptive_chunk is set: it grows
+     * while the background tasks are left alone and is halved whenever a
+     * priority call has to wait for one of them.
+     */
+    bool adaptive_chunk;
+    int64_t bg_chunk;
     BlockReqList reqs;
     QLIST_HEAD(, BlockCopyCallState) calls;
     /*
@@ -158,6 +180,11 @@ typedef struct BlockCopyState {
     BdrvDirtyBitmap *copy_bitmap;
     ProgressMeter *progress;
     SharedResource *mem;
+    /*
+     * Background tasks take their buffers from @bg_mem as well as from @mem,
+     * so that some memory is always left to priority calls.
+     */
+    SharedResource *bg_mem;
     RateLimit rate_limit;
 } BlockCopyState;
 
@@ -180,6 +207,75 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
     }
 }
 
+/* Called with lock held */
+static int64_t block_copy_max_adaptive_chunk(BlockCopyState *s)
+{
+    return MIN(MAX(s->cluster_size, BLOCK_COPY_MAX_ADAPTIVE_CHUNK),
+               s->max_transfer);
+}
+
+/* Called with lock held */
+static bool block_copy_use_adaptive_chunk(BlockCopyState *s,
+                                          BlockCopyCallState *call_state)
+{
+    /* Compression only supports cluster-sized writes */
+    return s->adaptive_chunk && !call_state->priority &&
+           s->method != COPY_READ_WRITE_CLUSTER;
+}
+
+/* Called with lock held */
+static void block_copy_set_bg_chunk(BlockCopyState *s, int64_t bg_chunk)
+{
+    bg_chunk = QEMU_ALIGN_DOWN(bg_chunk, s->cluster_size);
+    bg_chunk = MIN(MAX(bg_chunk, s->cluster_size),
+                   block_copy_max_adaptive_chunk(s));
+
+    if (bg_chunk != s->bg_chunk) {
+        trace_block_copy_chunk_size(s, s->bg_chunk, bg_chunk);
+        s->bg_chunk = bg_chunk;
+    }
+}
+
+/*
+ * A priority call is about to wait for the tasks in @offset/@bytes range.
+ * Background tasks in its way make the guest wait, so make the next ones
+ * smaller.  Called with lock held.
+ */
+static void block_copy_note_stall(BlockCopyState *s, int64_t offset,
+                                  int64_t bytes)
+{
+    BlockReq *req = reqlist_find_conflict(&s->reqs, offset, bytes);
+    BlockCopyTask *task;
+
+    if (!req) {
+        return;
+    }
+
+    task = container_of(req, BlockCopyTask, req);
+    if (!task->call_state->priority && !task->stalled_priority) {
+        task->stalled_priority = true;
+        if (s->adaptive_chunk) {
+            block_copy_set_bg_chunk(s, s->bg_chunk / 2);
+        }
+    }
+}
+
+static void coroutine_fn block_copy_task_get_mem(BlockCopyTask *task)
+{
+    if (!task->call_state->priority) {
+        co_get_from_shres(task->s->bg_mem, task->req.bytes);
+    }
+    co_get_from_shres(task->s->mem, task->req.bytes);
+}
+
+static void coroutine_fn block_copy_task_put_mem(BlockCopyTask *task)
+{
+    co_put_to_shres(task->s->mem, task->req.bytes);
+    if (!task->call_state->priority) {
+        co_put_to_shres(task->s->bg_mem, task->req.bytes);
+    }
+}
+
 /*
  * Search for the first dirty area in offset/bytes range and create task at
  * the beginning of it.
@@ -192,7 +288,12 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
     int64_t max_chunk;
 
     QEMU_LOCK_GUARD(&s->lock);
-    max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    if (block_copy_use_adaptive_chunk(s, call_state)) {
+        max_chunk = MIN_NON_ZERO(s->bg_chunk, call_state->max_chunk);
+    } else {
+        max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s),
+                                 call_state->max_chunk);
+    }
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -271,6 +372,7 @@ void block_copy_state_free(BlockCopyState *s)
     ratelimit_destroy(&s->rate_limit);
     bdrv_release_dirty_bitmap(s->copy_bitmap);
     shres_destroy(s->mem);
+    shres_destroy(s->bg_mem);
     g_free(s);
 }
 
@@ -412,6 +514,7 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
         .len = bdrv_dirty_bitmap_size(copy_bitmap),
         .write_flags = (is_fleecing ? BDRV_REQ_SERIALISING : 0),
         .mem = shres_create(BLOCK_COPY_MAX_MEM),
+        .bg_mem = shres_create(BLOCK_COPY_MAX_MEM - BLOCK_COPY_PRIORITY_MEM),
         .max_transfer = QEMU_ALIGN_DOWN(
                                     block_copy_max_transfer(source, target),
                                     cluster_size),
@@ -454,7 +557,7 @@ static coroutine_fn int block_copy_task_run(AioTaskPool *pool,
 
     aio_task_pool_wait_slot(pool);
     if (aio_task_pool_status(pool) < 0) {
-        co_put_to_shres(task->s->mem, task->req.bytes);
+        block_copy_task_put_mem(task);
         block_copy_task_end(task, -ECANCELED);
         g_free(task);
         return -ECANCELED;
@@ -581,11 +684,17 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
                 t->call_state->ret = ret;
                 t->call_state->error_is_read = error_is_read;
             }
-        } else if (s->progress) {
-            progress_work_done(s->progress, t->req.bytes);
+        } else {
+            if (s->progress) {
+                progress_work_done(s->progress, t->req.bytes);
+            }
+            if (block_copy_use_adaptive_chunk(s, t->call_state) &&
+                !t->stalled_priority && t->req.bytes >= s->bg_chunk) {
+                block_copy_set_bg_chunk(s, s->bg_chunk * 2);
+            }
         }
     }
-    co_put_to_shres(s->mem, t->req.bytes);
+    block_copy_task_put_mem(t);
     block_copy_task_end(t, ret);
 
     return ret;
@@ -788,7 +897,7 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
 
         trace_block_copy_process(s, task->req.offset);
 
-        co_get_from_shres(s->mem, task->req.bytes);
+        block_copy_task_get_mem(task);
 
         offset = task_end(task);
         bytes = end - offset;
@@ -853,6 +962,10 @@ block_copy_common(BlockCopyCallState *call_state)
 
         if (ret == 0 && !qatomic_read(&call_state->cancelled)) {
             WITH_QEMU_LOCK_GUARD(&s->lock) {
+                if (call_state->priority) {
+                    block_copy_note_stall(s, call_state->offset,
+                                          call_state->bytes);
+                }
                 /*
                  * Check that there is no task we still need to
                  * wait to complete
@@ -922,6 +1035,7 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t start, int64_t bytes,
         .bytes = bytes,
         .ignore_ratelimit = ignore_ratelimit,
         .max_workers = BLOCK_COPY_MAX_WORKERS,
+        .priority = true,
         .cb = cb,
         .cb_opaque = cb_opaque,
     };
@@ -1009,6 +1123,14 @@ int block_copy_call_status(BlockCopyCallState *call_state, bool *error_is_read)
     return call_state->ret;
 }
 
+bool coroutine_fn block_copy_range_is_clean(BlockCopyState *s, int64_t offset,
+                                            int64_t bytes)
+{
+    QEMU_LOCK_GUARD(&s->lock);
+    return bdrv_dirty_bitmap_next_dirty(s->copy_bitmap, offset, bytes) < 0 &&
+           !reqlist_find_conflict(&s->reqs, offset, bytes);
+}
+
 /*
  * Note that cancelling and finishing are racy.
  * User can cancel a block-copy that is already finished.
@@ -1034,6 +1156,14 @@ void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip)
     qatomic_set(&s->skip_unallocated, skip);
 }
 
+/* Only set before running the job, no need for locking. */
+void block_copy_set_adaptive_chunk(BlockCopyState *s, bool adaptive)
+{
+    s->adaptive_chunk = adaptive;
+    s->bg_chunk = MIN(block_copy_chunk_size(s),
+                      block_copy_max_adaptive_chunk(s));
+}
+
 void block_copy_set_speed(BlockCopyState *s, uint64_t speed)
 {
     ratelimit_set_speed(&s->rate_limit, speed, BLOCK_COPY_SLICE_TIME);
@@ -28,6 +28,7 @@
 
 #include "sysemu/block-backend.h"
 #include "qemu/cutils.h"
+#include "qemu/timer.h"
 #include "qapi/error.h"
 #include "block/block_int.h"
 #include "block/qdict.h"
@@ -39,6 +40,13 @@
 
 #include "qapi/qapi-visit-block-core.h"
 
+/* Intervals of the histogram of guest write stalls, in nanoseconds */
+static const uint64_t cbw_stall_boundaries[] = {
+    10 * SCALE_US, 100 * SCALE_US, SCALE_MS, 10 * SCALE_MS, 100 * SCALE_MS,
+    NANOSECONDS_PER_SECOND,
+};
+#define CBW_STALL_BINS (ARRAY_SIZE(cbw_stall_boundaries) + 1)
+
 typedef struct BDRVCopyBeforeWriteState {
     BlockCopyState *bcs;
     BdrvChild *target;
@@ -76,6 +84,12 @@ typedef struct BDRVCopyBeforeWriteState {
      * snapshot-API requests will fail with that error.
      */
     int snapshot_error;
+
+    /*
+     * @stall_bins: number of guest writes that were held up by
+     * copy-before-write for a time in each interval of cbw_stall_boundaries.
+     */
+    uint64_t stall_bins[CBW_STALL_BINS];
 } BDRVCopyBeforeWriteState;
 
 static int coroutine_fn GRAPH_RDLOCK
@@ -92,6 +106,18 @@ static void block_copy_cb(void *opaque)
     bdrv_dec_in_flight(bs);
 }
 
+static void cbw_account_stall(BDRVCopyBeforeWriteState *s, int64_t ns)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(cbw_stall_boundaries); i++) {
+        if (ns < cbw_stall_boundaries[i]) {
+            break;
+        }
+    }
+    s->stall_bins[i]++;
+}
+
 /*
  * Do copy-before-write operation.
  *
@@ -108,6 +134,8 @@ static coroutine_fn int cbw_do_copy_before_write(BlockDriverState *bs,
     int ret;
     uint64_t off, end;
     int64_t cluster_size = block_copy_cluster_size(s->bcs);
+    int64_t start_ns;
+    bool clean;
 
     if (flags & BDRV_REQ_WRITE_UNCHANGED) {
         return 0;
@@ -128,8 +156,14 @@ static coroutine_fn int cbw_do_copy_before_write(BlockDriverState *bs,
      * running block_copy calls.
      */
     bdrv_inc_in_flight(bs);
+    /* Only writes that actually wait for the copy are stalls */
+    clean = block_copy_range_is_clean(s->bcs, off, end - off);
+    start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     ret = block_copy(s->bcs, off, end - off, true, s->cbw_timeout_ns,
                      block_copy_cb, bs);
+    if (!clean) {
+        cbw_account_stall(s, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_ns);
+    }
     if (ret < 0 && s->on_cbw_error == ON_CBW_ERROR_BREAK_GUEST_WRITE) {
         return ret;
     }
@@ -505,6 +539,28 @@ static void cbw_close(BlockDriverState *bs)
     s->bcs = NULL;
 }
 
+static BlockStatsSpecific *cbw_get_specific_stats(BlockDriverState *bs)
+{
+    BDRVCopyBeforeWriteState *s = bs->opaque;
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+    BlockLatencyHistogramInfo *hist = g_new0(BlockLatencyHistogramInfo, 1);
+    int i;
+
+    for (i = ARRAY_SIZE(cbw_stall_boundaries) - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(hist->boundaries, cbw_stall_boundaries[i]);
+    }
+    for (i = CBW_STALL_BINS - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(hist->bins, s->stall_bins[i]);
+    }
+
+    stats->driver = BLOCKDEV_DRIVER_COPY_BEFORE_WRITE;
+    stats->u.copy_before_write = (BlockStatsSpecificCopyBeforeWrite) {
+        .stall_histogram = hist,
+    };
+
+    return stats;
+}
+
 static BlockDriver bdrv_cbw_filter = {
     .format_name = "copy-before-write",
     .instance_size = sizeof(BDRVCopyBeforeWriteState),
@@ -523,6 +579,7 @@ static BlockDriver bdrv_cbw_filter = {
     .bdrv_co_snapshot_block_status = cbw_co_snapshot_block_status,
 
     .bdrv_refresh_filename      = cbw_refresh_filename,
+    .bdrv_get_specific_stats    = cbw_get_specific_stats,
 
     .bdrv_child_perm            = cbw_child_perm,
 
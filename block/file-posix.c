@@ -37,6 +37,7 @@
 #include "qemu/iov.h"
 #include "block/raw-aio.h"
 #include "qapi/qmp/qdict.h"
+#include "exec/memory.h" /* for ram_block_discard_disable() */
 #include "qapi/qmp/qstring.h"
 
 #include "scsi/pr-manager.h"
@@ -66,6 +67,7 @@
 #ifdef __linux__
 #include <sys/ioctl.h>
 #include <sys/param.h>
+#include <sys/sendfile.h>
 #include <sys/syscall.h>
 #include <sys/vfs.h>
 #if defined(CONFIG_BLKZONED)
@@ -158,8 +160,13 @@ typedef struct BDRVRawState {
 
     bool has_discard:1;
     bool has_write_zeroes:1;
-    bool use_linux_aio:1;
-    bool use_linux_io_uring:1;
+    /*
+     * Not bitfields: requests in any AioContext may clear them when the
+     * AIO engine cannot be set up there.
+     */
+    bool use_linux_aio;
+    bool use_linux_io_uring;
+    bool io_uring_fixed_buffers;
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -173,6 +180,9 @@ typedef struct BDRVRawState {
     } stats;
 
     PRManager *pr_mgr;
+
+    /* Buffers registered with io_uring, as struct iovec */
+    GArray *fixed_bufs;
 } BDRVRawState;
 
 typedef struct BDRVRawReopenState {
@@ -215,6 +225,12 @@ typedef struct RawPosixAIOData {
             int aio_fd2;
             off_t aio_offset2;
         } copy_range;
+        struct {
+            int out_fd;
+            QEMUIOVector *hdr;
+            /* Bytes of the header and data sent so far */
+            uint64_t sent;
+        } splice;
         struct {
             PreallocMode prealloc;
             Error **errp;
@@ -560,6 +576,13 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+#ifdef CONFIG_LINUX_IO_URING
+        {
+            .name = "io-uring-fixed-buffers",
+            .type = QEMU_OPT_BOOL,
+            .help = "register guest RAM with io_uring (default: off)",
+        },
+#endif
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -640,6 +663,9 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
+    s->io_uring_fixed_buffers = qemu_opt_get_bool(opts,
+                                                  "io-uring-fixed-buffers",
+                                                  false);
 
     locking = qapi_enum_parse(&OnOffAuto_lookup,
                               qemu_opt_get(opts, "locking"),
@@ -740,6 +766,20 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
             goto fail;
         }
     }
+    if (s->io_uring_fixed_buffers) {
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+        if (!s->use_linux_io_uring) {
+            error_setg(errp, "io-uring-fixed-buffers requires aio=io_uring");
+            ret = -EINVAL;
+            goto fail;
+        }
+#else
+        error_setg(errp, "io-uring-fixed-buffers is not supported by the "
+                         "io_uring library of this build");
+        ret = -EINVAL;
+        goto fail;
+#endif
+    }
 #else
     if (s->use_linux_io_uring) {
         error_setg(errp, "aio=io_uring was specified, but is not supported "
@@ -818,6 +858,17 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
         /* When extending regular files, we get zeros from the OS */
         bs->supported_truncate_flags = BDRV_REQ_ZERO_WRITE;
     }
+
+    if (s->io_uring_fixed_buffers) {
+        /* Registered buffers are pinned, discarding them would not free RAM */
+        ret = ram_block_discard_disable(true);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "ram_block_discard_disable() failed");
+            goto fail;
+        }
+        s->fixed_bufs = g_array_new(false, false, sizeof(struct iovec));
+        bs->supported_write_flags |= BDRV_REQ_REGISTERED_BUF;
+    }
     ret = 0;
 fail:
     if (ret < 0 && s->fd != -1) {
@@ -2201,6 +2252,89 @@ static int handle_aiocb_copy_range(void *opaque)
     return 0;
 }
 
+#ifdef __linux__
+/*
+ * The socket is non-blocking, and a worker thread must not wait for it to
+ * drain: -EAGAIN tells the caller to retry once it is writable.
+ */
+static int raw_splice_send_hdr(RawPosixAIOData *aiocb)
+{
+    QEMUIOVector *hdr = aiocb->splice.hdr;
+    g_autofree struct iovec *iov = g_new(struct iovec, hdr->niov);
+
+    while (aiocb->splice.sent < hdr->size) {
+        size_t done = aiocb->splice.sent;
+        struct msghdr msg = {
+            .msg_iov = iov,
+            .msg_iovlen = iov_copy(iov, hdr->niov, hdr->iov, hdr->niov,
+                                   done, hdr->size - done),
+        };
+        /* The data follows right away, don't push out a short segment */
+        ssize_t ret = sendmsg(aiocb->splice.out_fd, &msg,
+                              MSG_MORE | MSG_DONTWAIT);
+
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+        aiocb->splice.sent += ret;
+    }
+    return 0;
+}
+
+static int handle_aiocb_splice_read(void *opaque)
+{
+    RawPosixAIOData *aiocb = opaque;
+    int out_fd = aiocb->splice.out_fd;
+    off_t offset = aiocb->aio_offset;
+    struct stat st;
+    int ret;
+
+    /*
+     * sendfile() stops at EOF, where the normal read path would return
+     * zeroes.  The header announcing the length must not go out before
+     * it is sure that the data can follow, so leave such ranges to the
+     * read path.
+     */
+    if (fstat(aiocb->aio_fildes, &st) < 0 || !S_ISREG(st.st_mode) ||
+        offset + aiocb->aio_nbytes > st.st_size) {
+        return -ENOTSUP;
+    }
+
+    if (aiocb->splice.hdr) {
+        ret = raw_splice_send_hdr(aiocb);
+        if (ret < 0) {
+            return ret == -EAGAIN ? 0 : ret;
+        }
+    }
+
+    while (aiocb->aio_nbytes) {
+        ssize_t len = sendfile(out_fd, aiocb->aio_fildes, &offset,
+                               aiocb->aio_nbytes);
+        trace_file_sendfile(aiocb->bs, aiocb->aio_fildes, offset, out_fd,
+                            aiocb->aio_nbytes, len);
+        if (len == 0) {
+            /* The file was truncated under our feet */
+            return -EIO;
+        }
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno == EAGAIN) {
+                /* The socket is full, let the caller wait for it */
+                break;
+            }
+            return -errno;
+        }
+        aiocb->aio_nbytes -= len;
+        aiocb->splice.sent += len;
+    }
+    return 0;
+}
+#endif
+
 static int handle_aiocb_discard(void *opaque)
 {
     RawPosixAIOData *aiocb = opaque;
@@ -2444,6 +2578,53 @@ static bool bdrv_qiov_is_aligned(BlockDriverState *bs, QEMUIOVector *qiov)
     return true;
 }
 
+#ifdef CONFIG_LINUX_AIO
+/*
+ * Requests are submitted from the AioContext of the thread that runs
+ * them, which is not necessarily the one of the node when a device spreads
+ * its queues over several iothreads.  Each AioContext has its own AIO
+ * engine state, set up on first use.
+ */
+static bool raw_check_linux_aio(BDRVRawState *s)
+{
+    Error *local_err = NULL;
+
+    if (!s->use_linux_aio) {
+        return false;
+    }
+
+    if (unlikely(!aio_setup_linux_aio(qemu_get_current_aio_context(),
+                                      &local_err))) {
+        error_reportf_err(local_err, "Unable to use native AIO, "
+                                     "falling back to thread pool: ");
+        s->use_linux_aio = false;
+        return false;
+    }
+    return true;
+}
+#endif
+
+#ifdef CONFIG_LINUX_IO_URING
+/* See raw_check_linux_aio() */
+static bool raw_check_linux_io_uring(BDRVRawState *s)
+{
+    Error *local_err = NULL;
+
+    if (!s->use_linux_io_uring) {
+        return false;
+    }
+
+    if (unlikely(!aio_setup_linux_io_uring(qemu_get_current_aio_context(),
+                                           &local_err))) {
+        error_reportf_err(local_err, "Unable to use linux io_uring, "
+                                     "falling back to thread pool: ");
+        s->use_linux_io_uring = false;
+        return false;
+    }
+    return true;
+}
+#endif
+
 static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
                                    uint64_t bytes, QEMUIOVector *qiov, int type)
 {
@@ -2474,13 +2655,13 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
     if (s->needs_alignment && !bdrv_qiov_is_aligned(bs, qiov)) {
         type |= QEMU_AIO_MISALIGNED;
 #ifdef CONFIG_LINUX_IO_URING
-    } else if (s->use_linux_io_uring) {
+    } else if (raw_check_linux_io_uring(s)) {
         assert(qiov->size == bytes);
         ret = luring_co_submit(bs, s->fd, offset, qiov, type);
         goto out;
 #endif
 #ifdef CONFIG_LINUX_AIO
-    } else if (s->use_linux_aio) {
+    } else if (raw_check_linux_aio(s)) {
         assert(qiov->size == bytes);
         ret = laio_co_submit(s->fd, offset, qiov, type,
                               s->aio_max_batch);
@@ -2539,14 +2720,26 @@ static int coroutine_fn raw_co_preadv(BlockDriverState *bs, int64_t offset,
                                       int64_t bytes, QEMUIOVector *qiov,
                                       BdrvRequestFlags flags)
 {
-    return raw_co_prw(bs, &offset, bytes, qiov, QEMU_AIO_READ);
+    BDRVRawState *s = bs->opaque;
+    int type = QEMU_AIO_READ;
+
+    if (s->io_uring_fixed_buffers && (flags & BDRV_REQ_REGISTERED_BUF)) {
+        type |= QEMU_AIO_REGISTERED_BUF;
+    }
+    return raw_co_prw(bs, &offset, bytes, qiov, type);
 }
 
 static int coroutine_fn raw_co_pwritev(BlockDriverState *bs, int64_t offset,
                                        int64_t bytes, QEMUIOVector *qiov,
                                        BdrvRequestFlags flags)
 {
-    return raw_co_prw(bs, &offset, bytes, qiov, QEMU_AIO_WRITE);
+    BDRVRawState *s = bs->opaque;
+    int type = QEMU_AIO_WRITE;
+
+    if (s->io_uring_fixed_buffers && (flags & BDRV_REQ_REGISTERED_BUF)) {
+        type |= QEMU_AIO_REGISTERED_BUF;
+    }
+    return raw_co_prw(bs, &offset, bytes, qiov, type);
 }
 
 static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
@@ -2567,38 +2760,54 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
     };
 
 #ifdef CONFIG_LINUX_IO_URING
-    if (s->use_linux_io_uring) {
+    if (raw_check_linux_io_uring(s)) {
         return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH);
     }
 #endif
     return raw_thread_pool_submit(handle_aiocb_flush, &acb);
 }
 
-static void raw_aio_attach_aio_context(BlockDriverState *bs,
-                                       AioContext *new_context)
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+static bool raw_register_buf(BlockDriverState *bs, void *host, size_t size,
+                             Error **errp)
 {
-    BDRVRawState __attribute__((unused)) *s = bs->opaque;
-#ifdef CONFIG_LINUX_AIO
-    if (s->use_linux_aio) {
-        Error *local_err = NULL;
-        if (!aio_setup_linux_aio(new_context, &local_err)) {
-            error_reportf_err(local_err, "Unable to use native AIO, "
-                                         "falling back to thread pool: ");
-            s->use_linux_aio = false;
-        }
+    BDRVRawState *s = bs->opaque;
+    struct iovec iov = {
+        .iov_base = host,
+        .iov_len = size,
+    };
+
+    /*
+     * Failing to register only means that requests will not use fixed
+     * buffers, so errors are not reported to the caller.
+     */
+    if (s->io_uring_fixed_buffers) {
+        luring_register_buf(host, size);
+        g_array_append_val(s->fixed_bufs, iov);
     }
-#endif
-#ifdef CONFIG_LINUX_IO_URING
-    if (s->use_linux_io_uring) {
-        Error *local_err = NULL;
-        if (!aio_setup_linux_io_uring(new_context, &local_err)) {
-            error_reportf_err(local_err, "Unable to use linux io_uring, "
-                                         "falling back to thread pool: ");
-            s->use_linux_io_uring = false;
+    return true;
+}
+
+static void raw_unregister_buf(BlockDriverState *bs, void *host, size_t size)
+{
+    BDRVRawState *s = bs->opaque;
+    guint i;
+
+    if (!s->io_uring_fixed_buffers) {
+        return;
+    }
+
+    for (i = 0; i < s->fixed_bufs->len; i++) {
+        struct iovec *iov = &g_array_index(s->fixed_bufs, struct iovec, i);
+
+        if (iov->iov_base == host && iov->iov_len == size) {
+            luring_unregister_buf(host, size);
+            g_array_remove_index_fast(s->fixed_bufs, i);
+            break;
         }
     }
-#endif
 }
+#endif
 
 static void raw_close(BlockDriverState *bs)
 {
@@ -2607,10 +2816,28 @@ static void raw_close(BlockDriverState *bs)
     if (s->fd >= 0) {
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+        /* A registered file would keep the file and its locks alive */
+        luring_unregister_fd(s->fd);
 #endif
         qemu_close(s->fd);
         s->fd = -1;
     }
+
+    if (s->io_uring_fixed_buffers) {
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+        /* The block layer does not unregister buffers before closing */
+        while (s->fixed_bufs->len) {
+            struct iovec *iov = &g_array_index(s->fixed_bufs, struct iovec, 0);
+
+            raw_unregister_buf(bs, iov->iov_base, iov->iov_len);
+        }
+#endif
+        g_array_free(s->fixed_bufs, true);
+        s->fixed_bufs = NULL;
+        ram_block_discard_disable(false);
+    }
 }
 
 /**
@@ -3799,6 +4026,9 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
+#ifdef CONFIG_LINUX_IO_URING
+        luring_unregister_fd(s->fd);
+#endif
         qemu_close(s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
@@ -3869,6 +4099,40 @@ raw_co_copy_range_to(BlockDriverState *bs,
     return raw_thread_pool_submit(handle_aiocb_copy_range, &acb);
 }
 
+#ifdef __linux__
+static int64_t coroutine_fn
+raw_co_splice_read(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                   int out_fd, QEMUIOVector *hdr)
+{
+    RawPosixAIOData acb;
+    BDRVRawState *s = bs->opaque;
+    int ret;
+
+    /* sendfile() goes through the page cache that cache.direct avoids */
+    if (s->open_flags & O_DIRECT) {
+        return -ENOTSUP;
+    }
+    if (fd_open(bs) < 0) {
+        return -EIO;
+    }
+
+    acb = (RawPosixAIOData) {
+        .bs             = bs,
+        .aio_type       = QEMU_AIO_READ,
+        .aio_fildes     = s->fd,
+        .aio_offset     = offset,
+        .aio_nbytes     = bytes,
+        .splice         = {
+            .out_fd         = out_fd,
+            .hdr            = hdr,
+        },
+    };
+
+    ret = raw_thread_pool_submit(handle_aiocb_splice_read, &acb);
+    return ret < 0 ? ret : acb.splice.sent;
+}
+#endif
+
 BlockDriver bdrv_file = {
     .format_name = "file",
     .protocol_name = "file",
@@ -3895,8 +4159,14 @@ BlockDriver bdrv_file = {
     .bdrv_co_pdiscard       = raw_co_pdiscard,
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
+#ifdef __linux__
+    .bdrv_co_splice_read    = raw_co_splice_read,
+#endif
     .bdrv_refresh_limits = raw_refresh_limits,
-    .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4266,7 +4536,10 @@ static BlockDriver bdrv_host_device = {
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
     .bdrv_refresh_limits = raw_refresh_limits,
-    .bdrv_attach_aio_context = raw_aio_attach_aio_context,
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+    .bdrv_register_buf      = raw_register_buf,
+    .bdrv_unregister_buf    = raw_unregister_buf,
+#endif
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4402,7 +4675,6 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_co_pwritev        = raw_co_pwritev,
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_refresh_limits    = cdrom_refresh_limits,
-    .bdrv_attach_aio_context = raw_aio_attach_aio_context,
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -4528,7 +4800,6 @@ static BlockDriver bdrv_host_cdrom = {
     .bdrv_co_pwritev        = raw_co_pwritev,
     .bdrv_co_flush_to_disk  = raw_co_flush_to_disk,
     .bdrv_refresh_limits    = cdrom_refresh_limits,
-    .bdrv_attach_aio_context = raw_aio_attach_aio_context,
 
     .bdrv_co_truncate                   = raw_co_truncate,
     .bdrv_co_getlength                  = raw_co_getlength,
@@ -3532,6 +3532,48 @@ int coroutine_fn bdrv_co_copy_range(BdrvChild *src, int64_t src_offset,
                                    bytes, read_flags, write_flags);
 }
 
+int64_t coroutine_fn bdrv_co_splice_read(BdrvChild *child, int64_t offset,
+                                         int64_t bytes, int out_fd,
+                                         QEMUIOVector *hdr)
+{
+    BlockDriverState *bs = child->bs;
+    BdrvTrackedRequest req;
+    int64_t ret;
+    IO_CODE();
+    assert_bdrv_graph_readable();
+    trace_bdrv_co_splice_read(bs, offset, bytes, out_fd);
+
+    if (!bdrv_co_is_inserted(bs)) {
+        return -ENOMEDIUM;
+    }
+    ret = bdrv_check_request32(offset, bytes, NULL, 0);
+    if (ret < 0) {
+        return ret;
+    }
+
+    /*
+     * Anything that needs to see or change the data on its way to the
+     * caller (encryption, copy-on-read, alignment fixups) is left to the
+     * normal read path.
+     */
+    if (!bs->drv->bdrv_co_splice_read || bs->encrypted ||
+        qatomic_read(&bs->copy_on_read) ||
+        !QEMU_IS_ALIGNED(offset | bytes, bs->bl.request_alignment)) {
+        return -ENOTSUP;
+    }
+
+    bdrv_inc_in_flight(bs);
+    tracked_request_begin(&req, bs, offset, bytes, BDRV_TRACKED_READ);
+    bdrv_wait_serialising_requests(&req);
+
+    ret = bs->drv->bdrv_co_splice_read(bs, offset, bytes, out_fd, hdr);
+
+    tracked_request_end(&req);
+    bdrv_dec_in_flight(bs);
+
+    return ret;
+}
+
 static void coroutine_fn GRAPH_RDLOCK
 bdrv_parent_cb_resize(BlockDriverState *bs)
 {
@@ -16,6 +16,9 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/error-report.h"
+#include "qemu/lockable.h"
+#include "qemu/units.h"
 #include "qapi/error.h"
 #include "sysemu/block-backend.h"
 #include "trace.h"
@@ -26,6 +29,15 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Number of registered file slots in each ring */
+#define MAX_FIXED_FILES 64
+
+/* Number of registered buffer slots, shared by all rings */
+#define MAX_FIXED_BUFS 1024
+
+/* The kernel refuses to register larger buffers */
+#define MAX_FIXED_BUF_SIZE (1 * GiB)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
     struct io_uring_sqe sqeq;
@@ -40,6 +52,9 @@ typedef struct LuringAIOCB {
      */
     int total_read;
     QEMUIOVector resubmit_qiov;
+
+    /* Used when a fixed buffer request is resubmitted as a vectored one */
+    struct iovec unfixed_iov;
 } LuringAIOCB;
 
 typedef struct LuringQueue {
@@ -58,8 +73,287 @@ typedef struct LuringState {
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    QLIST_ENTRY(LuringState) next;
+
+    /*
+     * File descriptors registered with the ring, indexed by slot, -1 for
+     * a free slot.  Requests on a registered file skip the file table
+     * lookup and reference counting in the kernel.  Slots are filled from
+     * the AioContext home thread but emptied by luring_unregister_fd() in
+     * the main loop, hence the lock.
+     */
+    QemuMutex fixed_files_lock;
+    int fixed_files[MAX_FIXED_FILES];
+    bool has_fixed_files;
+
+    /* Whether the slots of luring_bufs are registered with the ring */
+    bool has_fixed_bufs;
 } LuringState;
 
+/* Protects luring_states and changes to luring_bufs */
+static QemuMutex luring_lock;
+static QLIST_HEAD(, LuringState) luring_states =
+    QLIST_HEAD_INITIALIZER(luring_states);
+
+static void __attribute__((__constructor__)) luring_init_lock(void)
+{
+    qemu_mutex_init(&luring_lock);
+}
+
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+/*
+ * Guest RAM registered as fixed buffers, so that the kernel does not have
+ * to pin and unpin the pages of every request.  A slot has the same index
+ * in all rings because a BlockDriverState can submit requests to the ring
+ * of any AioContext.
+ *
+ * Lookups are done without luring_lock.  A stale lookup at worst makes
+ * the kernel fail the request with -EFAULT, and the request is then
+ * resubmitted with a plain iovec.
+ */
+typedef struct LuringFixedBuf {
+    void *host;
+    size_t size;
+    unsigned refcnt;
+} LuringFixedBuf;
+
+static LuringFixedBuf luring_bufs[MAX_FIXED_BUFS];
+
+/* One more than the highest slot of luring_bufs ever used */
+static unsigned luring_bufs_used;
+
+/* Returns the fixed buffer slot that contains @buf, or -1 */
+static int luring_fixed_buf(LuringState *s, void *buf, size_t len)
+{
+    unsigned used = qatomic_load_acquire(&luring_bufs_used);
+    unsigned i;
+
+    if (!qatomic_read(&s->has_fixed_bufs)) {
+        return -1;
+    }
+
+    for (i = 0; i < used; i++) {
+        uint8_t *host = qatomic_load_acquire(&luring_bufs[i].host);
+        size_t size = qatomic_read(&luring_bufs[i].size);
+
+        if (host && (uint8_t *)buf >= host &&
+            (uint8_t *)buf + len <= host + size) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Called with luring_lock held */
+static void luring_update_fixed_buf(LuringState *s, unsigned slot,
+                                    void *host, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = host,
+        .iov_len = size,
+    };
+    int ret;
+
+    if (!qatomic_read(&s->has_fixed_bufs)) {
+        return;
+    }
+
+    ret = io_uring_register_buffers_update_tag(&s->ring, slot, &iov, NULL, 1);
+    if (ret < 0) {
+        /*
+         * Typically RLIMIT_MEMLOCK is too low.  Stop using fixed buffers
+         * in this ring and unpin whatever it registered so far.
+         */
+        trace_luring_fixed_bufs_failed(s, slot, ret);
+        qatomic_set(&s->has_fixed_bufs, false);
+        io_uring_unregister_buffers(&s->ring);
+    }
+}
+
+/* Called with luring_lock held */
+static void luring_init_fixed_bufs(LuringState *s)
+{
+    unsigned i;
+    int ret;
+
+    ret = io_uring_register_buffers_sparse(&s->ring, MAX_FIXED_BUFS);
+    if (ret < 0) {
+        trace_luring_fixed_bufs_failed(s, -1, ret);
+        return;
+    }
+    s->has_fixed_bufs = true;
+
+    for (i = 0; i < luring_bufs_used; i++) {
+        if (luring_bufs[i].host) {
+            luring_update_fixed_buf(s, i, luring_bufs[i].host,
+                                    luring_bufs[i].size);
+        }
+    }
+}
+
+void luring_register_buf(void *host, size_t size)
+{
+    uint8_t *start = host;
+    LuringState *s;
+
+    QEMU_LOCK_GUARD(&luring_lock);
+
+    while (size) {
+        size_t len = MIN(size, MAX_FIXED_BUF_SIZE);
+        int slot = -1;
+        unsigned i;
+
+        for (i = 0; i < MAX_FIXED_BUFS; i++) {
+            if (luring_bufs[i].host == start && luring_bufs[i].size == len) {
+                slot = i;
+                break;
+            }
+            if (slot < 0 && !luring_bufs[i].refcnt) {
+                slot = i;
+            }
+        }
+        if (slot < 0) {
+            /* Requests on the rest of the buffer just do not use slots */
+            trace_luring_register_buf(start, size, -1);
+            return;
+        }
+
+        if (!luring_bufs[slot].refcnt++) {
+            QLIST_FOREACH(s, &luring_states, next) {
+                luring_update_fixed_buf(s, slot, start, len);
+            }
+            qatomic_set(&luring_bufs[slot].size, len);
+            qatomic_store_release(&luring_bufs[slot].host, start);
+            if (slot >= (int)luring_bufs_used) {
+                qatomic_store_release(&luring_bufs_used, slot + 1);
+            }
+        }
+        trace_luring_register_buf(start, len, slot);
+
+        start += len;
+        size -= len;
+    }
+}
+
+void luring_unregister_buf(void *host, size_t size)
+{
+    uint8_t *start = host;
+    LuringState *s;
+
+    QEMU_LOCK_GUARD(&luring_lock);
+
+    while (size) {
+        size_t len = MIN(size, MAX_FIXED_BUF_SIZE);
+        unsigned i;
+
+        for (i = 0; i < luring_bufs_used; i++) {
+            if (luring_bufs[i].host != start || luring_bufs[i].size != len) {
+                continue;
+            }
+            if (!--luring_bufs[i].refcnt) {
+                qatomic_set(&luring_bufs[i].host, NULL);
+                QLIST_FOREACH(s, &luring_states, next) {
+                    luring_update_fixed_buf(s, i, NULL, 0);
+                }
+            }
+            break;
+        }
+
+        start += len;
+        size -= len;
+    }
+}
+#else
+static int luring_fixed_buf(LuringState *s, void *buf, size_t len)
+{
+    return -1;
+}
+
+static void luring_init_fixed_bufs(LuringState *s)
+{
+}
+#endif /* HAVE_IO_URING_REGISTER_BUFFERS_SPARSE */
+
+/* Called with luring_lock held */
+static void luring_init_fixed_files(LuringState *s)
+{
+    int i, ret;
+
+    qemu_mutex_init(&s->fixed_files_lock);
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        s->fixed_files[i] = -1;
+    }
+
+    ret = io_uring_register_files(&s->ring, s->fixed_files, MAX_FIXED_FILES);
+    if (ret < 0) {
+        trace_luring_fixed_files_failed(s, ret);
+        return;
+    }
+    s->has_fixed_files = true;
+}
+
+/**
+ * luring_fixed_file:
+ *
+ * Returns the registered file slot for @fd, registering @fd if it has none
+ * yet, or -1 if the file cannot be registered.
+ */
+static int luring_fixed_file(LuringState *s, int fd)
+{
+    int free_slot = -1;
+    int i, ret;
+
+    if (!s->has_fixed_files) {
+        return -1;
+    }
+
+    QEMU_LOCK_GUARD(&s->fixed_files_lock);
+
+    for (i = 0; i < MAX_FIXED_FILES; i++) {
+        if (s->fixed_files[i] == fd) {
+            return i;
+        }
+        if (free_slot < 0 && s->fixed_files[i] == -1) {
+            free_slot = i;
+        }
+    }
+    if (free_slot < 0) {
+        return -1;
+    }
+
+    ret = io_uring_register_files_update(&s->ring, free_slot, &fd, 1);
+    trace_luring_register_file(s, fd, free_slot, ret);
+    if (ret < 0) {
+        return -1;
+    }
+    s->fixed_files[free_slot] = fd;
+    return free_slot;
+}
+
+void luring_unregister_fd(int fd)
+{
+    LuringState *s;
+    int unused = -1;
+    int i;
+
+    QEMU_LOCK_GUARD(&luring_lock);
+
+    QLIST_FOREACH(s, &luring_states, next) {
+        if (!s->has_fixed_files) {
+            continue;
+        }
+        WITH_QEMU_LOCK_GUARD(&s->fixed_files_lock) {
+            for (i = 0; i < MAX_FIXED_FILES; i++) {
+                if (s->fixed_files[i] == fd) {
+                    io_uring_register_files_update(&s->ring, i, &unused, 1);
+                    s->fixed_files[i] = -1;
+                }
+            }
+        }
+    }
+}
+
 /**
  * luring_resubmit:
  *
@@ -88,6 +382,14 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
 
     /* Update read position */
     luringcb->total_read += nread;
+
+    if (luringcb->sqeq.opcode == IORING_OP_READ_FIXED) {
+        luringcb->sqeq.off += nread;
+        luringcb->sqeq.addr += nread;
+        luringcb->sqeq.len -= nread;
+        luring_resubmit(s, luringcb);
+        return;
+    }
     remaining = luringcb->qiov->size - luringcb->total_read;
 
     /* Shorten qiov */
@@ -108,6 +410,29 @@ static void luring_resubmit_short_read(LuringState *s, LuringAIOCB *luringcb,
     luring_resubmit(s, luringcb);
 }
 
+/**
+ * luring_resubmit_unfixed:
+ *
+ * Resubmit a fixed buffer request whose buffer is not registered anymore
+ * as a vectored request on the same memory.
+ */
+static void luring_resubmit_unfixed(LuringState *s, LuringAIOCB *luringcb)
+{
+    struct io_uring_sqe *sqe = &luringcb->sqeq;
+
+    luringcb->unfixed_iov = (struct iovec) {
+        .iov_base = (void *)(uintptr_t)sqe->addr,
+        .iov_len = sqe->len,
+    };
+    sqe->opcode = sqe->opcode == IORING_OP_READ_FIXED ?
+                  IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->addr = (__u64)(uintptr_t)&luringcb->unfixed_iov;
+    sqe->len = 1;
+    sqe->buf_index = 0;
+
+    luring_resubmit(s, luringcb);
+}
+
 /**
  * luring_process_completions:
  * @s: AIO state
@@ -184,6 +509,12 @@ static void luring_process_completions(LuringState *s)
                 luring_resubmit(s, luringcb);
                 continue;
             }
+            if (ret == -EFAULT &&
+                (luringcb->sqeq.opcode == IORING_OP_READ_FIXED ||
+                 luringcb->sqeq.opcode == IORING_OP_WRITE_FIXED)) {
+                luring_resubmit_unfixed(s, luringcb);
+                continue;
+            }
         } else if (!luringcb->qiov) {
             goto end;
         } else if (total_bytes == luringcb->qiov->size) {
@@ -333,25 +664,43 @@ static void luring_deferred_fn(void *opaque)
  *
  * Fetches sqes from ring, adds to pending queue and preps them
  *
+ * Requests use the registered file slot of @fd when there is one, and a
+ * fixed buffer when the request is on a single buffer within registered
+ * guest RAM.
  */
 static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type)
 {
     int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
+    QEMUIOVector *qiov = luringcb->qiov;
+    int file_index = luring_fixed_file(s, fd);
+    int buf_index = -1;
 
-    switch (type) {
+    if ((type & QEMU_AIO_REGISTERED_BUF) && qiov->niov == 1) {
+        buf_index = luring_fixed_buf(s, qiov->iov[0].iov_base,
+                                     qiov->iov[0].iov_len);
+    }
+
+    switch (type & QEMU_AIO_TYPE_MASK) {
     case QEMU_AIO_WRITE:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
-        break;
     case QEMU_AIO_ZONE_APPEND:
-        io_uring_prep_writev(sqes, fd, luringcb->qiov->iov,
-                             luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_write_fixed(sqes, fd, qiov->iov[0].iov_base,
+                                      qiov->iov[0].iov_len, offset,
+                                      buf_index);
+        } else {
+            io_uring_prep_writev(sqes, fd, qiov->iov, qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_READ:
-        io_uring_prep_readv(sqes, fd, luringcb->qiov->iov,
-                            luringcb->qiov->niov, offset);
+        if (buf_index >= 0) {
+            io_uring_prep_read_fixed(sqes, fd, qiov->iov[0].iov_base,
+                                     qiov->iov[0].iov_len, offset,
+                                     buf_index);
+        } else {
+            io_uring_prep_readv(sqes, fd, qiov->iov, qiov->niov, offset);
+        }
         break;
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
@@ -361,6 +710,10 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                         __func__, type);
         abort();
     }
+    if (file_index >= 0) {
+        sqes->fd = file_index;
+        io_uring_sqe_set_flags(sqes, IOSQE_FIXED_FILE);
+    }
     io_uring_sqe_set_data(sqes, luringcb);
 
     QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
@@ -389,7 +742,7 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
         .co         = qemu_coroutine_self(),
         .ret        = -EINPROGRESS,
         .qiov       = qiov,
-        .is_read    = (type == QEMU_AIO_READ),
+        .is_read    = ((type & QEMU_AIO_TYPE_MASK) == QEMU_AIO_READ),
     };
     trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
                            type);
@@ -422,7 +775,7 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(bool sqpoll, Error **errp)
 {
     int rc;
     LuringState *s = g_new0(LuringState, 1);
@@ -430,20 +783,41 @@ LuringState *luring_init(Error **errp)
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
-    if (rc < 0) {
-        error_setg_errno(errp, errno, "failed to init linux io_uring ring");
-        g_free(s);
-        return NULL;
+    if (sqpoll) {
+        rc = io_uring_queue_init(MAX_ENTRIES, ring, IORING_SETUP_SQPOLL);
+        if (rc < 0) {
+            warn_report("io_uring submission queue polling is not available "
+                        "(%s), using system calls to submit requests",
+                        strerror(-rc));
+            sqpoll = false;
+        }
+    }
+    if (!sqpoll) {
+        rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+        if (rc < 0) {
+            error_setg_errno(errp, errno, "failed to init linux io_uring ring");
+            g_free(s);
+            return NULL;
+        }
     }
 
     ioq_init(&s->io_q);
+
+    WITH_QEMU_LOCK_GUARD(&luring_lock) {
+        luring_init_fixed_files(s);
+        luring_init_fixed_bufs(s);
+        QLIST_INSERT_HEAD(&luring_states, s, next);
+    }
     return s;
 
 }
 
 void luring_cleanup(LuringState *s)
 {
+    WITH_QEMU_LOCK_GUARD(&luring_lock) {
+        QLIST_REMOVE(s, next);
+    }
+    qemu_mutex_destroy(&s->fixed_files_lock);
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
     g_free(s);
@@ -24,10 +24,13 @@
 #include "qemu/ratelimit.h"
 #include "qemu/bitmap.h"
 #include "qemu/memalign.h"
+#include "qemu/stats64.h"
 
 #define MAX_IN_FLIGHT 16
 #define MAX_IO_BYTES (1 << 20) /* 1 Mb */
 #define DEFAULT_MIRROR_BUF_SIZE (MAX_IN_FLIGHT * MAX_IO_BYTES)
+/* Number of block status extents looked up ahead of the copy operations */
+#define MIRROR_STATUS_PREFETCH 8
 
 /* The mirroring buffer is a list of granularity-sized chunks.
  * Free chunks are organized in a list.
@@ -93,6 +96,21 @@ typedef struct MirrorBlockJob {
     int64_t active_write_bytes_in_flight;
     bool prepared;
     bool in_drain;
+
+    /*
+     * Maximum size of a copy operation.  It grows while the source data stays
+     * put and shrinks when guest writes hit copies in flight, see
+     * mirror_adapt_chunk_size().  To be read with atomics outside the job.
+     */
+    int chunk_size;
+    int max_chunk_size;
+
+    /* Telemetry, see mirror_account_op() */
+    int64_t stats_window_start_ns;
+    int64_t stats_window_bytes;
+    Stat64 avg_latency_ns;
+    Stat64 throughput;
+    bool stats_valid;
 } MirrorBlockJob;
 
 typedef struct MirrorBDSOpaque {
@@ -114,6 +132,11 @@ struct MirrorOp {
     bool is_pseudo_op;
     bool is_active_write;
     bool is_in_flight;
+    /* Background copy of the source data (as opposed to zero or discard) */
+    bool is_copy;
+    /* The guest wrote to the area while the copy was in flight */
+    bool redirtied;
+    int64_t start_ns;
     CoQueue waiting_requests;
     Coroutine *co;
     MirrorOp *waiting_for_op;
@@ -193,6 +216,70 @@ static void coroutine_fn mirror_wait_on_conflicts(MirrorOp *self,
     }
 }
 
+/*
+ * A copy that the guest overwrote while it was in flight has to be done
+ * again, so copy hot areas in small pieces, but go for large requests as
+ * long as the data stays put.
+ */
+static void mirror_adapt_chunk_size(MirrorBlockJob *s, MirrorOp *op)
+{
+    int old = s->chunk_size;
+    int chunk_size = old;
+
+    if (op->redirtied) {
+        chunk_size = MAX(chunk_size / 2, s->granularity);
+    } else if (op->bytes >= chunk_size) {
+        chunk_size = MIN(chunk_size * 2, s->max_chunk_size);
+    }
+    chunk_size = QEMU_ALIGN_DOWN(chunk_size, s->granularity);
+
+    if (chunk_size != old) {
+        trace_mirror_chunk_size(s, old, chunk_size);
+        qatomic_set(&s->chunk_size, chunk_size);
+    }
+}
+
+/*
+ * Update the job telemetry: a moving average of the operation latency, and
+ * the throughput over the last window of at least one second.
+ */
+static void mirror_account_op(MirrorBlockJob *s, MirrorOp *op)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t latency = now - op->start_ns;
+    uint64_t avg = stat64_get(&s->avg_latency_ns);
+    int64_t elapsed;
+
+    stat64_set(&s->avg_latency_ns, avg ? avg - avg / 8 + latency / 8 : latency);
+
+    s->stats_window_bytes += op->bytes;
+    elapsed = now - s->stats_window_start_ns;
+    if (elapsed >= NANOSECONDS_PER_SECOND) {
+        stat64_set(&s->throughput,
+                   s->stats_window_bytes * 1000 / (elapsed / SCALE_MS));
+        s->stats_window_start_ns = now;
+        s->stats_window_bytes = 0;
+        qatomic_set(&s->stats_valid, true);
+    }
+}
+
+/*
+ * Called for guest writes that the background copy will have to redo; the
+ * copies of that area that are still in flight are wasted.
+ */
+static void mirror_note_redirtied(MirrorBlockJob *s, uint64_t offset,
+                                  uint64_t bytes)
+{
+    MirrorOp *op;
+
+    QTAILQ_FOREACH(op, &s->ops_in_flight, next) {
+        if (op->is_copy &&
+            ranges_overlap(offset, bytes, op->offset, op->bytes)) {
+            op->redirtied = true;
+        }
+    }
+}
+
 static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
 {
     MirrorBlockJob *s = op->s;
@@ -223,6 +310,10 @@ static void coroutine_fn mirror_iteration_done(MirrorOp *op, int ret)
         if (!s->initial_zeroing_ongoing) {
             job_progress_update(&s->common.job, op->bytes);
         }
+        if (op->is_copy) {
+            mirror_adapt_chunk_size(s, op);
+        }
+        mirror_account_op(s, op);
     }
     qemu_iovec_destroy(&op->qiov);
 
@@ -446,6 +537,8 @@ static unsigned mirror_perform(MirrorBlockJob *s, int64_t offset,
         .offset         = offset,
         .bytes          = bytes,
         .bytes_handled  = &bytes_handled,
+        .is_copy        = mirror_method == MIRROR_METHOD_COPY,
+        .start_ns       = qemu_clock_get_ns(QEMU_CLOCK_REALTIME),
     };
     qemu_co_queue_init(&op->waiting_requests);
 
@@ -479,15 +572,120 @@ static unsigned mirror_perform(MirrorBlockJob *s, int64_t offset,
     return bytes_handled;
 }
 
+typedef struct MirrorStatusExtent {
+    int64_t offset;
+    int64_t bytes;
+    int ret;
+} MirrorStatusExtent;
+
+/*
+ * Block status of the area handled by one mirror_iteration(), looked up by a
+ * separate coroutine so that the (possibly slow) status queries overlap with
+ * the copy operations instead of being issued between them.
+ */
+typedef struct MirrorStatusPrefetch {
+    BlockDriverState *source;
+    /* Next offset to query and end of the area */
+    int64_t offset;
+    int64_t end;
+    /* Ring of extents that have not been consumed yet */
+    MirrorStatusExtent extents[MIRROR_STATUS_PREFETCH];
+    int head;
+    int count;
+    bool stop;
+    bool done;
+    /* Wakes up the producer when an extent was consumed, and vice versa */
+    CoQueue queue;
+} MirrorStatusPrefetch;
+
+static void coroutine_fn mirror_status_prefetch_co(void *opaque)
+{
+    MirrorStatusPrefetch *p = opaque;
+
+    while (!p->stop && p->offset < p->end) {
+        MirrorStatusExtent *e;
+        int64_t bytes;
+        int ret;
+
+        if (p->count == MIRROR_STATUS_PREFETCH) {
+            qemu_co_queue_wait(&p->queue, NULL);
+            continue;
+        }
+
+        WITH_GRAPH_RDLOCK_GUARD() {
+            ret = bdrv_co_block_status_above(p->source, NULL, p->offset,
+                                             p->end - p->offset, &bytes,
+                                             NULL, NULL);
+        }
+        if (ret < 0) {
+            /* The consumer copies whatever is left */
+            bytes = p->end - p->offset;
+        } else if (bytes == 0) {
+            break;
+        }
+
+        e = &p->extents[(p->head + p->count) % MIRROR_STATUS_PREFETCH];
+        *e = (MirrorStatusExtent) {
+            .offset = p->offset,
+            .bytes  = bytes,
+            .ret    = ret,
+        };
+        p->count++;
+        p->offset += bytes;
+        qemu_co_queue_restart_all(&p->queue);
+    }
+
+    p->done = true;
+    qemu_co_queue_restart_all(&p->queue);
+}
+
+/*
+ * Return the block status at @offset, like bdrv_co_block_status_above(), from
+ * the extents prefetched by mirror_status_prefetch_co().  Offsets must be
+ * passed in increasing order.
+ */
+static int coroutine_fn mirror_status_get(MirrorStatusPrefetch *p,
+                                          int64_t offset, int64_t *pnum)
+{
+    for (;;) {
+        while (p->count) {
+            MirrorStatusExtent *e = &p->extents[p->head];
+
+            if (e->offset + e->bytes > offset) {
+                assert(e->offset <= offset);
+                *pnum = e->offset + e->bytes - offset;
+                return e->ret;
+            }
+            p->head = (p->head + 1) % MIRROR_STATUS_PREFETCH;
+            p->count--;
+            qemu_co_queue_restart_all(&p->queue);
+        }
+        if (p->done) {
+            *pnum = 0;
+            return -EIO;
+        }
+        qemu_co_queue_wait(&p->queue, NULL);
+    }
+}
+
+static void coroutine_fn mirror_status_prefetch_stop(MirrorStatusPrefetch *p)
+{
+    p->stop = true;
+    qemu_co_queue_restart_all(&p->queue);
+    while (!p->done) {
+        qemu_co_queue_wait(&p->queue, NULL);
+    }
+}
+
 static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
 {
     BlockDriverState *source = s->mirror_top_bs->backing->bs;
     MirrorOp *pseudo_op;
+    MirrorStatusPrefetch prefetch;
     int64_t offset;
     /* At least the first dirty chunk is mirrored in one iteration. */
     int nb_chunks = 1;
     bool write_zeroes_ok = bdrv_can_write_zeroes_with_unmap(blk_bs(s->target));
-    int max_io_bytes = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
 
     bdrv_dirty_bitmap_lock(s->dirty_bitmap);
     offset = bdrv_dirty_iter_next(s->dbi);
@@ -537,7 +735,8 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
 
     /* Clear dirty bits before querying the block status, because
      * calling bdrv_block_status_above could yield - if some blocks are
-     * marked dirty in this window, we need to know.
+     * marked dirty in this window, we need to know.  This also covers the
+     * status prefetched for the whole area below.
      */
     bdrv_reset_dirty_bitmap_locked(s->dirty_bitmap, offset,
                                    nb_chunks * s->granularity);
@@ -559,6 +758,16 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
     QTAILQ_INSERT_TAIL(&s->ops_in_flight, pseudo_op, next);
 
     bitmap_set(s->in_flight_bitmap, offset / s->granularity, nb_chunks);
+
+    prefetch = (MirrorStatusPrefetch) {
+        .source = source,
+        .offset = offset,
+        .end    = MIN(offset + nb_chunks * s->granularity, s->bdev_length),
+    };
+    qemu_co_queue_init(&prefetch.queue);
+    qemu_coroutine_enter(qemu_coroutine_create(mirror_status_prefetch_co,
+                                               &prefetch));
+
     while (nb_chunks > 0 && offset < s->bdev_length) {
         int ret;
         int64_t io_bytes;
@@ -566,15 +775,11 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
         MirrorMethod mirror_method = MIRROR_METHOD_COPY;
 
         assert(!(offset % s->granularity));
-        WITH_GRAPH_RDLOCK_GUARD() {
-            ret = bdrv_co_block_status_above(source, NULL, offset,
-                                             nb_chunks * s->granularity,
-                                             &io_bytes, NULL, NULL);
-        }
+        ret = mirror_status_get(&prefetch, offset, &io_bytes);
         if (ret < 0) {
-            io_bytes = MIN(nb_chunks * s->granularity, max_io_bytes);
+            io_bytes = MIN(nb_chunks * s->granularity, s->chunk_size);
         } else if (ret & BDRV_BLOCK_DATA) {
-            io_bytes = MIN(io_bytes, max_io_bytes);
+            io_bytes = MIN(io_bytes, s->chunk_size);
         }
 
         io_bytes -= io_bytes % s->granularity;
@@ -619,6 +824,7 @@ static void coroutine_fn GRAPH_RDLOCK mirror_iteration(MirrorBlockJob *s)
     }
 
 fail:
+    mirror_status_prefetch_stop(&prefetch);
     QTAILQ_REMOVE(&s->ops_in_flight, pseudo_op, next);
     qemu_co_queue_restart_all(&pseudo_op->waiting_requests);
     g_free(pseudo_op);
@@ -1014,6 +1220,13 @@ static int coroutine_fn mirror_run(Job *job, Error **errp)
     s->max_iov = MIN(bs->bl.max_iov, target_bs->bl.max_iov);
     bdrv_graph_co_rdunlock();
 
+    s->chunk_size = MAX(s->buf_size / MAX_IN_FLIGHT, MAX_IO_BYTES);
+    s->chunk_size = MAX(QEMU_ALIGN_DOWN(s->chunk_size, s->granularity),
+                        s->granularity);
+    s->max_chunk_size = MAX(QEMU_ALIGN_DOWN(s->buf_size / 4, s->granularity),
+                            s->chunk_size);
+    s->stats_window_start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
     s->buf = qemu_try_blockalign(bs, s->buf_size);
     if (s->buf == NULL) {
         ret = -ENOMEM;
@@ -1310,6 +1523,15 @@ static void mirror_query(BlockJob *job, BlockJobInfo *info)
     info->u.mirror = (BlockJobInfoMirror) {
         .actively_synced = qatomic_read(&s->actively_synced),
     };
+
+    if (qatomic_read(&s->stats_valid)) {
+        info->u.mirror.has_chunk_size = true;
+        info->u.mirror.chunk_size = qatomic_read(&s->chunk_size);
+        info->u.mirror.has_throughput = true;
+        info->u.mirror.throughput = stat64_get(&s->throughput);
+        info->u.mirror.has_latency_ns = true;
+        info->u.mirror.latency_ns = stat64_get(&s->avg_latency_ns);
+    }
 }
 
 static const BlockJobDriver mirror_job_driver = {
@@ -1572,6 +1794,7 @@ bdrv_mirror_top_do_write(BlockDriverState *bs, MirrorMethod method,
     if (!copy_to_target && s->job && s->job->dirty_bitmap) {
         qatomic_set(&s->job->actively_synced, false);
         bdrv_set_dirty_bitmap(s->job->dirty_bitmap, offset, bytes);
+        mirror_note_redirtied(s->job, offset, bytes);
     }
 
     if (ret < 0) {
@@ -1328,6 +1328,18 @@ store_bitmap_data(BlockDriverState *bs, BdrvDirtyBitmap *bitmap,
                                                           end - offset);
         assert(write_size <= s->cluster_size);
 
+        /*
+         * A cluster that would only hold ones is stored as a flag in the
+         * bitmap table.  The last, partial cluster is written out as usual.
+         */
+        if (end - offset == limit &&
+            bdrv_dirty_bitmap_next_zero(bitmap, offset, limit) < 0)
+        {
+            tb[cluster] = BME_TABLE_ENTRY_FLAG_ALL_ONES;
+            offset = end;
+            continue;
+        }
+
         off = qcow2_alloc_clusters(bs, s->cluster_size);
         if (off < 0) {
             error_setg_errno(errp, -off,
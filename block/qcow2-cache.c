@@ -32,7 +32,11 @@ typedef struct Qcow2CachedTable {
     int64_t  offset;
     uint64_t lru_counter;
     int      ref;
+    /* Next entry in the same hash bucket, or -1 */
+    int      hash_next;
     bool     dirty;
+    /* Used since the clock hand last went past the entry */
+    bool     referenced;
 } Qcow2CachedTable;
 
 struct Qcow2Cache {
@@ -44,6 +48,17 @@ struct Qcow2Cache {
     void                   *table_array;
     uint64_t                lru_counter;
     uint64_t                cache_clean_lru_counter;
+
+    /*
+     * Cached tables are indexed by offset in a chained hash table, and
+     * the replacement victim is chosen with the CLOCK algorithm, so
+     * that neither a lookup nor a miss has to scan the whole cache.
+     */
+    int                    *hash_buckets;
+    unsigned                hash_bits;
+    int                     clock_hand;
+
+    Qcow2CacheStats         stats;
 };
 
 static inline void *qcow2_cache_get_table_addr(Qcow2Cache *c, int table)
@@ -59,6 +74,50 @@ static inline int qcow2_cache_get_table_idx(Qcow2Cache *c, void *table)
     return idx;
 }
 
+static inline unsigned qcow2_cache_hash(Qcow2Cache *c, uint64_t offset)
+{
+    return ((offset / c->table_size) * 0x9e3779b97f4a7c15ULL) >>
+           (64 - c->hash_bits);
+}
+
+static int qcow2_cache_lookup(Qcow2Cache *c, uint64_t offset)
+{
+    int i = c->hash_buckets[qcow2_cache_hash(c, offset)];
+
+    while (i != -1 && c->entries[i].offset != offset) {
+        i = c->entries[i].hash_next;
+    }
+    return i;
+}
+
+static void qcow2_cache_hash_insert(Qcow2Cache *c, int i)
+{
+    int *bucket = &c->hash_buckets[qcow2_cache_hash(c, c->entries[i].offset)];
+
+    c->entries[i].hash_next = *bucket;
+    *bucket = i;
+}
+
+/* Drop entry @i from the cache index, leaving it free for reuse */
+static void qcow2_cache_hash_remove(Qcow2Cache *c, int i)
+{
+    int *link;
+
+    if (!c->entries[i].offset) {
+        return;
+    }
+
+    link = &c->hash_buckets[qcow2_cache_hash(c, c->entries[i].offset)];
+    while (*link != i) {
+        assert(*link != -1);
+        link = &c->entries[*link].hash_next;
+    }
+    *link = c->entries[i].hash_next;
+
+    c->entries[i].hash_next = -1;
+    c->entries[i].offset = 0;
+}
+
 static inline const char *qcow2_cache_get_name(BDRVQcow2State *s, Qcow2Cache *c)
 {
     if (c == s->refcount_block_cache) {
@@ -106,7 +165,7 @@ void qcow2_cache_clean_unused(Qcow2Cache *c)
 
         /* And count how many we can clean in a row */
         while (i < c->size && can_clean_entry(c, i)) {
-            c->entries[i].offset = 0;
+            qcow2_cache_hash_remove(c, i);
             c->entries[i].lru_counter = 0;
             i++;
             to_clean++;
@@ -125,6 +184,7 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2Cache *c;
+    int i;
 
     assert(num_tables > 0);
     assert(is_power_of_2(table_size));
@@ -138,11 +198,23 @@ Qcow2Cache *qcow2_cache_create(BlockDriverState *bs, int num_tables,
     c->table_array = qemu_try_blockalign(bs->file->bs,
                                          (size_t) num_tables * c->table_size);
 
-    if (!c->entries || !c->table_array) {
+    /* Between one and two buckets per entry */
+    c->hash_bits = MAX(ctz32(pow2ceil(num_tables)), 1);
+    c->hash_buckets = g_try_new(int, 1U << c->hash_bits);
+
+    if (!c->entries || !c->table_array || !c->hash_buckets) {
         qemu_vfree(c->table_array);
+        g_free(c->hash_buckets);
         g_free(c->entries);
         g_free(c);
-        c = NULL;
+        return NULL;
+    }
+
+    for (i = 0; i < (1 << c->hash_bits); i++) {
+        c->hash_buckets[i] = -1;
+    }
+    for (i = 0; i < num_tables; i++) {
+        c->entries[i].hash_next = -1;
     }
 
     return c;
@@ -157,6 +229,7 @@ int qcow2_cache_destroy(Qcow2Cache *c)
     }
 
     qemu_vfree(c->table_array);
+    g_free(c->hash_buckets);
     g_free(c->entries);
     g_free(c);
 
@@ -233,6 +306,7 @@ qcow2_cache_entry_flush(BlockDriverState *bs, Qcow2Cache *c, int i)
     }
 
     c->entries[i].dirty = false;
+    c->stats.writebacks++;
 
     return 0;
 }
@@ -311,15 +385,51 @@ int qcow2_cache_empty(BlockDriverState *bs, Qcow2Cache *c)
         assert(c->entries[i].ref == 0);
         c->entries[i].offset = 0;
         c->entries[i].lru_counter = 0;
+        c->entries[i].hash_next = -1;
+        c->entries[i].referenced = false;
+    }
+    for (i = 0; i < (1 << c->hash_bits); i++) {
+        c->hash_buckets[i] = -1;
     }
 
     qcow2_cache_table_release(c, 0, c->size);
 
     c->lru_counter = 0;
+    c->clock_hand = 0;
 
     return 0;
 }
 
+/*
+ * Pick the entry to replace on a miss: the first free entry, or the first
+ * unused one that was not referenced since the clock hand last swept past
+ * it.  Returns -1 if all entries are in use.
+ */
+static int qcow2_cache_find_victim(Qcow2Cache *c)
+{
+    int n;
+
+    /* Two rounds: the first one may only clear the referenced bits */
+    for (n = 0; n < 2 * c->size; n++) {
+        int i = c->clock_hand;
+        Qcow2CachedTable *t = &c->entries[i];
+
+        if (++c->clock_hand == c->size) {
+            c->clock_hand = 0;
+        }
+
+        if (t->ref) {
+            continue;
+        }
+        if (t->offset && t->referenced) {
+            t->referenced = false;
+            continue;
+        }
+        return i;
+    }
+    return -1;
+}
+
 static int GRAPH_RDLOCK
 qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
                    void **table, bool read_from_disk)
@@ -327,9 +437,6 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     BDRVQcow2State *s = bs->opaque;
     int i;
     int ret;
-    int lookup_index;
-    uint64_t min_lru_counter = UINT64_MAX;
-    int min_lru_index = -1;
 
     assert(offset != 0);
 
@@ -344,29 +451,21 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     /* Check if the table is already cached */
-    i = lookup_index = (offset / c->table_size * 4) % c->size;
-    do {
-        const Qcow2CachedTable *t = &c->entries[i];
-        if (t->offset == offset) {
-            goto found;
-        }
-        if (t->ref == 0 && t->lru_counter < min_lru_counter) {
-            min_lru_counter = t->lru_counter;
-            min_lru_index = i;
-        }
-        if (++i == c->size) {
-            i = 0;
-        }
-    } while (i != lookup_index);
+    i = qcow2_cache_lookup(c, offset);
+    if (i != -1) {
+        c->stats.hits++;
+        goto found;
+    }
+    c->stats.misses++;
 
-    if (min_lru_index == -1) {
+    i = qcow2_cache_find_victim(c);
+    if (i == -1) {
         /* This can't happen in current synchronous code, but leave the check
          * here as a reminder for whoever starts using AIO with the cache */
         abort();
     }
 
     /* Cache miss: write a table back and replace it */
-    i = min_lru_index;
     trace_qcow2_cache_get_replace_entry(qemu_coroutine_self(),
                                         c == s->l2_table_cache, i);
 
@@ -377,7 +476,10 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 
     trace_qcow2_cache_get_read(qemu_coroutine_self(),
                                c == s->l2_table_cache, i);
-    c->entries[i].offset = 0;
+    if (c->entries[i].offset) {
+        c->stats.evictions++;
+        qcow2_cache_hash_remove(c, i);
+    }
     if (read_from_disk) {
         if (c == s->l2_table_cache) {
             BLKDBG_EVENT(bs->file, BLKDBG_L2_LOAD);
@@ -391,6 +493,7 @@ qcow2_cache_do_get(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
     }
 
     c->entries[i].offset = offset;
+    qcow2_cache_hash_insert(c, i);
 
     /* And return the right table */
 found:
@@ -424,6 +527,7 @@ void qcow2_cache_put(Qcow2Cache *c, void **table)
 
     if (c->entries[i].ref == 0) {
         c->entries[i].lru_counter = ++c->lru_counter;
+        c->entries[i].referenced = true;
     }
 
     assert(c->entries[i].ref >= 0);
@@ -438,14 +542,9 @@ void qcow2_cache_entry_mark_dirty(Qcow2Cache *c, void *table)
 
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset)
 {
-    int i;
+    int i = qcow2_cache_lookup(c, offset);
 
-    for (i = 0; i < c->size; i++) {
-        if (c->entries[i].offset == offset) {
-            return qcow2_cache_get_table_addr(c, i);
-        }
-    }
-    return NULL;
+    return i == -1 ? NULL : qcow2_cache_get_table_addr(c, i);
 }
 
 void qcow2_cache_discard(Qcow2Cache *c, void *table)
@@ -454,9 +553,15 @@ void qcow2_cache_discard(Qcow2Cache *c, void *table)
 
     assert(c->entries[i].ref == 0);
 
-    c->entries[i].offset = 0;
+    qcow2_cache_hash_remove(c, i);
     c->entries[i].lru_counter = 0;
     c->entries[i].dirty = false;
+    c->entries[i].referenced = false;
 
     qcow2_cache_table_release(c, i, 1);
 }
+
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats)
+{
+    *stats = c->stats;
+}
@@ -1065,6 +1065,87 @@ int64_t coroutine_fn qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offs
     return i;
 }
 
+/*
+ * Allocate @nb_clusters contiguous clusters for guest data.
+ *
+ * With the alloc-run-size option set, the clusters are carved out of a
+ * run of that size that is allocated, and has its refcounts updated, in
+ * one go.  Most allocating writes thus neither search for free clusters
+ * nor touch the refcount blocks, which shortens the time they spend under
+ * s->lock, and consecutive allocations stay contiguous in the image file.
+ *
+ * The unused rest of the run is allocated but not referenced by any L2
+ * table.  It must be handed back with qcow2_release_data_clusters()
+ * before anything relies on refcounts matching the references, and is
+ * merely leaked if QEMU crashes.
+ */
+int64_t coroutine_fn qcow2_alloc_data_clusters(BlockDriverState *bs,
+                                               uint64_t nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t run_clusters = s->alloc_run_size >> s->cluster_bits;
+    int64_t offset;
+
+    if (nb_clusters >= run_clusters) {
+        return qcow2_alloc_clusters(bs, nb_clusters << s->cluster_bits);
+    }
+
+    if (nb_clusters > s->data_run_clusters) {
+        /* Let the new run start where the old one ends if possible */
+        qcow2_release_data_clusters(bs);
+
+        offset = qcow2_alloc_clusters(bs, run_clusters << s->cluster_bits);
+        if (offset < 0) {
+            return qcow2_alloc_clusters(bs, nb_clusters << s->cluster_bits);
+        }
+        s->data_run_offset = offset;
+        s->data_run_clusters = run_clusters;
+    }
+
+    offset = s->data_run_offset;
+    s->data_run_offset += nb_clusters << s->cluster_bits;
+    s->data_run_clusters -= nb_clusters;
+
+    trace_qcow2_alloc_data_clusters(qemu_coroutine_self(), offset,
+                                    nb_clusters, s->data_run_clusters);
+    return offset;
+}
+
+/*
+ * Like qcow2_alloc_clusters_at(), but takes the clusters from the data
+ * cluster run when @offset is where the run continues.
+ */
+int64_t coroutine_fn qcow2_alloc_data_clusters_at(BlockDriverState *bs,
+                                                  uint64_t offset,
+                                                  int64_t nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (s->data_run_clusters && offset == s->data_run_offset) {
+        nb_clusters = MIN(nb_clusters, s->data_run_clusters);
+        s->data_run_offset += nb_clusters << s->cluster_bits;
+        s->data_run_clusters -= nb_clusters;
+        return nb_clusters;
+    }
+
+    return qcow2_alloc_clusters_at(bs, offset, nb_clusters);
+}
+
+/* Free the clusters of the data cluster run that were not used yet */
+void qcow2_release_data_clusters(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (!s->data_run_clusters) {
+        return;
+    }
+
+    qcow2_free_clusters(bs, s->data_run_offset,
+                        s->data_run_clusters << s->cluster_bits,
+                        QCOW2_DISCARD_NEVER);
+    s->data_run_clusters = 0;
+}
+
 /* only used to allocate compressed sectors. We try to allocate
    contiguous sectors. size must be <= cluster_size */
 int64_t coroutine_fn GRAPH_RDLOCK qcow2_alloc_bytes(BlockDriverState *bs, int size)
@@ -614,6 +614,9 @@ qcow2_co_check_locked(BlockDriverState *bs, BdrvCheckResult *result,
 
     memset(result, 0, sizeof(*result));
 
+    /* Reserved data clusters would show up as leaks */
+    qcow2_release_data_clusters(bs);
+
     ret = qcow2_check_read_snapshot_table(bs, &snapshot_res, fix);
     if (ret < 0) {
         qcow2_add_check_result(result, &snapshot_res, false);
@@ -701,6 +704,7 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_ALLOC_RUN_SIZE,
     NULL
 };
 
@@ -817,6 +821,11 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_ALLOC_RUN_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "Allocate data clusters in runs of this size",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -979,6 +988,7 @@ typedef struct Qcow2ReopenState {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     bool discard_no_unref;
     uint64_t cache_clean_interval;
+    uint64_t alloc_run_size;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1079,6 +1089,14 @@ qcow2_update_options_prepare(BlockDriverState *bs, Qcow2ReopenState *r,
         goto fail;
     }
 
+    r->alloc_run_size = qemu_opt_get_size(opts, QCOW2_OPT_ALLOC_RUN_SIZE, 0);
+    if (r->alloc_run_size > BDRV_REQUEST_MAX_BYTES) {
+        error_setg(errp, QCOW2_OPT_ALLOC_RUN_SIZE " must not exceed %"
+                   PRIu64, (uint64_t) BDRV_REQUEST_MAX_BYTES);
+        ret = -EINVAL;
+        goto fail;
+    }
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1238,6 +1256,7 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
     }
 
     s->discard_no_unref = r->discard_no_unref;
+    s->alloc_run_size = r->alloc_run_size;
 
     if (s->cache_clean_interval != r->cache_clean_interval) {
         cache_clean_timer_del(bs);
@@ -1992,6 +2011,8 @@ qcow2_reopen_prepare(BDRVReopenState *state,BlockReopenQueue *queue,
 
     /* We need to write out any unwritten data if we reopen read-only. */
     if ((state->flags & BDRV_O_RDWR) == 0) {
+        qcow2_release_data_clusters(state->bs);
+
         ret = qcow2_reopen_bitmaps_ro(state->bs, errp);
         if (ret < 0) {
             goto fail;
@@ -2748,6 +2769,8 @@ static int GRAPH_RDLOCK qcow2_inactivate(BlockDriverState *bs)
     int ret, result = 0;
     Error *local_err = NULL;
 
+    qcow2_release_data_clusters(bs);
+
     qcow2_store_persistent_dirty_bitmaps(bs, true, &local_err);
     if (local_err != NULL) {
         result = -EINVAL;
@@ -4305,6 +4328,9 @@ qcow2_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
 
     qemu_co_mutex_lock(&s->lock);
 
+    /* Let the image end be computed from the clusters actually in use */
+    qcow2_release_data_clusters(bs);
+
     /*
      * Even though we store snapshot size for all images, it was not
      * required until v3, so it is not safe to proceed for v2.
@@ -5005,6 +5031,8 @@ static int GRAPH_RDLOCK qcow2_make_empty(BlockDriverState *bs)
 
     l1_clusters = DIV_ROUND_UP(s->l1_size, s->cluster_size / L1E_SIZE);
 
+    qcow2_release_data_clusters(bs);
+
     if (s->qcow_version >= 3 && !s->snapshots && !s->nb_bitmaps &&
         3 + l1_clusters <= s->refcount_block_size &&
         s->crypt_method_header != QCOW_CRYPT_LUKS &&
@@ -5311,6 +5339,34 @@ qcow2_get_specific_info(BlockDriverState *bs, Error **errp)
     return spec_info;
 }
 
+static BlockStatsQcow2Cache *qcow2_get_cache_stats(Qcow2Cache *c)
+{
+    BlockStatsQcow2Cache *info = g_new0(BlockStatsQcow2Cache, 1);
+    Qcow2CacheStats stats;
+
+    qcow2_cache_get_stats(c, &stats);
+    info->hits = stats.hits;
+    info->misses = stats.misses;
+    info->evictions = stats.evictions;
+    info->writebacks = stats.writebacks;
+
+    return info;
+}
+
+static BlockStatsSpecific *qcow2_get_specific_stats(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+
+    stats->driver = BLOCKDEV_DRIVER_QCOW2;
+    stats->u.qcow2 = (BlockStatsSpecificQcow2) {
+        .l2_cache = qcow2_get_cache_stats(s->l2_table_cache),
+        .refcount_cache = qcow2_get_cache_stats(s->refcount_block_cache),
+    };
+
+    return stats;
+}
+
 static int coroutine_mixed_fn GRAPH_RDLOCK
 qcow2_has_zero_init(BlockDriverState *bs)
 {
@@ -5759,6 +5815,9 @@ qcow2_amend_options(BlockDriverState *bs, QemuOpts *opts,
         desc++;
     }
 
+    /* Refcount order changes and downgrades walk all refcounts */
+    qcow2_release_data_clusters(bs);
+
     helper_cb_info = (Qcow2AmendHelperCBInfo){
         .original_status_cb = status_cb,
         .original_cb_opaque = cb_opaque,
@@ -6160,6 +6219,7 @@ BlockDriver bdrv_qcow2 = {
     .bdrv_measure                       = qcow2_measure,
     .bdrv_co_get_info                   = qcow2_co_get_info,
     .bdrv_get_specific_info             = qcow2_get_specific_info,
+    .bdrv_get_specific_stats            = qcow2_get_specific_stats,
 
     .bdrv_co_save_vmstate               = qcow2_co_save_vmstate,
     .bdrv_co_load_vmstate               = qcow2_co_load_vmstate,
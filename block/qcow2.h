@@ -150,6 +150,7 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_ALLOC_RUN_SIZE "alloc-run-size"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -231,6 +232,13 @@ typedef struct QCowSnapshot {
 struct Qcow2Cache;
 typedef struct Qcow2Cache Qcow2Cache;
 
+typedef struct Qcow2CacheStats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t writebacks;
+} Qcow2CacheStats;
+
 typedef struct Qcow2CryptoHeaderExtension {
     uint64_t offset;
     uint64_t length;
@@ -356,6 +364,9 @@ typedef struct BDRVQcow2State {
     uint32_t max_refcount_table_index; /* Last used entry in refcount_table */
     uint64_t free_cluster_index;
     uint64_t free_byte_offset;
+    /* Unused part of the data cluster run, see qcow2_alloc_data_clusters() */
+    uint64_t data_run_offset;
+    uint64_t data_run_clusters;
 
     CoMutex lock;
 
@@ -387,6 +398,7 @@ typedef struct BDRVQcow2State {
     bool discard_passthrough[QCOW2_DISCARD_MAX];
 
     bool discard_no_unref;
+    uint64_t alloc_run_size;
 
     int overlap_check; /* bitmask of Qcow2MetadataOverlap values */
     bool signaled_corruption;
@@ -873,6 +885,15 @@ int64_t GRAPH_RDLOCK coroutine_fn
 qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offset,
                         int64_t nb_clusters);
 
+int64_t coroutine_fn GRAPH_RDLOCK
+qcow2_alloc_data_clusters(BlockDriverState *bs, uint64_t nb_clusters);
+
+int64_t coroutine_fn GRAPH_RDLOCK
+qcow2_alloc_data_clusters_at(BlockDriverState *bs, uint64_t offset,
+                             int64_t nb_clusters);
+
+void GRAPH_RDLOCK qcow2_release_data_clusters(BlockDriverState *bs);
+
 int64_t coroutine_fn GRAPH_RDLOCK qcow2_alloc_bytes(BlockDriverState *bs, int size);
 void GRAPH_RDLOCK qcow2_free_clusters(BlockDriverState *bs,
                                       int64_t offset, int64_t size,
@@ -1021,6 +1042,7 @@ qcow2_cache_get_empty(BlockDriverState *bs, Qcow2Cache *c, uint64_t offset,
 void qcow2_cache_put(Qcow2Cache *c, void **table);
 void *qcow2_cache_is_table_offset(Qcow2Cache *c, uint64_t offset);
 void qcow2_cache_discard(Qcow2Cache *c, void *table);
+void qcow2_cache_get_stats(Qcow2Cache *c, Qcow2CacheStats *stats);
 
 /* qcow2-bitmap.c functions */
 int coroutine_fn GRAPH_RDLOCK
@@ -0,0 +1,879 @@
+/*
+ * Read cache filter block driver
+ *
+ * Keeps recently read blocks of the file child in host memory and/or in
+ * a local cache file, so that reading them again does not go to the file
+ * child.  This helps when the file child is a slow network backend and
+ * the same blocks are read over and over, e.g. by guests booting from a
+ * shared base image.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/cutils.h"
+#include "qemu/host-utils.h"
+#include "qemu/module.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "qapi/error.h"
+#include "qapi/qapi-visit-block-core.h"
+#include "block/block-io.h"
+#include "block/block_int.h"
+#include "block/qdict.h"
+#include "trace.h"
+
+#define READ_CACHE_DEFAULT_MEM_SIZE     (64 * MiB)
+#define READ_CACHE_DEFAULT_BLOCK_SIZE   (64 * KiB)
+#define READ_CACHE_MIN_BLOCK_SIZE       (4 * KiB)
+#define READ_CACHE_MAX_BLOCK_SIZE       (2 * MiB)
+/* Largest read issued to the file child to fill the cache */
+#define READ_CACHE_MAX_FILL             (1 * MiB)
+
+/*
+ * Each cache slot has one entry.  The first @mem_slots slots live in the
+ * memory pool, the others in the cache file.  An entry is in one of four
+ * states:
+ *  - free: on @free_list, holds nothing;
+ *  - cached: in @map and on @lru_list, its slot holds @block;
+ *  - reserved: on no list, its slot is being written to the cache file;
+ *  - detached: on no list, it was dropped from the cache while @readers
+ *    were still reading its slot.  The last reader frees it.
+ * The data of a cached slot never changes; a write to the block drops
+ * the entry and possibly caches the new data in another slot.
+ */
+typedef struct ReadCacheEntry {
+    uint64_t block; /* key in @map, only valid while cached */
+    bool cached;
+    int readers;
+    QTAILQ_ENTRY(ReadCacheEntry) next;
+} ReadCacheEntry;
+
+/*
+ * A request that may put blocks into the cache, either a read filling it
+ * or a write updating it.  A write to the same blocks that completes
+ * while the request is in flight marks it @stale, and it must not add
+ * its data to the cache then, as it may be outdated.
+ */
+typedef struct ReadCacheReq {
+    uint64_t first;
+    uint64_t end;
+    bool stale;
+    QLIST_ENTRY(ReadCacheReq) next;
+} ReadCacheReq;
+
+typedef struct BDRVReadCacheState {
+    BdrvChild *cache_file;
+
+    int64_t block_size;
+    int block_bits;
+    ReadCacheAdmission admission;
+    ReadCacheEviction eviction;
+    ReadCacheWriteMode write_mode;
+
+    uint8_t *mem;
+    uint64_t mem_slots;
+    uint64_t nb_slots;
+    ReadCacheEntry *entries;
+
+    /* Blocks recently missed, for ADMISSION_SECOND_HIT */
+    uint64_t *ghost;
+    uint64_t nb_ghost;
+    uint64_t ghost_next;
+    GHashTable *ghost_map;
+
+    /* Protects everything below */
+    QemuMutex lock;
+    GHashTable *map;
+    QTAILQ_HEAD(, ReadCacheEntry) free_list;
+    /* Cached entries, the one to evict first at the head */
+    QTAILQ_HEAD(, ReadCacheEntry) lru_list;
+    QLIST_HEAD(, ReadCacheReq) reqs;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t hit_bytes;
+    uint64_t miss_bytes;
+    uint64_t admissions;
+    uint64_t evictions;
+    uint64_t invalidations;
+    uint64_t nb_cached;
+} BDRVReadCacheState;
+
+static inline uint64_t read_cache_slot(BDRVReadCacheState *s,
+                                       ReadCacheEntry *entry)
+{
+    return entry - s->entries;
+}
+
+static inline bool read_cache_in_mem(BDRVReadCacheState *s,
+                                     ReadCacheEntry *entry)
+{
+    return read_cache_slot(s, entry) < s->mem_slots;
+}
+
+static inline uint8_t *read_cache_mem(BDRVReadCacheState *s,
+                                      ReadCacheEntry *entry)
+{
+    return s->mem + read_cache_slot(s, entry) * s->block_size;
+}
+
+static inline int64_t read_cache_file_offset(BDRVReadCacheState *s,
+                                             ReadCacheEntry *entry)
+{
+    return (read_cache_slot(s, entry) - s->mem_slots) * s->block_size;
+}
+
+/* Called with lock held */
+static void read_cache_entry_free(BDRVReadCacheState *s, ReadCacheEntry *entry)
+{
+    assert(!entry->cached && !entry->readers);
+    QTAILQ_INSERT_HEAD(&s->free_list, entry, next);
+}
+
+/* Called with lock held */
+static void read_cache_entry_add(BDRVReadCacheState *s, ReadCacheEntry *entry,
+                                 uint64_t block)
+{
+    entry->block = block;
+    entry->cached = true;
+    g_hash_table_add(s->map, &entry->block);
+    QTAILQ_INSERT_TAIL(&s->lru_list, entry, next);
+    s->admissions++;
+    s->nb_cached++;
+}
+
+/* Called with lock held */
+static void read_cache_entry_drop(BDRVReadCacheState *s,
+                                  ReadCacheEntry *entry)
+{
+    assert(entry->cached);
+    g_hash_table_remove(s->map, &entry->block);
+    QTAILQ_REMOVE(&s->lru_list, entry, next);
+    entry->cached = false;
+    s->nb_cached--;
+    if (!entry->readers) {
+        read_cache_entry_free(s, entry);
+    }
+}
+
+/* Called with lock held */
+static ReadCacheEntry *read_cache_lookup(BDRVReadCacheState *s, uint64_t block)
+{
+    uint64_t *key = g_hash_table_lookup(s->map, &block);
+
+    return key ? container_of(key, ReadCacheEntry, block) : NULL;
+}
+
+/*
+ * Take a free slot, evicting a cached block if needed.  Returns NULL if
+ * all slots are busy.  Called with lock held.
+ */
+static ReadCacheEntry *read_cache_get_slot(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    ReadCacheEntry *entry;
+
+    entry = QTAILQ_FIRST(&s->free_list);
+    if (entry) {
+        QTAILQ_REMOVE(&s->free_list, entry, next);
+        return entry;
+    }
+
+    QTAILQ_FOREACH(entry, &s->lru_list, next) {
+        if (!entry->readers) {
+            trace_read_cache_evict(bs, entry->block);
+            read_cache_entry_drop(s, entry);
+            s->evictions++;
+            QTAILQ_REMOVE(&s->free_list, entry, next);
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+/* Called with lock held */
+static void read_cache_put(BDRVReadCacheState *s, ReadCacheEntry *entry)
+{
+    assert(entry->readers > 0);
+    if (!--entry->readers && !entry->cached) {
+        read_cache_entry_free(s, entry);
+    }
+}
+
+/*
+ * Decide whether the blocks [@first, @end) that were just missed should
+ * be cached.  With ADMISSION_SECOND_HIT they are if the first one was
+ * missed recently; otherwise they are remembered as missed.  Called with
+ * lock held.
+ */
+static bool read_cache_admit(BDRVReadCacheState *s, uint64_t first,
+                             uint64_t end)
+{
+    gpointer key;
+    uint64_t *slot;
+    uint64_t b;
+
+    if (s->admission == READ_CACHE_ADMISSION_ALL) {
+        return true;
+    }
+
+    if (g_hash_table_remove(s->ghost_map, &first)) {
+        return true;
+    }
+
+    for (b = first; b < end; b++) {
+        if (g_hash_table_contains(s->ghost_map, &b)) {
+            continue;
+        }
+        slot = &s->ghost[s->ghost_next];
+        s->ghost_next = (s->ghost_next + 1) % s->nb_ghost;
+        /* The ring slot may still be the key of an older miss */
+        if (g_hash_table_lookup_extended(s->ghost_map, slot, &key, NULL) &&
+            key == slot) {
+            g_hash_table_remove(s->ghost_map, slot);
+        }
+        *slot = b;
+        g_hash_table_add(s->ghost_map, slot);
+    }
+    return false;
+}
+
+/* Called with lock held */
+static void read_cache_req_begin(BDRVReadCacheState *s, ReadCacheReq *req,
+                                 uint64_t first, uint64_t end)
+{
+    *req = (ReadCacheReq) {
+        .first = first,
+        .end = end,
+    };
+    QLIST_INSERT_HEAD(&s->reqs, req, next);
+}
+
+/*
+ * Drop the blocks [@first, @end) from the cache, and make sure that
+ * requests in flight do not add them back with old data.  If @updated is
+ * given, set a bit in it for each dropped block.  Called with lock held.
+ */
+static void read_cache_invalidate(BDRVReadCacheState *s, ReadCacheReq *self,
+                                  uint64_t first, uint64_t end,
+                                  unsigned long *updated)
+{
+    ReadCacheEntry *entry, *next_entry;
+    ReadCacheReq *req;
+    uint64_t b;
+
+    QLIST_FOREACH(req, &s->reqs, next) {
+        if (req != self && req->first < end && first < req->end) {
+            req->stale = true;
+        }
+    }
+
+    if (end - first > s->nb_cached) {
+        QTAILQ_FOREACH_SAFE(entry, &s->lru_list, next, next_entry) {
+            if (entry->block >= first && entry->block < end) {
+                if (updated) {
+                    set_bit(entry->block - first, updated);
+                }
+                read_cache_entry_drop(s, entry);
+                s->invalidations++;
+            }
+        }
+        return;
+    }
+
+    for (b = first; b < end; b++) {
+        entry = read_cache_lookup(s, b);
+        if (entry) {
+            if (updated) {
+                set_bit(b - first, updated);
+            }
+            read_cache_entry_drop(s, entry);
+            s->invalidations++;
+        }
+    }
+}
+
+/*
+ * Add the blocks [@first, @end), whose data is in @buf, to the cache.  If
+ * @mask is given, only those blocks whose bit is set in it are added.
+ * Blocks that land in the cache file are written there first; if that
+ * fails, they are just not cached.
+ */
+static void coroutine_fn GRAPH_RDLOCK
+read_cache_insert(BlockDriverState *bs, ReadCacheReq *req,
+                  uint64_t first, uint64_t end, uint8_t *buf,
+                  unsigned long *mask)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    g_autofree ReadCacheEntry **pending = g_new(ReadCacheEntry *, end - first);
+    ReadCacheEntry *entry;
+    uint64_t nb_pending = 0;
+    uint64_t b, i;
+    int ret;
+
+    qemu_mutex_lock(&s->lock);
+    for (b = first; b < end && !req->stale; b++) {
+        if ((mask && !test_bit(b - first, mask)) || read_cache_lookup(s, b)) {
+            continue;
+        }
+        entry = read_cache_get_slot(bs);
+        if (!entry) {
+            break;
+        }
+        entry->block = b;
+        if (read_cache_in_mem(s, entry)) {
+            memcpy(read_cache_mem(s, entry),
+                   buf + (b - first) * s->block_size, s->block_size);
+            read_cache_entry_add(s, entry, b);
+        } else {
+            pending[nb_pending++] = entry;
+        }
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    for (i = 0; i < nb_pending; i++) {
+        entry = pending[i];
+        b = entry->block;
+        ret = bdrv_co_pwrite(s->cache_file, read_cache_file_offset(s, entry),
+                             s->block_size, buf + (b - first) * s->block_size,
+                             0);
+        if (ret < 0) {
+            trace_read_cache_file_error(bs, b, ret);
+        }
+
+        qemu_mutex_lock(&s->lock);
+        if (ret >= 0 && !req->stale && !read_cache_lookup(s, b)) {
+            read_cache_entry_add(s, entry, b);
+        } else {
+            read_cache_entry_free(s, entry);
+        }
+        qemu_mutex_unlock(&s->lock);
+    }
+}
+
+/*
+ * Read the blocks [@first, @end) from the file child, copy the part of
+ * them that was asked for into @qiov and add them to the cache.
+ */
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_fill(BlockDriverState *bs, uint64_t first, uint64_t end,
+                int64_t offset, int64_t bytes,
+                QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int64_t start = first << s->block_bits;
+    int64_t len = (end - first) << s->block_bits;
+    ReadCacheReq req;
+    uint8_t *buf;
+    int ret;
+
+    buf = qemu_try_blockalign(bs->file->bs, len);
+    if (!buf) {
+        return bdrv_co_preadv_part(bs->file, offset, bytes, qiov, qiov_offset,
+                                   0);
+    }
+
+    qemu_mutex_lock(&s->lock);
+    read_cache_req_begin(s, &req, first, end);
+    qemu_mutex_unlock(&s->lock);
+
+    /* The last block may reach past the end of the file, which reads zeroes */
+    ret = bdrv_co_pread(bs->file, start, len, buf, 0);
+    if (ret >= 0) {
+        qemu_iovec_from_buf(qiov, qiov_offset, buf + (offset - start), bytes);
+        read_cache_insert(bs, &req, first, end, buf, NULL);
+    }
+
+    qemu_mutex_lock(&s->lock);
+    QLIST_REMOVE(&req, next);
+    qemu_mutex_unlock(&s->lock);
+
+    qemu_vfree(buf);
+    return ret;
+}
+
+/* Read from a cached block; @entry is held as a reader */
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_read_entry(BlockDriverState *bs, ReadCacheEntry *entry,
+                      int64_t offset, int64_t bytes,
+                      QEMUIOVector *qiov, size_t qiov_offset)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int64_t in_block = offset & (s->block_size - 1);
+
+    if (read_cache_in_mem(s, entry)) {
+        qemu_iovec_from_buf(qiov, qiov_offset,
+                            read_cache_mem(s, entry) + in_block, bytes);
+        return 0;
+    }
+
+    return bdrv_co_preadv_part(s->cache_file,
+                               read_cache_file_offset(s, entry) + in_block,
+                               bytes, qiov, qiov_offset, 0);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_preadv_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                          QEMUIOVector *qiov, size_t qiov_offset,
+                          BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    while (bytes) {
+        uint64_t block = offset >> s->block_bits;
+        uint64_t end = block + 1;
+        uint64_t last = (offset + bytes - 1) >> s->block_bits;
+        ReadCacheEntry *entry;
+        int64_t cur;
+        bool admit;
+        int ret;
+
+        qemu_mutex_lock(&s->lock);
+        entry = read_cache_lookup(s, block);
+        if (entry) {
+            cur = MIN(bytes, (end << s->block_bits) - offset);
+            entry->readers++;
+            if (s->eviction == READ_CACHE_EVICTION_LRU) {
+                QTAILQ_REMOVE(&s->lru_list, entry, next);
+                QTAILQ_INSERT_TAIL(&s->lru_list, entry, next);
+            }
+            s->hits++;
+            s->hit_bytes += cur;
+            qemu_mutex_unlock(&s->lock);
+
+            ret = read_cache_read_entry(bs, entry, offset, cur,
+                                        qiov, qiov_offset);
+
+            qemu_mutex_lock(&s->lock);
+            read_cache_put(s, entry);
+            if (ret < 0) {
+                /* Drop the block and read it from the file child instead */
+                trace_read_cache_file_error(bs, block, ret);
+                if (entry->cached) {
+                    read_cache_entry_drop(s, entry);
+                }
+                s->hits--;
+                s->hit_bytes -= cur;
+                s->misses++;
+                s->miss_bytes += cur;
+            }
+            qemu_mutex_unlock(&s->lock);
+
+            if (ret < 0) {
+                ret = bdrv_co_preadv_part(bs->file, offset, cur,
+                                          qiov, qiov_offset, 0);
+            }
+        } else {
+            /* Gather the following missed blocks into a single read */
+            while (end <= last &&
+                   end - block < READ_CACHE_MAX_FILL >> s->block_bits &&
+                   !read_cache_lookup(s, end)) {
+                end++;
+            }
+            cur = MIN(bytes, (end << s->block_bits) - offset);
+            admit = read_cache_admit(s, block, end);
+            s->misses += end - block;
+            s->miss_bytes += cur;
+            qemu_mutex_unlock(&s->lock);
+
+            trace_read_cache_fill(bs, block, end, admit);
+            if (admit) {
+                ret = read_cache_fill(bs, block, end, offset, cur,
+                                      qiov, qiov_offset);
+            } else {
+                ret = bdrv_co_preadv_part(bs->file, offset, cur,
+                                          qiov, qiov_offset, 0);
+            }
+        }
+        if (ret < 0) {
+            return ret;
+        }
+
+        offset += cur;
+        bytes -= cur;
+        qiov_offset += cur;
+    }
+
+    return 0;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pwritev_part(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                           QEMUIOVector *qiov, size_t qiov_offset,
+                           BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    uint64_t first = offset >> s->block_bits;
+    uint64_t end = DIV_ROUND_UP(offset + bytes, s->block_size);
+    /* Blocks fully overwritten by the request */
+    uint64_t full_first = DIV_ROUND_UP(offset, s->block_size);
+    uint64_t full_end = (offset + bytes) >> s->block_bits;
+    g_autofree unsigned long *updated = NULL;
+    uint8_t *buf = NULL;
+    ReadCacheReq req;
+    int ret;
+
+    if (s->write_mode == READ_CACHE_WRITE_MODE_WRITE_THROUGH &&
+        full_first < full_end) {
+        updated = bitmap_new(full_end - full_first);
+    }
+
+    qemu_mutex_lock(&s->lock);
+    read_cache_req_begin(s, &req, first, end);
+    qemu_mutex_unlock(&s->lock);
+
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+
+    qemu_mutex_lock(&s->lock);
+    if (updated) {
+        read_cache_invalidate(s, &req, first, full_first, NULL);
+        read_cache_invalidate(s, &req, full_first, full_end, updated);
+        read_cache_invalidate(s, &req, full_end, end, NULL);
+    } else {
+        read_cache_invalidate(s, &req, first, end, NULL);
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    /* Put the new data of blocks that were cached back into the cache */
+    if (ret >= 0 && updated &&
+        !bitmap_empty(updated, full_end - full_first)) {
+        int64_t len = (full_end - full_first) << s->block_bits;
+
+        buf = qemu_try_blockalign(bs->file->bs, len);
+        if (buf) {
+            qemu_iovec_to_buf(qiov, qiov_offset +
+                              (full_first << s->block_bits) - offset,
+                              buf, len);
+            read_cache_insert(bs, &req, full_first, full_end, buf, updated);
+            qemu_vfree(buf);
+        }
+    }
+
+    qemu_mutex_lock(&s->lock);
+    QLIST_REMOVE(&req, next);
+    qemu_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+/* Drop [@offset, @offset + @bytes) from the cache after it was changed */
+static void read_cache_invalidate_bytes(BlockDriverState *bs, int64_t offset,
+                                        int64_t bytes)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    qemu_mutex_lock(&s->lock);
+    read_cache_invalidate(s, NULL, offset >> s->block_bits,
+                          DIV_ROUND_UP(offset + bytes, s->block_size), NULL);
+    qemu_mutex_unlock(&s->lock);
+}
+
+/* Drop the whole cache, e.g. after the image was changed behind our back */
+static void read_cache_invalidate_all(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    qemu_mutex_lock(&s->lock);
+    read_cache_invalidate(s, NULL, 0, UINT64_MAX, NULL);
+    qemu_mutex_unlock(&s->lock);
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pwrite_zeroes(BlockDriverState *bs, int64_t offset,
+                            int64_t bytes, BdrvRequestFlags flags)
+{
+    int ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+
+    read_cache_invalidate_bytes(bs, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
+{
+    int ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+
+    read_cache_invalidate_bytes(bs, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn GRAPH_RDLOCK
+read_cache_co_truncate(BlockDriverState *bs, int64_t offset, bool exact,
+                       PreallocMode prealloc, BdrvRequestFlags flags,
+                       Error **errp)
+{
+    int ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+
+    read_cache_invalidate_all(bs);
+    return ret;
+}
+
+static void coroutine_fn GRAPH_RDLOCK
+read_cache_co_invalidate_cache(BlockDriverState *bs, Error **errp)
+{
+    /* The image may have been changed by someone else while inactive */
+    read_cache_invalidate_all(bs);
+}
+
+static int64_t coroutine_fn GRAPH_RDLOCK
+read_cache_co_getlength(BlockDriverState *bs)
+{
+    return bdrv_co_getlength(bs->file->bs);
+}
+
+static void GRAPH_RDLOCK read_cache_refresh_filename(BlockDriverState *bs)
+{
+    pstrcpy(bs->exact_filename, sizeof(bs->exact_filename),
+            bs->file->bs->filename);
+}
+
+static void GRAPH_RDLOCK
+read_cache_child_perm(BlockDriverState *bs, BdrvChild *c, BdrvChildRole role,
+                      BlockReopenQueue *reopen_queue,
+                      uint64_t perm, uint64_t shared,
+                      uint64_t *nperm, uint64_t *nshared)
+{
+    if (!(role & BDRV_CHILD_FILTERED)) {
+        /* Cache file child: nobody else may change what we have cached */
+        *nperm = BLK_PERM_CONSISTENT_READ;
+        *nshared = BLK_PERM_ALL & ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+        if (!(bs->open_flags & BDRV_O_INACTIVE)) {
+            *nperm |= BLK_PERM_WRITE;
+        }
+    } else {
+        bdrv_default_perms(bs, c, role, reopen_queue,
+                           perm, shared, nperm, nshared);
+        /* Writes that bypass the filter would leave stale data cached */
+        *nshared &= ~(BLK_PERM_WRITE | BLK_PERM_RESIZE);
+    }
+}
+
+static BlockStatsSpecific *read_cache_get_specific_stats(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    BlockStatsSpecific *stats = g_new(BlockStatsSpecific, 1);
+
+    stats->driver = BLOCKDEV_DRIVER_READ_CACHE;
+
+    qemu_mutex_lock(&s->lock);
+    stats->u.read_cache = (BlockStatsSpecificReadCache) {
+        .hits = s->hits,
+        .misses = s->misses,
+        .hit_bytes = s->hit_bytes,
+        .miss_bytes = s->miss_bytes,
+        .admissions = s->admissions,
+        .evictions = s->evictions,
+        .invalidations = s->invalidations,
+        .cached_bytes = s->nb_cached * s->block_size,
+    };
+    qemu_mutex_unlock(&s->lock);
+
+    return stats;
+}
+
+static BlockdevOptions *read_cache_parse_options(QDict *options, Error **errp)
+{
+    BlockdevOptions *opts = NULL;
+    Visitor *v = NULL;
+
+    qdict_put_str(options, "driver", "read-cache");
+
+    v = qobject_input_visitor_new_flat_confused(options, errp);
+    if (!v) {
+        goto out;
+    }
+
+    visit_type_BlockdevOptions(v, NULL, &opts, errp);
+    if (!opts) {
+        goto out;
+    }
+
+    /*
+     * Delete options which we are going to parse through BlockdevOptions
+     * object for original options.
+     */
+    qdict_del(options, "mem-size");
+    qdict_del(options, "block-size");
+    qdict_del(options, "admission");
+    qdict_del(options, "eviction");
+    qdict_del(options, "write-mode");
+
+out:
+    visit_free(v);
+    qdict_del(options, "driver");
+
+    return opts;
+}
+
+static int read_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                           Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    g_autoptr(BlockdevOptions) full_opts = NULL;
+    BlockdevOptionsReadCache *opts;
+    uint64_t mem_size, file_slots = 0;
+    uint64_t i;
+    int ret;
+
+    GLOBAL_STATE_CODE();
+
+    full_opts = read_cache_parse_options(options, errp);
+    if (!full_opts) {
+        return -EINVAL;
+    }
+    assert(full_opts->driver == BLOCKDEV_DRIVER_READ_CACHE);
+    opts = &full_opts->u.read_cache;
+
+    s->block_size = opts->has_block_size ? opts->block_size :
+        READ_CACHE_DEFAULT_BLOCK_SIZE;
+    if (s->block_size < READ_CACHE_MIN_BLOCK_SIZE ||
+        s->block_size > READ_CACHE_MAX_BLOCK_SIZE ||
+        !is_power_of_2(s->block_size)) {
+        error_setg(errp, "block-size must be a power of two between %"
+                   PRId64 " and %" PRId64, READ_CACHE_MIN_BLOCK_SIZE,
+                   READ_CACHE_MAX_BLOCK_SIZE);
+        return -EINVAL;
+    }
+    s->block_bits = ctz64(s->block_size);
+    s->admission = opts->has_admission ? opts->admission :
+        READ_CACHE_ADMISSION_ALL;
+    s->eviction = opts->has_eviction ? opts->eviction :
+        READ_CACHE_EVICTION_LRU;
+    s->write_mode = opts->has_write_mode ? opts->write_mode :
+        READ_CACHE_WRITE_MODE_WRITE_THROUGH;
+    mem_size = opts->has_mem_size ? opts->mem_size :
+        opts->cache_file ? 0 : READ_CACHE_DEFAULT_MEM_SIZE;
+
+    ret = bdrv_open_file_child(NULL, options, "file", bs, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (opts->cache_file) {
+        /* The cache file is written to even if the filter is read-only */
+        if (opts->cache_file->type == QTYPE_QDICT) {
+            qdict_set_default_str(options, "cache-file." BDRV_OPT_READ_ONLY,
+                                  "off");
+        }
+        s->cache_file = bdrv_open_child(NULL, options, "cache-file", bs,
+                                        &child_of_bds, BDRV_CHILD_DATA,
+                                        false, errp);
+        if (!s->cache_file) {
+            return -EINVAL;
+        }
+    }
+
+    GRAPH_RDLOCK_GUARD_MAINLOOP();
+
+    if (s->cache_file) {
+        int64_t len = bdrv_getlength(s->cache_file->bs);
+
+        if (len < 0) {
+            error_setg_errno(errp, -len, "Failed to get cache file length");
+            return len;
+        }
+        file_slots = len >> s->block_bits;
+    }
+
+    s->mem_slots = mem_size >> s->block_bits;
+    if (s->mem_slots > SIZE_MAX >> s->block_bits) {
+        error_setg(errp, "mem-size is too big");
+        return -EINVAL;
+    }
+    s->nb_slots = s->mem_slots + file_slots;
+    if (!s->nb_slots) {
+        error_setg(errp, "The cache has no room for a single block");
+        return -EINVAL;
+    }
+
+    if (s->mem_slots) {
+        s->mem = qemu_try_blockalign(bs->file->bs,
+                                     s->mem_slots << s->block_bits);
+        if (!s->mem) {
+            error_setg(errp, "Could not allocate the memory pool");
+            return -ENOMEM;
+        }
+    }
+
+    s->entries = g_try_new0(ReadCacheEntry, s->nb_slots);
+    if (!s->entries) {
+        error_setg(errp, "Could not allocate the cache metadata");
+        qemu_vfree(s->mem);
+        s->mem = NULL;
+        return -ENOMEM;
+    }
+    QTAILQ_INIT(&s->free_list);
+    QTAILQ_INIT(&s->lru_list);
+    for (i = s->nb_slots; i-- > 0; ) {
+        QTAILQ_INSERT_HEAD(&s->free_list, &s->entries[i], next);
+    }
+
+    s->map = g_hash_table_new(g_int64_hash, g_int64_equal);
+    if (s->admission == READ_CACHE_ADMISSION_SECOND_HIT) {
+        s->nb_ghost = s->nb_slots;
+        s->ghost = g_new0(uint64_t, s->nb_ghost);
+        s->ghost_map = g_hash_table_new(g_int64_hash, g_int64_equal);
+    }
+    QLIST_INIT(&s->reqs);
+    qemu_mutex_init(&s->lock);
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    return 0;
+}
+
+static void read_cache_close(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    if (s->map) {
+        g_hash_table_destroy(s->map);
+        qemu_mutex_destroy(&s->lock);
+    }
+    if (s->ghost_map) {
+        g_hash_table_destroy(s->ghost_map);
+    }
+    g_free(s->ghost);
+    g_free(s->entries);
+    qemu_vfree(s->mem);
+}
+
+static BlockDriver bdrv_read_cache = {
+    .format_name                = "read-cache",
+    .instance_size              = sizeof(BDRVReadCacheState),
+
+    .bdrv_open                  = read_cache_open,
+    .bdrv_close                 = read_cache_close,
+    .bdrv_child_perm            = read_cache_child_perm,
+
+    .bdrv_co_getlength          = read_cache_co_getlength,
+    .bdrv_co_truncate           = read_cache_co_truncate,
+    .bdrv_co_invalidate_cache   = read_cache_co_invalidate_cache,
+
+    .bdrv_co_preadv_part        = read_cache_co_preadv_part,
+    .bdrv_co_pwritev_part       = read_cache_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes      = read_cache_co_pwrite_zeroes,
+    .bdrv_co_pdiscard           = read_cache_co_pdiscard,
+
+    .bdrv_refresh_filename      = read_cache_refresh_filename,
+    .bdrv_get_specific_stats    = read_cache_get_specific_stats,
+
+    .is_filter                  = true,
+};
+
+static void bdrv_read_cache_init(void)
+{
+    bdrv_register(&bdrv_read_cache);
+}
+
+block_init(bdrv_read_cache_init);
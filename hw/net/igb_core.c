@@ -1033,6 +1033,75 @@ static bool igb_rx_is_oversized(IGBCore *core, const struct eth_header *ehdr,
     return lpe ? size + ETH_FCS_LEN > rlpml : size > header_size + ETH_MTU;
 }
 
+static inline uint32_t igb_ra_hash(uint64_t addr)
+{
+    return (addr * 0x9e3779b97f4a7c15ULL) >> (64 - IGB_RA_HASH_BITS);
+}
+
+static void igb_ra_hash_add(IGBCore *core, const uint32_t *macp)
+{
+    uint64_t addr = macp[0] | ((uint64_t)(macp[1] & 0xffff) << 32);
+    uint16_t pools = (macp[1] & E1000_RAH_POOL_MASK) / E1000_RAH_POOL_1;
+    uint32_t h;
+
+    if (!(macp[1] & E1000_RAH_AV) || !pools) {
+        return;
+    }
+
+    /* There are fewer RA entries than slots, so this always terminates */
+    for (h = igb_ra_hash(addr); core->ra_hash[h].pools;
+         h = (h + 1) % IGB_RA_HASH_SIZE) {
+        if (core->ra_hash[h].addr == addr) {
+            core->ra_hash[h].pools |= pools;
+            return;
+        }
+    }
+
+    core->ra_hash[h].addr = addr;
+    core->ra_hash[h].pools = pools;
+}
+
+static void igb_update_pool_filters(IGBCore *core)
+{
+    uint32_t *macp;
+    int i;
+
+    memset(core->ra_hash, 0, sizeof(core->ra_hash));
+    for (macp = core->mac + RA; macp < core->mac + RA + 32; macp += 2) {
+        igb_ra_hash_add(core, macp);
+    }
+    for (macp = core->mac + RA2; macp < core->mac + RA2 + 16; macp += 2) {
+        igb_ra_hash_add(core, macp);
+    }
+
+    memset(core->vlan_pools, 0, sizeof(core->vlan_pools));
+    for (i = 0; i < E1000_VLVF_ARRAY_SIZE; i++) {
+        uint32_t vlvf = core->mac[VLVF0 + i];
+
+        if (vlvf & E1000_VLVF_VLANID_ENABLE) {
+            core->vlan_pools[vlvf & E1000_VLVF_VLANID_MASK] |=
+                (vlvf & E1000_VLVF_POOLSEL_MASK) >> E1000_VLVF_POOLSEL_SHIFT;
+        }
+    }
+
+    core->pool_filters_dirty = false;
+}
+
+static uint16_t igb_ra_pools(IGBCore *core, const uint8_t *addr)
+{
+    uint64_t key = ldl_le_p(addr) | ((uint64_t)lduw_le_p(addr + 4) << 32);
+    uint32_t h;
+
+    for (h = igb_ra_hash(key); core->ra_hash[h].pools;
+         h = (h + 1) % IGB_RA_HASH_SIZE) {
+        if (core->ra_hash[h].addr == key) {
+            return core->ra_hash[h].pools;
+        }
+    }
+
+    return 0;
+}
+
 static uint16_t igb_receive_assign(IGBCore *core, const struct iovec *iov,
                                    size_t iovcnt, size_t iov_ofs,
                                    const L2Header *l2_header, size_t size,
@@ -1102,6 +1171,10 @@ static uint16_t igb_receive_assign(IGBCore *core, const struct iovec *iov,
     }
 
     if (core->mac[MRQC] & 1) {
+        if (core->pool_filters_dirty) {
+            igb_update_pool_filters(core);
+        }
+
         if (is_broadcast_ether_addr(ehdr->h_dest)) {
             for (i = 0; i < IGB_NUM_VM_POOLS; i++) {
                 if (core->mac[VMOLR0 + i] & E1000_VMOLR_BAM) {
@@ -1109,27 +1182,7 @@ static uint16_t igb_receive_assign(IGBCore *core, const struct iovec *iov,
                 }
             }
         } else {
-            for (macp = core->mac + RA; macp < core->mac + RA + 32; macp += 2) {
-                if (!(macp[1] & E1000_RAH_AV)) {
-                    continue;
-                }
-                ra[0] = cpu_to_le32(macp[0]);
-                ra[1] = cpu_to_le32(macp[1]);
-                if (!memcmp(ehdr->h_dest, (uint8_t *)ra, ETH_ALEN)) {
-                    queues |= (macp[1] & E1000_RAH_POOL_MASK) / E1000_RAH_POOL_1;
-                }
-            }
-
-            for (macp = core->mac + RA2; macp < core->mac + RA2 + 16; macp += 2) {
-                if (!(macp[1] & E1000_RAH_AV)) {
-                    continue;
-                }
-                ra[0] = cpu_to_le32(macp[0]);
-                ra[1] = cpu_to_le32(macp[1]);
-                if (!memcmp(ehdr->h_dest, (uint8_t *)ra, ETH_ALEN)) {
-                    queues |= (macp[1] & E1000_RAH_POOL_MASK) / E1000_RAH_POOL_1;
-                }
-            }
+            queues = igb_ra_pools(core, ehdr->h_dest);
 
             if (!queues) {
                 macp = core->mac + (is_multicast_ether_addr(ehdr->h_dest) ? MTA : UTA);
@@ -1154,13 +1207,7 @@ static uint16_t igb_receive_assign(IGBCore *core, const struct iovec *iov,
             if (vlan_num) {
                 uint16_t vid = be16_to_cpu(l2_header->vlan[vlan_num - 1].h_tci) & VLAN_VID_MASK;
 
-                for (i = 0; i < E1000_VLVF_ARRAY_SIZE; i++) {
-                    if ((core->mac[VLVF0 + i] & E1000_VLVF_VLANID_MASK) == vid &&
-                        (core->mac[VLVF0 + i] & E1000_VLVF_VLANID_ENABLE)) {
-                        uint32_t poolsel = core->mac[VLVF0 + i] & E1000_VLVF_POOLSEL_MASK;
-                        mask |= poolsel >> E1000_VLVF_POOLSEL_SHIFT;
-                    }
-                }
+                mask = core->vlan_pools[vid];
             } else {
                 for (i = 0; i < IGB_NUM_VM_POOLS; i++) {
                     if (core->mac[VMOLR0 + i] & E1000_VMOLR_AUPE) {
@@ -3017,12 +3064,20 @@ igb_mac_writereg(IGBCore *core, int index, uint32_t val)
     core->mac[index] = val;
 }
 
+static void
+igb_set_pool_filter(IGBCore *core, int index, uint32_t val)
+{
+    core->mac[index] = val;
+    core->pool_filters_dirty = true;
+}
+
 static void
 igb_mac_setmacaddr(IGBCore *core, int index, uint32_t val)
 {
     uint32_t macaddr[2];
 
     core->mac[index] = val;
+    core->pool_filters_dirty = true;
 
     macaddr[0] = cpu_to_le32(core->mac[RA]);
     macaddr[1] = cpu_to_le32(core->mac[RA + 1]);
@@ -4044,10 +4099,10 @@ static const writeops igb_macreg_writeops[] = {
 
     [IP6AT ... IP6AT + 3]    = igb_mac_writereg,
     [IP4AT ... IP4AT + 6]    = igb_mac_writereg,
-    [RA]                     = igb_mac_writereg,
+    [RA]                     = igb_set_pool_filter,
     [RA + 1]                 = igb_mac_setmacaddr,
-    [RA + 2 ... RA + 31]     = igb_mac_writereg,
-    [RA2 ... RA2 + 31]       = igb_mac_writereg,
+    [RA + 2 ... RA + 31]     = igb_set_pool_filter,
+    [RA2 ... RA2 + 31]       = igb_set_pool_filter,
     [WUPM ... WUPM + 31]     = igb_mac_writereg,
     [MTA ... MTA + E1000_MC_TBL_SIZE - 1] = igb_mac_writereg,
     [VFTA ... VFTA + E1000_VLAN_FILTER_TBL_SIZE - 1] = igb_mac_writereg,
@@ -4084,7 +4139,7 @@ static const writeops igb_macreg_writeops[] = {
     igb_putreg(QDE),
     igb_putreg(DTXSWC),
     igb_putreg(RPLOLR),
-    [VLVF0 ... VLVF0 + E1000_VLVF_ARRAY_SIZE - 1] = igb_mac_writereg,
+    [VLVF0 ... VLVF0 + E1000_VLVF_ARRAY_SIZE - 1] = igb_set_pool_filter,
     [VMVIR0 ... VMVIR7] = igb_mac_writereg,
     [VMOLR0 ... VMOLR7] = igb_mac_writereg,
     [UTA ... UTA + E1000_MC_TBL_SIZE - 1] = igb_mac_writereg,
@@ -4533,6 +4588,7 @@ static void igb_reset(IGBCore *core, bool sw)
     }
 
     e1000x_reset_mac_addr(core->owner_nic, core->mac, core->permanent_mac);
+    core->pool_filters_dirty = true;
 
     for (int vfn = 0; vfn < IGB_MAX_VF_FUNCTIONS; vfn++) {
         /* Set RSTI, so VF can identify a PF reset is in progress */
@@ -4585,6 +4641,7 @@ igb_core_post_load(IGBCore *core)
      * to link status bit in core.mac[STATUS].
      */
     nc->link_down = (core->mac[STATUS] & E1000_STATUS_LU) == 0;
+    core->pool_filters_dirty = true;
 
     return 0;
 }
@@ -48,6 +48,8 @@
 #define IGBVF_MSIX_VEC_NUM      (3)
 #define IGB_NUM_QUEUES          (16)
 #define IGB_NUM_VM_POOLS        (8)
+#define IGB_RA_HASH_BITS        (6)
+#define IGB_RA_HASH_SIZE        (1 << IGB_RA_HASH_BITS)
 
 typedef struct IGBCore IGBCore;
 
@@ -101,6 +103,18 @@ struct IGBCore {
     void (*owner_start_recv)(PCIDevice *d);
 
     int64_t timadj;
+
+    /*
+     * Lookup tables derived from RA/RA2 and VLVF, used to find the
+     * destination pools of a packet in VMDq mode without scanning every
+     * filter.  Rebuilt lazily after any of those registers change.
+     */
+    bool pool_filters_dirty;
+    struct {
+        uint64_t addr;
+        uint16_t pools;
+    } ra_hash[IGB_RA_HASH_SIZE];
+    uint8_t vlan_pools[VLAN_VID_MASK + 1];
 };
 
 void
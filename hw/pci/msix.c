@@ -383,15 +383,8 @@ int msix_init(struct PCIDevice *dev, unsigned short nentries,
     return 0;
 }
 
-int msix_init_exclusive_bar(PCIDevice *dev, unsigned short nentries,
-                            uint8_t bar_nr, Error **errp)
+static uint32_t msix_exclusive_bar_pba_offset(unsigned short nentries)
 {
-    int ret;
-    char *name;
-    uint32_t bar_size = 4096;
-    uint32_t bar_pba_offset = bar_size / 2;
-    uint32_t bar_pba_size = QEMU_ALIGN_UP(nentries, 64) / 8;
-
     /*
      * Migration compatibility dictates that this remains a 4k
      * BAR with the vector table in the lower half and PBA in
@@ -399,30 +392,42 @@ int msix_init_exclusive_bar(PCIDevice *dev, unsigned short nentries,
      * No need to care about using more than 65 entries for legacy
      * machine types who has at most 64 queues.
      */
-    if (nentries * PCI_MSIX_ENTRY_SIZE > bar_pba_offset) {
-        bar_pba_offset = nentries * PCI_MSIX_ENTRY_SIZE;
-    }
+    return MAX(nentries * PCI_MSIX_ENTRY_SIZE, 4096 / 2);
+}
 
-    if (bar_pba_offset + bar_pba_size > 4096) {
-        bar_size = bar_pba_offset + bar_pba_size;
-    }
+uint32_t msix_exclusive_bar_size(unsigned short nentries)
+{
+    uint32_t bar_pba_offset = msix_exclusive_bar_pba_offset(nentries);
+    uint32_t bar_pba_size = QEMU_ALIGN_UP(nentries, 64) / 8;
+
+    return pow2ceil(MAX(bar_pba_offset + bar_pba_size, 4096));
+}
 
-    bar_size = pow2ceil(bar_size);
+int msix_init_exclusive_bar(PCIDevice *dev, unsigned short nentries,
+                            uint8_t bar_nr, Error **errp)
+{
+    int ret;
+    char *name;
 
     name = g_strdup_printf("%s-msix", dev->name);
-    memory_region_init(&dev->msix_exclusive_bar, OBJECT(dev), name, bar_size);
+    memory_region_init(&dev->msix_exclusive_bar, OBJECT(dev), name,
+                       msix_exclusive_bar_size(nentries));
     g_free(name);
 
     ret = msix_init(dev, nentries, &dev->msix_exclusive_bar, bar_nr,
                     0, &dev->msix_exclusive_bar,
-                    bar_nr, bar_pba_offset,
+                    bar_nr, msix_exclusive_bar_pba_offset(nentries),
                     0, errp);
     if (ret) {
         return ret;
     }
 
-    pci_register_bar(dev, bar_nr, PCI_BASE_ADDRESS_SPACE_MEMORY,
-                     &dev->msix_exclusive_bar);
+    if (pci_is_vf(dev)) {
+        pcie_sriov_vf_register_bar(dev, bar_nr, &dev->msix_exclusive_bar);
+    } else {
+        pci_register_bar(dev, bar_nr, PCI_BASE_ADDRESS_SPACE_MEMORY,
+                         &dev->msix_exclusive_bar);
+    }
 
     return 0;
 }
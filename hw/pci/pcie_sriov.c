@@ -176,11 +176,22 @@ static void register_vfs(PCIDevice *dev)
 
     assert(sriov_cap > 0);
     num_vfs = pci_get_word(dev->config + sriov_cap + PCI_SRIOV_NUM_VF);
+    if (num_vfs > pci_get_word(dev->config + sriov_cap + PCI_SRIOV_TOTAL_VF)) {
+        return;
+    }
 
     dev->exp.sriov_pf.vf = g_new(PCIDevice *, num_vfs);
 
     trace_sriov_register_vfs(dev->name, PCI_SLOT(dev->devfn),
                              PCI_FUNC(dev->devfn), num_vfs);
+
+    /*
+     * Every VF maps its BARs while being realized.  Defer all of those
+     * updates to a single commit so that enabling a large number of VFs
+     * does not rebuild the flat views (and KVM/vhost memslots) once per
+     * VF BAR.
+     */
+    memory_region_transaction_begin();
     for (i = 0; i < num_vfs; i++) {
         dev->exp.sriov_pf.vf[i] = register_vf(dev, devfn,
                                               dev->exp.sriov_pf.vfname, i);
@@ -190,6 +201,7 @@ static void register_vfs(PCIDevice *dev)
         }
         devfn += vf_stride;
     }
+    memory_region_transaction_commit();
     dev->exp.sriov_pf.num_vfs = num_vfs;
 }
 
@@ -200,6 +212,7 @@ static void unregister_vfs(PCIDevice *dev)
 
     trace_sriov_unregister_vfs(dev->name, PCI_SLOT(dev->devfn),
                                PCI_FUNC(dev->devfn), num_vfs);
+    memory_region_transaction_begin();
     for (i = 0; i < num_vfs; i++) {
         Error *err = NULL;
         PCIDevice *vf = dev->exp.sriov_pf.vf[i];
@@ -209,6 +222,7 @@ static void unregister_vfs(PCIDevice *dev)
         object_unparent(OBJECT(vf));
         object_unref(OBJECT(vf));
     }
+    memory_region_transaction_commit();
     g_free(dev->exp.sriov_pf.vf);
     dev->exp.sriov_pf.vf = NULL;
     dev->exp.sriov_pf.num_vfs = 0;
@@ -25,10 +25,10 @@
 #include "qom/object.h"
 #include "hw/pci/msi.h"
 #include "hw/pci/msix.h"
+#include "hw/pci/pcie_sriov.h"
 
 typedef struct VirtIONetPCI VirtIONetPCI;
 
-//static const VirtioPCIDeviceTypeInfo virtio_net_pci_vf_info;
 /*
  * virtio-net-pci: This extends VirtioPCIProxy.
  */
@@ -36,13 +36,17 @@ typedef struct VirtIONetPCI VirtIONetPCI;
 DECLARE_INSTANCE_CHECKER(VirtIONetPCI, VIRTIO_NET_PCI,
                          TYPE_VIRTIO_NET_PCI)
 
+/*
+ * virtio-net-pci-vf: SR/IOV virtual function of a virtio-net-pci device
+ * created with sriov_max_vfs > 0.  VFs are only instantiated by the PF.
+ */
 #define TYPE_VIRTIO_NET_PCI_VF "virtio-net-pci-vf-base"
-DECLARE_INSTANCE_CHECKER(VirtIONetPCI, VIRTIO_NET_PCI_VF,
-                         TYPE_VIRTIO_NET_PCI_VF)
 
 struct VirtIONetPCI {
     VirtIOPCIProxy parent_obj;
     VirtIONet vdev;
+    /* Queue pairs of the PF's netdev handed to each VF */
+    uint16_t sriov_vf_queues;
 };
 
 static Property virtio_net_properties[] = {
@@ -50,9 +54,44 @@ static Property virtio_net_properties[] = {
                     VIRTIO_PCI_FLAG_USE_IOEVENTFD_BIT, true),
     DEFINE_PROP_UINT32("vectors", VirtIOPCIProxy, nvectors,
                        DEV_NVECTORS_UNSPECIFIED),
+    DEFINE_PROP_UINT16("sriov_vf_queues", VirtIONetPCI, sriov_vf_queues, 1),
     DEFINE_PROP_END_OF_LIST(),
 };
 
+static uint32_t virtio_net_pci_nvectors(int queue_pairs)
+{
+    return 2 * MAX(queue_pairs, 1)
+        + 1 /* Config interrupt */
+        + 1 /* Control vq */;
+}
+
+/*
+ * The PF's netdev backs the PF and all of its VFs: the PF keeps the first
+ * queue pairs and each VF gets sriov_vf_queues pairs after them, so a
+ * single multiqueue tap (or AF_XDP socket set) serves every function.
+ */
+static bool virtio_net_pci_sriov_split_peers(VirtIONetPCI *dev, Error **errp)
+{
+    VirtIOPCIProxy *vpci_dev = VIRTIO_PCI(dev);
+    NICPeers *peers = &dev->vdev.nic_conf.peers;
+    int vf_queues = vpci_dev->sriov_max_vfs * dev->sriov_vf_queues;
+
+    if (!dev->sriov_vf_queues) {
+        error_setg(errp, "sriov_vf_queues must be at least 1");
+        return false;
+    }
+    if (peers->queues <= vf_queues) {
+        error_setg(errp, "netdev must have more than %d queues to back %u VFs"
+                   " with %u queue pairs each", vf_queues,
+                   vpci_dev->sriov_max_vfs, dev->sriov_vf_queues);
+        return false;
+    }
+
+    peers->queues -= vf_queues;
+    vpci_dev->sriov_vf_nvectors = virtio_net_pci_nvectors(dev->sriov_vf_queues);
+    return true;
+}
+
 static void virtio_net_pci_realize(VirtIOPCIProxy *vpci_dev, Error **errp)
 {
     DeviceState *qdev = DEVICE(vpci_dev);
@@ -60,10 +99,13 @@ static void virtio_net_pci_realize(VirtIOPCIProxy *vpci_dev, Error **errp)
     DeviceState *vdev = DEVICE(&dev->vdev);
     VirtIONet *net = VIRTIO_NET(vdev);
 
+    if (vpci_dev->sriov_max_vfs &&
+        !virtio_net_pci_sriov_split_peers(dev, errp)) {
+        return;
+    }
+
     if (vpci_dev->nvectors == DEV_NVECTORS_UNSPECIFIED) {
-        vpci_dev->nvectors = 2 * MAX(net->nic_conf.peers.queues, 1)
-            + 1 /* Config interrupt */
-            + 1 /* Control vq */;
+        vpci_dev->nvectors = virtio_net_pci_nvectors(net->nic_conf.peers.queues);
     }
 
     virtio_net_set_netclient_name(&dev->vdev, qdev->id,
@@ -72,13 +114,24 @@ static void virtio_net_pci_realize(VirtIOPCIProxy *vpci_dev, Error **errp)
     qdev_realize(vdev, BUS(&vpci_dev->bus), errp);
 }
 
-/*
-static void virtio_net_pci_vf_qdev_reset_hold(Object *obj)
+static void virtio_net_pci_vf_realize(VirtIOPCIProxy *vpci_dev, Error **errp)
 {
-    //PCIDevice *vf = PCI_DEVICE(obj);
-    //igb_vf_reset(pcie_sriov_get_pf(vf), pcie_sriov_vf_number(vf));
+    PCIDevice *pci_dev = &vpci_dev->pci_dev;
+    VirtIONetPCI *dev = VIRTIO_NET_PCI(vpci_dev);
+    VirtIONetPCI *pf = VIRTIO_NET_PCI(pcie_sriov_get_pf(pci_dev));
+    NICPeers *pf_peers = &pf->vdev.nic_conf.peers;
+    NICPeers *peers = &dev->vdev.nic_conf.peers;
+    int first = pf_peers->queues +
+                pcie_sriov_vf_number(pci_dev) * pf->sriov_vf_queues;
+    int i;
+
+    for (i = 0; i < pf->sriov_vf_queues; i++) {
+        peers->ncs[i] = pf_peers->ncs[first + i];
+    }
+    peers->queues = pf->sriov_vf_queues;
+
+    virtio_net_pci_realize(vpci_dev, errp);
 }
-*/
 
 static void virtio_net_pci_instance_init(Object *obj)
 {
@@ -104,6 +157,7 @@ static void virtio_net_pci_class_init(ObjectClass *klass, void *data)
     set_bit(DEVICE_CATEGORY_NETWORK, dc->categories);
     device_class_set_props(dc, virtio_net_properties);
     vpciklass->realize = virtio_net_pci_realize;
+    vpciklass->sriov_vf_name = "virtio-net-pci-vf";
 }
 
 static void virtio_net_pci_vf_class_init(ObjectClass *klass, void *data)
@@ -112,13 +166,11 @@ static void virtio_net_pci_vf_class_init(ObjectClass *klass, void *data)
     PCIDeviceClass *k = PCI_DEVICE_CLASS(klass);
     VirtioPCIClass *vpciklass = VIRTIO_PCI_CLASS(klass);
 
-    k->vendor_id = PCI_VENDOR_ID_REDHAT_QUMRANET;
-    k->device_id = PCI_DEVICE_ID_VIRTIO_NET;
-    k->revision = VIRTIO_PCI_ABI_VERSION;
-    k->class_id = PCI_CLASS_NETWORK_ETHERNET;
-    set_bit(DEVICE_CATEGORY_NETWORK, dc->categories);
-    device_class_set_props(dc, virtio_net_properties);
-    vpciklass->realize = virtio_net_pci_realize;
+    k->romfile = NULL;
+    dc->desc = "virtio-net SR/IOV Virtual Function";
+    dc->user_creatable = false;
+    vpciklass->realize = virtio_net_pci_vf_realize;
+    vpciklass->sriov_vf_name = NULL;
 }
 
 static const VirtioPCIDeviceTypeInfo virtio_net_pci_info = {
@@ -131,13 +183,12 @@ static const VirtioPCIDeviceTypeInfo virtio_net_pci_info = {
     .class_init    = virtio_net_pci_class_init,
 };
 
+/* VFs are modern-only, so only register the non-transitional flavour */
 static const VirtioPCIDeviceTypeInfo virtio_net_pci_vf_info = {
     .base_name             = TYPE_VIRTIO_NET_PCI_VF,
-    .generic_name          = "virtio-net-pci-vf",
-    .transitional_name     = "virtio-net-pci-vf-transitional",
-    .non_transitional_name = "virtio-net-pci-vf-non-transitional",
+    .non_transitional_name = "virtio-net-pci-vf",
+    .parent        = TYPE_VIRTIO_NET_PCI,
     .instance_size = sizeof(VirtIONetPCI),
-    .instance_init = virtio_net_pci_instance_init,
     .class_init    = virtio_net_pci_vf_class_init,
 };
 
@@ -32,6 +32,7 @@
 #include "qemu/module.h"
 #include "hw/pci/msi.h"
 #include "hw/pci/msix.h"
+#include "hw/pci/pcie_sriov.h"
 #include "hw/loader.h"
 #include "sysemu/kvm.h"
 #include "hw/virtio/virtio-pci.h"
@@ -40,17 +41,18 @@
 #include "qapi/visitor.h"
 #include "sysemu/replay.h"
 #include "trace.h"
-#include "hw/pci/pcie_sriov.h"
 
 #define VIRTIO_PCI_REGION_SIZE(dev)     VIRTIO_PCI_CONFIG_OFF(msix_present(dev))
 
 #undef VIRTIO_PCI_CONFIG
 
-#define VIRTIO_MAX_VFS 127
 /* The remaining space is defined by each driver as the per-driver
  * configuration space */
 #define VIRTIO_PCI_CONFIG_SIZE(dev)     VIRTIO_PCI_CONFIG_OFF(msix_enabled(dev))
 
+/* Keep all VFs and the PF within the 256 functions reachable through ARI */
+#define VIRTIO_PCI_SRIOV_MAX_VFS        127
+
 static void virtio_pci_bus_new(VirtioBusState *bus, size_t bus_size,
                                VirtIOPCIProxy *dev);
 static void virtio_pci_reset(DeviceState *qdev);
@@ -1444,7 +1446,7 @@ int virtio_pci_add_shm_cap(VirtIOPCIProxy *proxy,
     return virtio_pci_add_mem_cap(proxy, &cap.cap);
 }
 
-uint64_t virtio_pci_common_read(void *opaque, hwaddr addr,
+static uint64_t virtio_pci_common_read(void *opaque, hwaddr addr,
                                        unsigned size)
 {
     VirtIOPCIProxy *proxy = opaque;
@@ -1536,7 +1538,7 @@ uint64_t virtio_pci_common_read(void *opaque, hwaddr addr,
     return val;
 }
 
-void virtio_pci_common_write(void *opaque, hwaddr addr,
+static void virtio_pci_common_write(void *opaque, hwaddr addr,
                                     uint64_t val, unsigned size)
 {
     VirtIOPCIProxy *proxy = opaque;
@@ -1869,7 +1871,6 @@ static void virtio_pci_modern_region_map(VirtIOPCIProxy *proxy,
                                          MemoryRegion *mr,
                                          uint8_t bar)
 {
-    // proxy->common cap proxy->modern_bar proxy->modern_mem_bar_idx
     memory_region_add_subregion(mr, region->offset, &region->mr);
 
     cap->cfg_type = region->type;
@@ -1877,14 +1878,12 @@ static void virtio_pci_modern_region_map(VirtIOPCIProxy *proxy,
     cap->offset = cpu_to_le32(region->offset);
     cap->length = cpu_to_le32(region->size);
     virtio_pci_add_mem_cap(proxy, cap);
-
 }
 
 static void virtio_pci_modern_mem_region_map(VirtIOPCIProxy *proxy,
                                              VirtIOPCIRegion *region,
                                              struct virtio_pci_cap *cap)
 {
-
     virtio_pci_modern_region_map(proxy, region, cap,
                                  &proxy->modern_bar, proxy->modern_mem_bar_idx);
 }
@@ -1897,31 +1896,6 @@ static void virtio_pci_modern_io_region_map(VirtIOPCIProxy *proxy,
                                  &proxy->io_bar, proxy->modern_io_bar_idx);
 }
 
-void virtio_pci_vf_modern_region_map(PCIDevice *dev,
-                                         VirtIOPCIRegion *region,
-                                         struct virtio_pci_cap *cap,
-                                         MemoryRegion *mr,
-                                         uint8_t bar)
-{
-    // proxy->common cap proxy->modern_bar proxy->modern_mem_bar_idx
-    memory_region_add_subregion(mr, region->offset, &region->mr);
-
-    cap->cfg_type = region->type;
-    cap->bar = bar;
-    cap->offset = cpu_to_le32(region->offset);
-    cap->length = cpu_to_le32(region->size);
-
-    int offset;
-
-    offset = pci_add_capability(dev, PCI_CAP_ID_VNDR, 0,
-                                cap->cap_len, &error_abort);
-
-    assert(cap->cap_len >= sizeof *cap);
-    memcpy(dev->config + offset + PCI_CAP_FLAGS, &cap->cap_len,
-        cap->cap_len - PCI_CAP_FLAGS);
-
-}
-
 static void virtio_pci_modern_mem_region_unmap(VirtIOPCIProxy *proxy,
                                                VirtIOPCIRegion *region)
 {
@@ -1945,9 +1919,55 @@ static void virtio_pci_pre_plugged(DeviceState *d, Error **errp)
         virtio_add_feature(&vdev->host_features, VIRTIO_F_VERSION_1);
     }
 
+    if (proxy->sriov_max_vfs) {
+        virtio_add_feature(&vdev->host_features, VIRTIO_F_SR_IOV);
+    }
+
     virtio_add_feature(&vdev->host_features, VIRTIO_F_BAD_FEATURE);
 }
 
+/*
+ * Expose @proxy as an SR/IOV physical function.  Each VF is an instance of
+ * the class' sriov_vf_name type and mirrors the PF's modern BAR layout.
+ */
+static bool virtio_pci_sriov_pf_init(VirtIOPCIProxy *proxy, Error **errp)
+{
+    VirtioPCIClass *k = VIRTIO_PCI_GET_CLASS(proxy);
+    PCIDevice *dev = &proxy->pci_dev;
+
+    if (!k->sriov_vf_name) {
+        error_setg(errp, "sriov_max_vfs is not supported by %s", dev->name);
+        return false;
+    }
+    if (!pci_is_express(dev)) {
+        error_setg(errp, "sriov_max_vfs requires a PCI Express port");
+        return false;
+    }
+    if (proxy->sriov_max_vfs > VIRTIO_PCI_SRIOV_MAX_VFS) {
+        error_setg(errp, "sriov_max_vfs must be between 0 and %d",
+                   VIRTIO_PCI_SRIOV_MAX_VFS);
+        return false;
+    }
+
+    pcie_sriov_pf_init(dev, proxy->last_pcie_cap_offset, k->sriov_vf_name,
+                       PCI_DEVICE_ID_VIRTIO_10_BASE +
+                       virtio_bus_get_vdev_id(&proxy->bus),
+                       proxy->sriov_max_vfs, proxy->sriov_max_vfs, 1, 1);
+
+    if (proxy->sriov_vf_nvectors) {
+        pcie_sriov_pf_init_vf_bar(dev, proxy->msix_bar_idx,
+                                  PCI_BASE_ADDRESS_SPACE_MEMORY,
+                                  msix_exclusive_bar_size(
+                                      proxy->sriov_vf_nvectors));
+    }
+    pcie_sriov_pf_init_vf_bar(dev, proxy->modern_mem_bar_idx,
+                              PCI_BASE_ADDRESS_SPACE_MEMORY |
+                              PCI_BASE_ADDRESS_MEM_PREFETCH |
+                              PCI_BASE_ADDRESS_MEM_TYPE_64,
+                              memory_region_size(&proxy->modern_bar));
+    return true;
+}
+
 /* This is called by virtio-bus just after the device is plugged. */
 static void virtio_pci_device_plugged(DeviceState *d, Error **errp)
 {
@@ -2051,63 +2071,32 @@ static void virtio_pci_device_plugged(DeviceState *d, Error **errp)
         virtio_pci_modern_mem_region_map(proxy, &proxy->device, &cap);
         virtio_pci_modern_mem_region_map(proxy, &proxy->notify, &notify.cap);
 
-        if (!pci_is_vf(&proxy->pci_dev)) {
-            if (virtio_bus_get_vdev_id(bus) != VIRTIO_ID_NET) {
-                error_setg(errp, "sriov_max_vfs prop is not supported by %s",
-                           proxy->pci_dev.name);
-                return;
-            }
-            if (proxy->sriov_max_vfs > VIRTIO_MAX_VFS) {
-                error_setg(errp, "sriov_max_vfs must be between 0 and %d",
-                           VIRTIO_MAX_VFS);
-                return;
-            }
-
-            pcie_sriov_pf_init(&proxy->pci_dev, PCI_CONFIG_SPACE_SIZE,
-                               proxy->pci_dev.name,
-                               PCI_DEVICE_ID_VIRTIO_10_BASE
-                               + virtio_bus_get_vdev_id(bus),
-                               proxy->sriov_max_vfs, proxy->sriov_max_vfs, 1, 1);
-            if (proxy->flags & VIRTIO_PCI_FLAG_MODERN_PIO_NOTIFY) {
-                pcie_sriov_pf_init_vf_bar(&proxy->pci_dev, proxy->modern_io_bar_idx,
-                                          PCI_BASE_ADDRESS_SPACE_IO, 4);
-            }
-
-            if (proxy->nvectors) {
-                pcie_sriov_pf_init_vf_bar(&proxy->pci_dev, proxy->msix_bar_idx,
-                                          PCI_BASE_ADDRESS_SPACE_MEMORY, 4 * 1024);
-            }
-            pcie_sriov_pf_init_vf_bar(&proxy->pci_dev, proxy->modern_mem_bar_idx,
-                                      PCI_BASE_ADDRESS_SPACE_MEMORY |
-                                      PCI_BASE_ADDRESS_MEM_PREFETCH |
-                                      PCI_BASE_ADDRESS_MEM_TYPE_64,
-                                      16 * 1024);
-        }
-
         if (modern_pio) {
             memory_region_init(&proxy->io_bar, OBJECT(proxy),
                                "virtio-pci-io", 0x4);
 
-            if (pci_is_vf(&proxy->pci_dev))
-                pcie_sriov_vf_register_bar(&proxy->pci_dev, proxy->modern_io_bar_idx,
-                                           &proxy->io_bar);
-            else
-                pci_register_bar(&proxy->pci_dev, proxy->modern_io_bar_idx,
-                                 PCI_BASE_ADDRESS_SPACE_IO, &proxy->io_bar);
+            pci_register_bar(&proxy->pci_dev, proxy->modern_io_bar_idx,
+                             PCI_BASE_ADDRESS_SPACE_IO, &proxy->io_bar);
 
             virtio_pci_modern_io_region_map(proxy, &proxy->notify_pio,
                                             &notify_pio.cap);
         }
 
-        if (pci_is_vf(&proxy->pci_dev))
-            pcie_sriov_vf_register_bar(&proxy->pci_dev, proxy->modern_mem_bar_idx,
+        if (pci_is_vf(&proxy->pci_dev)) {
+            pcie_sriov_vf_register_bar(&proxy->pci_dev,
+                                       proxy->modern_mem_bar_idx,
                                        &proxy->modern_bar);
-        else
+        } else {
             pci_register_bar(&proxy->pci_dev, proxy->modern_mem_bar_idx,
                              PCI_BASE_ADDRESS_SPACE_MEMORY |
                              PCI_BASE_ADDRESS_MEM_PREFETCH |
                              PCI_BASE_ADDRESS_MEM_TYPE_64,
                              &proxy->modern_bar);
+        }
+
+        if (proxy->sriov_max_vfs && !virtio_pci_sriov_pf_init(proxy, errp)) {
+            return;
+        }
 
         proxy->config_cap = virtio_pci_add_mem_cap(proxy, &cfg.cap);
         cfg_mask = (void *)(proxy->pci_dev.wmask + proxy->config_cap);
@@ -2173,6 +2162,17 @@ static void virtio_pci_realize(PCIDevice *pci_dev, Error **errp)
     bool pcie_port = pci_bus_is_express(pci_get_bus(pci_dev)) &&
                      !pci_bus_is_root(pci_get_bus(pci_dev));
 
+    /*
+     * VFs are created by the PF and have no properties of their own, so
+     * follow the PF's transport configuration.  The VF BARs are sized by
+     * the PF, which only describes a modern memory BAR and MSI-X.
+     */
+    if (pci_is_vf(pci_dev)) {
+        VirtIOPCIProxy *pf = VIRTIO_PCI(pcie_sriov_get_pf(pci_dev));
+
+        proxy->flags = pf->flags & ~VIRTIO_PCI_FLAG_MODERN_PIO_NOTIFY;
+    }
+
     /* fd-based ioevents can't be synchronized in record/replay */
     if (replay_mode != REPLAY_MODE_NONE) {
         proxy->flags &= ~VIRTIO_PCI_FLAG_USE_IOEVENTFD;
@@ -2283,6 +2283,15 @@ static void virtio_pci_realize(PCIDevice *pci_dev, Error **errp)
             /* Set Function Level Reset capability bit */
             pcie_cap_flr_init(pci_dev);
         }
+
+        if (proxy->sriov_max_vfs || pci_is_vf(pci_dev)) {
+            /* VFs live beyond function 7, which requires ARI */
+            pcie_ari_init(pci_dev, last_pcie_cap_offset);
+            last_pcie_cap_offset += PCI_ARI_SIZEOF;
+        }
+
+        /* The SR/IOV capability is added once the backend is plugged */
+        proxy->last_pcie_cap_offset = last_pcie_cap_offset;
     } else {
         /*
          * make future invocations of pci_is_express() return false
@@ -2303,6 +2312,9 @@ static void virtio_pci_exit(PCIDevice *pci_dev)
     bool pcie_port = pci_bus_is_express(pci_get_bus(pci_dev)) &&
                      !pci_bus_is_root(pci_get_bus(pci_dev));
 
+    if (pci_dev->exp.sriov_cap) {
+        pcie_sriov_pf_exit(pci_dev);
+    }
     msix_uninit_exclusive_bar(pci_dev);
     if (proxy->flags & VIRTIO_PCI_FLAG_AER && pcie_port &&
         pci_is_express(pci_dev)) {
@@ -2334,6 +2346,7 @@ static void virtio_pci_bus_reset_hold(Object *obj)
     PCIDevice *dev = PCI_DEVICE(obj);
     DeviceState *qdev = DEVICE(obj);
 
+    pcie_sriov_pf_disable_vfs(dev);
     virtio_pci_reset(qdev);
 
     if (pci_is_express(dev)) {
@@ -26,6 +26,7 @@
 #include "hw/virtio/vhost.h"
 #include "migration/qemu-file-types.h"
 #include "qemu/atomic.h"
+#include "qemu/rcu_queue.h"
 #include "hw/virtio/virtio-bus.h"
 #include "hw/qdev-properties.h"
 #include "hw/virtio/virtio-access.h"
@@ -149,8 +150,14 @@ struct VirtQueue
     VirtIOHandleOutput handle_output;
     VirtIODevice *vdev;
     EventNotifier guest_notifier;
+    /* Set while the transport has wired guest_notifier to an interrupt */
+    bool guest_notifier_assigned;
     EventNotifier host_notifier;
     bool host_notifier_enabled;
+    /* Polls the avail ring while the guest is told not to kick */
+    QEMUTimer *doorbell_timer;
+    bool doorbell_polling;
+    int64_t doorbell_last_busy;
     QLIST_ENTRY(VirtQueue) node;
 };
 
@@ -2304,14 +2311,15 @@ void virtio_queue_set_vector(VirtIODevice *vdev, int n, uint16_t vector)
     VirtQueue *vq = &vdev->vq[n];
 
     if (n < VIRTIO_QUEUE_MAX) {
+        /* vector_queues is walked locklessly by virtio_notify_irqfd() */
         if (vdev->vector_queues &&
             vdev->vq[n].vector != VIRTIO_NO_VECTOR) {
-            QLIST_REMOVE(vq, node);
+            QLIST_REMOVE_RCU(vq, node);
         }
-        vdev->vq[n].vector = vector;
+        qatomic_set(&vdev->vq[n].vector, vector);
         if (vdev->vector_queues &&
             vector != VIRTIO_NO_VECTOR) {
-            QLIST_INSERT_HEAD(&vdev->vector_queues[vector], vq, node);
+            QLIST_INSERT_HEAD_RCU(&vdev->vector_queues[vector], vq, node);
         }
     }
 }
@@ -2446,6 +2454,37 @@ static bool virtio_should_notify(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
+/*
+ * Queues that share an MSI-X vector each have their own guest notifier, but
+ * all of those notifiers raise the same interrupt.  Pick the notifier of the
+ * first wired-up queue on @vq's vector so that notifications for any queue
+ * on that vector are coalesced by defer_call() into a single eventfd write.
+ *
+ * Called within rcu_read_lock().
+ */
+static EventNotifier *virtio_vector_guest_notifier(VirtQueue *vq)
+{
+    VirtIODevice *vdev = vq->vdev;
+    uint16_t vector = qatomic_read(&vq->vector);
+    VirtQueue *first;
+
+    if (vector == VIRTIO_NO_VECTOR || !vdev->vector_queues) {
+        return &vq->guest_notifier;
+    }
+
+    QLIST_FOREACH_RCU(first, &vdev->vector_queues[vector], node) {
+        if (qatomic_read(&first->guest_notifier_assigned)) {
+            break;
+        }
+    }
+
+    /* A queue may move to another vector while we walk the list */
+    if (!first || qatomic_read(&first->vector) != vector) {
+        return &vq->guest_notifier;
+    }
+    return &first->guest_notifier;
+}
+
 /* Batch irqs while inside a defer_call_begin()/defer_call_end() section */
 static void virtio_notify_irqfd_deferred_fn(void *opaque)
 {
@@ -2458,10 +2497,13 @@ static void virtio_notify_irqfd_deferred_fn(void *opaque)
 
 void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
 {
+    EventNotifier *notifier;
+
     WITH_RCU_READ_LOCK_GUARD() {
         if (!virtio_should_notify(vdev, vq)) {
             return;
         }
+        notifier = virtio_vector_guest_notifier(vq);
     }
 
     trace_virtio_notify_irqfd(vdev, vq);
@@ -2482,7 +2524,7 @@ void virtio_notify_irqfd(VirtIODevice *vdev, VirtQueue *vq)
      * to an atomic operation.
      */
     virtio_set_isr(vq->vdev, 0x1);
-    defer_call(virtio_notify_irqfd_deferred_fn, &vq->guest_notifier);
+    defer_call(virtio_notify_irqfd_deferred_fn, notifier);
 }
 
 static void virtio_irq(VirtQueue *vq)
@@ -3489,6 +3531,7 @@ static void virtio_config_guest_notifier_read(EventNotifier *n)
 void virtio_queue_set_guest_notifier_fd_handler(VirtQueue *vq, bool assign,
                                                 bool with_irqfd)
 {
+    qatomic_set(&vq->guest_notifier_assigned, assign);
     if (assign && !with_irqfd) {
         event_notifier_set_handler(&vq->guest_notifier,
                                    virtio_queue_guest_notifier_read);
@@ -3524,10 +3567,71 @@ EventNotifier *virtio_queue_get_guest_notifier(VirtQueue *vq)
     return &vq->guest_notifier;
 }
 
+/*
+ * Doorbell polling: when the device has the x-doorbell-poll-us property set
+ * and a virtqueue saw work recently, AioContext polling ending does not
+ * re-enable guest notifications.  The guest keeps VRING_USED_F_NO_NOTIFY (or
+ * a stale avail_event) and stops kicking, and a timer in the IOThread checks
+ * the avail ring every doorbell_poll_us instead.  Once the virtqueue has been
+ * idle for VIRTIO_DOORBELL_IDLE_NS notifications are re-enabled and the
+ * ioeventfd takes over again.
+ */
+#define VIRTIO_DOORBELL_IDLE_NS (1 * SCALE_MS)
+
+static void virtio_queue_doorbell_busy(VirtQueue *vq)
+{
+    if (vq->doorbell_timer) {
+        vq->doorbell_last_busy = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
+}
+
+static void virtio_queue_doorbell_stop(VirtQueue *vq)
+{
+    timer_del(vq->doorbell_timer);
+    vq->doorbell_polling = false;
+    trace_virtio_queue_doorbell_poll(vq->vdev, vq->queue_index, false);
+}
+
+static void virtio_queue_doorbell_timer_cb(void *opaque)
+{
+    VirtQueue *vq = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    if (vq->vring.desc && !virtio_queue_empty(vq)) {
+        vq->doorbell_last_busy = now;
+        virtio_queue_notify_vq(vq);
+    }
+
+    if (now - vq->doorbell_last_busy >= VIRTIO_DOORBELL_IDLE_NS) {
+        virtio_queue_doorbell_stop(vq);
+        virtio_queue_set_notification(vq, 1);
+
+        /* Catch requests that raced with re-enabling notifications */
+        if (vq->vring.desc && !virtio_queue_empty(vq)) {
+            virtio_queue_notify_vq(vq);
+        }
+        return;
+    }
+
+    timer_mod(vq->doorbell_timer,
+              now + (int64_t)vq->vdev->doorbell_poll_us * SCALE_US);
+}
+
+static void virtio_queue_host_notifier_aio_read(EventNotifier *n)
+{
+    VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
+
+    virtio_queue_doorbell_busy(vq);
+    virtio_queue_host_notifier_read(n);
+}
+
 static void virtio_queue_host_notifier_aio_poll_begin(EventNotifier *n)
 {
     VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
 
+    if (vq->doorbell_polling) {
+        virtio_queue_doorbell_stop(vq);
+    }
     virtio_queue_set_notification(vq, 0);
 }
 
@@ -3543,6 +3647,7 @@ static void virtio_queue_host_notifier_aio_poll_ready(EventNotifier *n)
 {
     VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
 
+    virtio_queue_doorbell_busy(vq);
     virtio_queue_notify_vq(vq);
 }
 
@@ -3550,14 +3655,32 @@ static void virtio_queue_host_notifier_aio_poll_end(EventNotifier *n)
 {
     VirtQueue *vq = container_of(n, VirtQueue, host_notifier);
 
+    if (vq->doorbell_timer) {
+        int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+        /* Busy virtqueue: keep kicks suppressed and poll from the timer */
+        if (now - vq->doorbell_last_busy < VIRTIO_DOORBELL_IDLE_NS) {
+            vq->doorbell_polling = true;
+            trace_virtio_queue_doorbell_poll(vq->vdev, vq->queue_index, true);
+            timer_mod(vq->doorbell_timer,
+                      now + (int64_t)vq->vdev->doorbell_poll_us * SCALE_US);
+            return;
+        }
+    }
+
     /* Caller polls once more after this to catch requests that race with us */
     virtio_queue_set_notification(vq, 1);
 }
 
 void virtio_queue_aio_attach_host_notifier(VirtQueue *vq, AioContext *ctx)
 {
+    if (vq->vdev->doorbell_poll_us && !vq->doorbell_timer) {
+        vq->doorbell_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_NS,
+                                           virtio_queue_doorbell_timer_cb, vq);
+        vq->doorbell_last_busy = 0;
+    }
     aio_set_event_notifier(ctx, &vq->host_notifier,
-                           virtio_queue_host_notifier_read,
+                           virtio_queue_host_notifier_aio_read,
                            virtio_queue_host_notifier_aio_poll,
                            virtio_queue_host_notifier_aio_poll_ready);
     aio_set_event_notifier_poll(ctx, &vq->host_notifier,
@@ -3581,6 +3704,16 @@ void virtio_queue_aio_attach_host_notifier_no_poll(VirtQueue *vq, AioContext *ct
 void virtio_queue_aio_detach_host_notifier(VirtQueue *vq, AioContext *ctx)
 {
     aio_set_event_notifier(ctx, &vq->host_notifier, NULL, NULL, NULL);
+
+    if (vq->doorbell_timer) {
+        /* The ioeventfd handler that takes over needs the guest to kick */
+        if (vq->doorbell_polling) {
+            virtio_queue_doorbell_stop(vq);
+            virtio_queue_set_notification(vq, 1);
+        }
+        timer_free(vq->doorbell_timer);
+        vq->doorbell_timer = NULL;
+    }
 }
 
 void virtio_queue_host_notifier_read(EventNotifier *n)
@@ -3731,6 +3864,8 @@ static Property virtio_properties[] = {
     DEFINE_PROP_BOOL("use-disabled-flag", VirtIODevice, use_disabled_flag, true),
     DEFINE_PROP_BOOL("x-disable-legacy-check", VirtIODevice,
                      disable_legacy_check, false),
+    DEFINE_PROP_UINT32("x-doorbell-poll-us", VirtIODevice,
+                       doorbell_poll_us, 0),
     DEFINE_PROP_END_OF_LIST(),
 };
 
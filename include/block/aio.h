@@ -213,6 +213,8 @@ struct AioContext {
 #endif
 #ifdef CONFIG_LINUX_IO_URING
     struct LuringState *linux_io_uring;
+    /* Create linux_io_uring with a kernel submission polling thread */
+    bool linux_io_uring_sqpoll;
 
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
@@ -727,4 +729,15 @@ void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch,
  */
 void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
                                         int64_t max, Error **errp);
+
+/**
+ * aio_context_set_io_uring_params:
+ * @ctx: the aio context
+ * @sqpoll: whether the io_uring ring is polled by a kernel thread
+ *
+ * The parameters are only used when the ring is created, so they cannot
+ * be changed once the AioContext has started submitting io_uring requests.
+ */
+void aio_context_set_io_uring_params(AioContext *ctx, bool sqpoll,
+                                     Error **errp);
 #endif
@@ -45,6 +45,13 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
                             BlockCopyAsyncCallbackFunc cb,
                             void *cb_opaque);
 
+/*
+ * Return true if block_copy() on the range would neither copy anything nor
+ * wait for a copy in progress.
+ */
+bool coroutine_fn block_copy_range_is_clean(BlockCopyState *s, int64_t offset,
+                                            int64_t bytes);
+
 /*
  * Run block-copy in a coroutine, create corresponding BlockCopyCallState
  * object and return pointer to it. Never returns NULL.
@@ -97,5 +104,6 @@ void block_copy_call_cancel(BlockCopyCallState *call_state);
 BdrvDirtyBitmap *block_copy_dirty_bitmap(BlockCopyState *s);
 int64_t block_copy_cluster_size(BlockCopyState *s);
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip);
+void block_copy_set_adaptive_chunk(BlockCopyState *s, bool adaptive);
 
 #endif /* BLOCK_COPY_H */
@@ -329,6 +329,30 @@ bdrv_co_copy_range(BdrvChild *src, int64_t src_offset,
                    int64_t bytes, BdrvRequestFlags read_flags,
                    BdrvRequestFlags write_flags);
 
+/**
+ * bdrv_co_splice_read:
+ *
+ * Send @bytes of data at @offset of @child to the socket @out_fd without
+ * copying them through a userspace buffer.  If @hdr is not NULL, its
+ * contents are sent first, e.g. a protocol header announcing the data.
+ *
+ * Like bdrv_co_copy_range(), there is no bounce buffer fallback: -ENOTSUP
+ * is returned if the node cannot do this, and in that case nothing has been
+ * written to @out_fd and the caller should use a normal read instead.  Any
+ * other error may come after part of the data was written to @out_fd.
+ *
+ * @out_fd must be in non-blocking mode.  The function does not wait for it
+ * to become writable, so like write(2) it may send less than requested.
+ * The caller then waits for @out_fd itself and sends the rest with another
+ * call.
+ *
+ * Returns: the number of bytes of @hdr and data sent; negative error code
+ * if failed.
+ **/
+int64_t coroutine_fn GRAPH_RDLOCK
+bdrv_co_splice_read(BdrvChild *child, int64_t offset, int64_t bytes,
+                    int out_fd, QEMUIOVector *hdr);
+
 /*
  * "I/O or GS" API functions. These functions can run without
  * the BQL, but only in one specific iothread/main loop.
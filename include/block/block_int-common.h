@@ -605,6 +605,18 @@ struct BlockDriver {
         BdrvChild *dst, int64_t dst_offset, int64_t bytes,
         BdrvRequestFlags read_flags, BdrvRequestFlags write_flags);
 
+    /*
+     * Send @hdr and then [offset, offset + bytes) of @bs to @out_fd without
+     * going through a userspace buffer, and return the number of bytes
+     * sent.  Return -ENOTSUP without writing anything to @out_fd if that is
+     * not possible for this range.  Never wait for @out_fd to drain.
+     *
+     * See the comment of bdrv_co_splice_read for the semantics.
+     */
+    int64_t coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_splice_read)(
+        BlockDriverState *bs, int64_t offset, int64_t bytes, int out_fd,
+        QEMUIOVector *hdr);
+
     /*
      * Building block for bdrv_block_status[_above] and
      * bdrv_is_allocated[_above].  The driver should answer only
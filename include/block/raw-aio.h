@@ -48,6 +48,7 @@
 #define QEMU_AIO_MISALIGNED   0x1000
 #define QEMU_AIO_BLKDEV       0x2000
 #define QEMU_AIO_NO_FALLBACK  0x4000
+#define QEMU_AIO_REGISTERED_BUF 0x8000
 
 
 /* linux-aio.c - Linux native implementation */
@@ -66,9 +67,24 @@ void laio_attach_aio_context(LinuxAioState *s, AioContext *new_context);
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
 typedef struct LuringState LuringState;
-LuringState *luring_init(Error **errp);
+LuringState *luring_init(bool sqpoll, Error **errp);
 void luring_cleanup(LuringState *s);
 
+/*
+ * luring_unregister_fd: drop @fd from the registered files of all rings.
+ * Must be called before closing a file descriptor used for io_uring I/O.
+ */
+void luring_unregister_fd(int fd);
+
+#ifdef HAVE_IO_URING_REGISTER_BUFFERS_SPARSE
+/*
+ * luring_register_buf/luring_unregister_buf: pin memory as fixed buffers
+ * in all rings.  Registrations are reference counted.
+ */
+void luring_register_buf(void *host, size_t size);
+void luring_unregister_buf(void *host, size_t size);
+#endif
+
 /* luring_co_submit: submit I/O requests in the thread's current AioContext. */
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
                                   QEMUIOVector *qiov, int type);
@@ -462,8 +462,22 @@ static inline void cpu_physical_memory_clear_dirty_range(ram_addr_t start,
     cpu_physical_memory_test_and_clear_dirty(start, length, DIRTY_MEMORY_CODE);
 }
 
+/*
+ * Mark the region of @page as possibly dirty in the summary of the
+ * migration bitmap, see RAMBlock.bmap_summary.
+ */
+static inline void ramblock_bmap_summary_set(RAMBlock *rb, unsigned long page)
+{
+    if (rb->bmap_summary) {
+        set_bit_atomic(page >> RAMBLOCK_BMAP_SUMMARY_SHIFT, rb->bmap_summary);
+    }
+}
 
-/* Called with RCU critical section */
+/*
+ * Called with RCU critical section.  Callers may sync disjoint ranges
+ * of a block concurrently, as long as the ranges start on a bitmap
+ * word boundary.
+ */
 static inline
 uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                                                ram_addr_t start,
@@ -485,6 +499,7 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
         unsigned long offset = BIT_WORD((word * BITS_PER_LONG) %
                                         DIRTY_MEMORY_BLOCK_SIZE);
         unsigned long page = BIT_WORD(start >> TARGET_PAGE_BITS);
+        unsigned long region, summary = ULONG_MAX;
 
         src = qatomic_rcu_read(
                 &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
@@ -497,6 +512,13 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                 dest[k] |= bits;
                 new_dirty &= bits;
                 num_dirty += ctpopl(new_dirty);
+
+                /* Consecutive words mostly share their summary bit */
+                region = (k * BITS_PER_LONG) >> RAMBLOCK_BMAP_SUMMARY_SHIFT;
+                if (new_dirty && region != summary) {
+                    summary = region;
+                    ramblock_bmap_summary_set(rb, k * BITS_PER_LONG);
+                }
             }
 
             if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
@@ -527,6 +549,7 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
                         DIRTY_MEMORY_MIGRATION)) {
                 long k = (start + addr) >> TARGET_PAGE_BITS;
                 if (!test_and_set_bit(k, dest)) {
+                    ramblock_bmap_summary_set(rb, k);
                     num_dirty++;
                 }
             }
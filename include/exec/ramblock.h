@@ -24,6 +24,9 @@
 #include "qemu/rcu.h"
 #include "exec/ramlist.h"
 
+/* Pages covered by one bit of RAMBlock.bmap_summary */
+#define RAMBLOCK_BMAP_SUMMARY_SHIFT 12
+
 struct RAMBlock {
     struct rcu_head rcu;
     struct MemoryRegion *mr;
@@ -44,6 +47,13 @@ struct RAMBlock {
     size_t page_size;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
+    /*
+     * Summary of bmap, used on the migration source to skip clean
+     * regions when looking for dirty pages.  One bit covers
+     * 1 << RAMBLOCK_BMAP_SUMMARY_SHIFT pages.  A clear bit means that
+     * none of these pages is dirty, a set bit that some may be.
+     */
+    unsigned long *bmap_summary;
     /* bitmap of already received pages in postcopy */
     unsigned long *receivedmap;
 
@@ -75,6 +85,24 @@ struct RAMBlock {
      * could not have been valid on the source.
      */
     ram_addr_t postcopy_length;
+
+    /*
+     * Used by the mapped-ram migration format: bitmap of the pages
+     * that have data in the file, and where the bitmap and the pages
+     * of this block are located in the file.
+     */
+    unsigned long *file_bmap;
+    off_t bitmap_offset;
+    uint64_t pages_offset;
+
+    /*
+     * Used by multifd compression methods that skip pages which do not
+     * compress: the number of pages of this block that were compressed
+     * recently, and how many of them did not shrink enough.  Updated
+     * atomically by the send channels; approximate by design.
+     */
+    uint32_t compress_tried;
+    uint32_t compress_poor;
 };
 #endif
 #endif
@@ -105,6 +105,8 @@ struct VirtioPCIClass {
     PCIDeviceClass parent_class;
     DeviceRealize parent_dc_realize;
     void (*realize)(VirtIOPCIProxy *vpci_dev, Error **errp);
+    /* Type of the VFs created when sriov_max_vfs is set, NULL if none */
+    const char *sriov_vf_name;
 };
 
 typedef struct VirtIOPCIRegion {
@@ -159,6 +161,9 @@ struct VirtIOPCIProxy {
     uint32_t gfselect;
     uint32_t guest_features[2];
     uint16_t sriov_max_vfs;
+    /* MSI-X vectors of each VF, set by the subclass before plugging */
+    uint32_t sriov_vf_nvectors;
+    uint16_t last_pcie_cap_offset;
     VirtIOPCIQueue vqs[VIRTIO_QUEUE_MAX];
 
     VirtIOIRQFD *vector_irqfd;
@@ -269,16 +274,5 @@ void virtio_pci_set_guest_notifier_fd_handler(VirtIODevice *vdev, VirtQueue *vq,
 
 int virtio_pci_add_shm_cap(VirtIOPCIProxy *proxy, uint8_t bar, uint64_t offset,
                            uint64_t length, uint8_t id);
-void virtio_pci_vf_modern_region_map(PCIDevice *dev,
-                                         VirtIOPCIRegion *region,
-                                         struct virtio_pci_cap *cap,
-                                         MemoryRegion *mr,
-                                         uint8_t bar);
-void virtio_net_pci_vf_pci_cap_init(VirtIOPCIProxy *proxy, PCIDevice *dev);
-
-void virtio_pci_common_write(void *opaque, hwaddr addr,
-                                    uint64_t val, unsigned size);
-
-uint64_t virtio_pci_common_read(void *opaque, hwaddr addr,
-                                       unsigned size);
+
 #endif
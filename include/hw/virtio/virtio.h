@@ -146,6 +146,11 @@ struct VirtIODevice
     bool started;
     bool start_on_kick; /* when virtio 1.0 feature has not been negotiated */
     bool disable_legacy_check;
+    /*
+     * @doorbell_poll_us: interval at which an IOThread polls busy virtqueues
+     * with guest notifications suppressed, 0 to always rely on ioeventfd.
+     */
+    uint32_t doorbell_poll_us;
     bool vhost_started;
     VMChangeStateEntry *vmstate;
     char *bus_name;
@@ -367,8 +372,6 @@ typedef struct VirtIORNGConf VirtIORNGConf;
                       VIRTIO_F_IOMMU_PLATFORM, false), \
     DEFINE_PROP_BIT64("packed", _state, _field, \
                       VIRTIO_F_RING_PACKED, false), \
-    DEFINE_PROP_BIT64("sriov", _state, _field, \
-                      VIRTIO_F_SR_IOV, true), \
     DEFINE_PROP_BIT64("queue_reset", _state, _field, \
                       VIRTIO_F_RING_RESET, true)
 
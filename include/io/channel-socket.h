@@ -49,6 +49,8 @@ struct QIOChannelSocket {
     socklen_t remoteAddrLen;
     ssize_t zero_copy_queued;
     ssize_t zero_copy_sent;
+    bool blocking;
+    struct QIOChannelSocketURing *uring;
 };
 
 
@@ -262,4 +264,23 @@ qio_channel_socket_accept(QIOChannelSocket *ioc,
                           Error **errp);
 
 
+/**
+ * qio_channel_socket_enable_io_uring:
+ * @ioc: the socket channel object
+ * @errp: pointer to a NULL-initialized error object
+ *
+ * Switch the blocking reads and writes of a connected
+ * socket over to io_uring. The socket is registered with
+ * a ring per direction, so that each transfer costs a
+ * single submit-and-wait system call on a fixed file.
+ * Non-blocking I/O, file descriptor passing and zero copy
+ * writes keep using the plain socket system calls.
+ *
+ * Returns: 0 on success, -1 on error
+ */
+int
+qio_channel_socket_enable_io_uring(QIOChannelSocket *ioc,
+                                   Error **errp);
+
+
 #endif /* QIO_CHANNEL_SOCKET_H */
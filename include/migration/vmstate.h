@@ -198,6 +198,16 @@ struct VMStateDescription {
      * a QEMU_VM_SECTION_START section.
      */
     bool early_setup;
+    /*
+     * With capability 'parallel-device-state', the sections of VMSDs with
+     * parallel_save set are serialized by a pool of worker threads that do
+     * not hold the BQL, while the migration thread holds it on their
+     * behalf.  Only set this if the pre_save/post_save/needed hooks of the
+     * VMSD and all its subsections neither take nor assert the BQL and do
+     * not touch other devices or accelerator state; all other VMSDs are
+     * saved by the migration thread as usual.
+     */
+    bool parallel_save;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
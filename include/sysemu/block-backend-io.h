@@ -116,6 +116,9 @@ int coroutine_fn blk_co_copy_range(BlockBackend *blk_in, int64_t off_in,
                                    BlockBackend *blk_out, int64_t off_out,
                                    int64_t bytes, BdrvRequestFlags read_flags,
                                    BdrvRequestFlags write_flags);
+int64_t coroutine_fn blk_co_splice_read(BlockBackend *blk, int64_t offset,
+                                        int64_t bytes, int out_fd,
+                                        QEMUIOVector *hdr);
 
 int coroutine_fn blk_co_block_status_above(BlockBackend *blk,
                                            BlockDriverState *base,
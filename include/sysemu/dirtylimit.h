@@ -33,6 +33,8 @@ void dirtylimit_set_vcpu(int cpu_index,
                          bool enable);
 void dirtylimit_set_all(uint64_t quota,
                         bool enable);
+int dirtylimit_set_total(uint64_t total_quota, uint64_t min_quota);
+int dirtylimit_limited_nvcpu(void);
 void dirtylimit_vcpu_execute(CPUState *cpu);
 uint64_t dirtylimit_throttle_time_per_round(void);
 uint64_t dirtylimit_ring_full_time(void);
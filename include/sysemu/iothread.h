@@ -38,6 +38,9 @@ struct IOThread {
     int64_t poll_max_ns;
     int64_t poll_grow;
     int64_t poll_shrink;
+
+    /* AioContext io_uring parameters */
+    bool io_uring_sqpoll;
 };
 typedef struct IOThread IOThread;
 
@@ -34,6 +34,9 @@
 #define QEMU_MSG_ZEROCOPY
 #endif
 #endif
+#ifdef CONFIG_LINUX_IO_URING
+#include <liburing.h>
+#endif
 
 #define SOCKET_MAX_FDS 16
 
@@ -176,6 +179,8 @@ int qio_channel_socket_connect_sync(QIOChannelSocket *ioc,
 
     qio_channel_set_feature(QIO_CHANNEL(ioc),
                             QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
+    qio_channel_set_feature(QIO_CHANNEL(ioc),
+                            QIO_CHANNEL_FEATURE_READ_WAITALL);
 
     return 0;
 }
@@ -412,6 +417,8 @@ qio_channel_socket_accept(QIOChannelSocket *ioc,
 
     qio_channel_set_feature(QIO_CHANNEL(cioc),
                             QIO_CHANNEL_FEATURE_READ_MSG_PEEK);
+    qio_channel_set_feature(QIO_CHANNEL(cioc),
+                            QIO_CHANNEL_FEATURE_READ_WAITALL);
 
     trace_qio_channel_socket_accept_complete(ioc, cioc, cioc->fd);
     return cioc;
@@ -427,10 +434,152 @@ static void qio_channel_socket_init(Object *obj)
     ioc->fd = -1;
 }
 
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * Only one request is ever in flight on a ring, since the channel
+ * I/O calls are synchronous; a little slack costs nothing.
+ */
+#define QIO_CHANNEL_SOCKET_URING_DEPTH 4
+
+struct QIOChannelSocketURing {
+    /*
+     * Reads and writes may be issued concurrently from different
+     * threads, e.g. by the migration return path, so each direction
+     * has a ring of its own.
+     */
+    struct io_uring read_ring;
+    struct io_uring write_ring;
+};
+
+int
+qio_channel_socket_enable_io_uring(QIOChannelSocket *ioc,
+                                   Error **errp)
+{
+    struct QIOChannelSocketURing *uring;
+    int ret;
+
+    if (ioc->uring) {
+        return 0;
+    }
+    if (ioc->fd == -1) {
+        error_setg(errp, "Socket is not connected");
+        return -1;
+    }
+
+    uring = g_new0(struct QIOChannelSocketURing, 1);
+    ret = io_uring_queue_init(QIO_CHANNEL_SOCKET_URING_DEPTH,
+                              &uring->read_ring, 0);
+    if (ret < 0) {
+        goto err_free;
+    }
+    ret = io_uring_queue_init(QIO_CHANNEL_SOCKET_URING_DEPTH,
+                              &uring->write_ring, 0);
+    if (ret < 0) {
+        goto err_read;
+    }
+
+    /* Fixed files save the fd table lookup on every request */
+    ret = io_uring_register_files(&uring->read_ring, &ioc->fd, 1);
+    if (ret == 0) {
+        ret = io_uring_register_files(&uring->write_ring, &ioc->fd, 1);
+    }
+    if (ret < 0) {
+        goto err_write;
+    }
+
+    ioc->blocking = !(fcntl(ioc->fd, F_GETFL) & O_NONBLOCK);
+    ioc->uring = uring;
+    trace_qio_channel_socket_io_uring(ioc, ioc->fd);
+    return 0;
+
+ err_write:
+    io_uring_queue_exit(&uring->write_ring);
+ err_read:
+    io_uring_queue_exit(&uring->read_ring);
+ err_free:
+    g_free(uring);
+    trace_qio_channel_socket_io_uring_fail(ioc, -ret);
+    error_setg_errno(errp, -ret, "Unable to set up io_uring for socket");
+    return -1;
+}
+
+static void qio_channel_socket_uring_free(QIOChannelSocket *ioc)
+{
+    if (!ioc->uring) {
+        return;
+    }
+    /* The registered file holds a reference on the socket */
+    io_uring_queue_exit(&ioc->uring->read_ring);
+    io_uring_queue_exit(&ioc->uring->write_ring);
+    g_free(ioc->uring);
+    ioc->uring = NULL;
+}
+
+/*
+ * Run a single sendmsg/recvmsg through @ring and wait for it.
+ * Follows the system call convention: returns -1 with errno set
+ * on failure.
+ */
+static ssize_t qio_channel_socket_uring_msg(struct io_uring *ring,
+                                            struct msghdr *msg,
+                                            int sflags,
+                                            bool is_write)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+    struct io_uring_cqe *cqe;
+    int ret;
+
+    assert(sqe);
+    if (is_write) {
+        io_uring_prep_sendmsg(sqe, 0, msg, sflags);
+    } else {
+        io_uring_prep_recvmsg(sqe, 0, msg, sflags);
+    }
+    io_uring_sqe_set_flags(sqe, IOSQE_FIXED_FILE);
+
+    do {
+        ret = io_uring_submit_and_wait(ring, 1);
+    } while (ret == -EINTR && io_uring_sq_ready(ring));
+    if (ret < 0 && ret != -EINTR) {
+        errno = -ret;
+        return -1;
+    }
+
+    do {
+        ret = io_uring_wait_cqe(ring, &cqe);
+    } while (ret == -EINTR);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+
+    ret = cqe->res;
+    io_uring_cqe_seen(ring, cqe);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return ret;
+}
+#else /* !CONFIG_LINUX_IO_URING */
+int
+qio_channel_socket_enable_io_uring(QIOChannelSocket *ioc,
+                                   Error **errp)
+{
+    error_setg(errp, "io_uring support not built in");
+    return -1;
+}
+
+static void qio_channel_socket_uring_free(QIOChannelSocket *ioc)
+{
+}
+#endif /* !CONFIG_LINUX_IO_URING */
+
 static void qio_channel_socket_finalize(Object *obj)
 {
     QIOChannelSocket *ioc = QIO_CHANNEL_SOCKET(obj);
 
+    qio_channel_socket_uring_free(ioc);
     if (ioc->fd != -1) {
         QIOChannel *ioc_local = QIO_CHANNEL(ioc);
         if (qio_channel_has_feature(ioc_local, QIO_CHANNEL_FEATURE_LISTEN)) {
@@ -498,6 +647,38 @@ static void qio_channel_socket_copy_fds(struct msghdr *msg,
 }
 
 
+/*
+ * Blocking transfers without ancillary data go through io_uring
+ * when it was enabled on the channel.
+ */
+static ssize_t qio_channel_socket_recvmsg(QIOChannelSocket *sioc,
+                                          struct msghdr *msg,
+                                          int sflags)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (sioc->uring && sioc->blocking && !msg->msg_control) {
+        return qio_channel_socket_uring_msg(&sioc->uring->read_ring,
+                                            msg, sflags, false);
+    }
+#endif
+    return recvmsg(sioc->fd, msg, sflags);
+}
+
+static ssize_t qio_channel_socket_sendmsg(QIOChannelSocket *sioc,
+                                          struct msghdr *msg,
+                                          int sflags)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (sioc->uring && sioc->blocking && !msg->msg_control && !sflags) {
+        /* Have the kernel finish short sends instead of coming back */
+        return qio_channel_socket_uring_msg(&sioc->uring->write_ring,
+                                            msg, MSG_WAITALL, true);
+    }
+#endif
+    return sendmsg(sioc->fd, msg, sflags);
+}
+
+
 static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
                                         const struct iovec *iov,
                                         size_t niov,
@@ -528,9 +709,12 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
     if (flags & QIO_CHANNEL_READ_FLAG_MSG_PEEK) {
         sflags |= MSG_PEEK;
     }
+    if (flags & QIO_CHANNEL_READ_FLAG_WAITALL) {
+        sflags |= MSG_WAITALL;
+    }
 
  retry:
-    ret = recvmsg(sioc->fd, &msg, sflags);
+    ret = qio_channel_socket_recvmsg(sioc, &msg, sflags);
     if (ret < 0) {
         if (errno == EAGAIN) {
             return QIO_CHANNEL_ERR_BLOCK;
@@ -603,7 +787,7 @@ static ssize_t qio_channel_socket_writev(QIOChannel *ioc,
     }
 
  retry:
-    ret = sendmsg(sioc->fd, &msg, sflags);
+    ret = qio_channel_socket_sendmsg(sioc, &msg, sflags);
     if (ret <= 0) {
         switch (errno) {
         case EAGAIN:
@@ -647,6 +831,9 @@ static ssize_t qio_channel_socket_readv(QIOChannel *ioc,
     if (flags & QIO_CHANNEL_READ_FLAG_MSG_PEEK) {
         sflags |= MSG_PEEK;
     }
+    if (flags & QIO_CHANNEL_READ_FLAG_WAITALL) {
+        sflags |= MSG_WAITALL;
+    }
 
     for (i = 0; i < niov; i++) {
         ssize_t ret;
@@ -809,6 +996,7 @@ qio_channel_socket_set_blocking(QIOChannel *ioc,
 {
     QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(ioc);
 
+    sioc->blocking = enabled;
     if (enabled) {
         qemu_socket_set_block(sioc->fd);
     } else {
@@ -850,6 +1038,7 @@ qio_channel_socket_close(QIOChannel *ioc,
     int rc = 0;
     Error *err = NULL;
 
+    qio_channel_socket_uring_free(sioc);
     if (sioc->fd != -1) {
 #ifdef WIN32
         qemu_socket_unselect(sioc->fd, NULL);
@@ -77,6 +77,7 @@ qio_channel_tls_new_server(QIOChannel *master,
     if (qio_channel_has_feature(master, QIO_CHANNEL_FEATURE_SHUTDOWN)) {
         qio_channel_set_feature(QIO_CHANNEL(ioc), QIO_CHANNEL_FEATURE_SHUTDOWN);
     }
+    qio_channel_set_feature(QIO_CHANNEL(ioc), QIO_CHANNEL_FEATURE_READ_WAITALL);
     object_ref(OBJECT(master));
 
     ioc->session = qcrypto_tls_session_new(
@@ -119,6 +120,7 @@ qio_channel_tls_new_client(QIOChannel *master,
     if (qio_channel_has_feature(master, QIO_CHANNEL_FEATURE_SHUTDOWN)) {
         qio_channel_set_feature(ioc, QIO_CHANNEL_FEATURE_SHUTDOWN);
     }
+    qio_channel_set_feature(ioc, QIO_CHANNEL_FEATURE_READ_WAITALL);
     object_ref(OBJECT(master));
 
     tioc->session = qcrypto_tls_session_new(
@@ -273,28 +275,41 @@ static ssize_t qio_channel_tls_readv(QIOChannel *ioc,
     ssize_t got = 0;
 
     for (i = 0 ; i < niov ; i++) {
-        ssize_t ret = qcrypto_tls_session_read(tioc->session,
-                                               iov[i].iov_base,
-                                               iov[i].iov_len);
-        if (ret < 0) {
-            if (errno == EAGAIN) {
-                if (got) {
-                    return got;
-                } else {
-                    return QIO_CHANNEL_ERR_BLOCK;
+        size_t done = 0;
+
+        while (done < iov[i].iov_len) {
+            ssize_t ret = qcrypto_tls_session_read(tioc->session,
+                                                   (char *)iov[i].iov_base +
+                                                   done,
+                                                   iov[i].iov_len - done);
+            if (ret < 0) {
+                if (errno == EAGAIN) {
+                    if (got) {
+                        return got;
+                    } else {
+                        return QIO_CHANNEL_ERR_BLOCK;
+                    }
+                } else if (errno == ECONNABORTED &&
+                           (qatomic_load_acquire(&tioc->shutdown) &
+                            QIO_CHANNEL_SHUTDOWN_READ)) {
+                    return 0;
                 }
-            } else if (errno == ECONNABORTED &&
-                       (qatomic_load_acquire(&tioc->shutdown) &
-                        QIO_CHANNEL_SHUTDOWN_READ)) {
-                return 0;
-            }
 
-            error_setg_errno(errp, errno,
-                             "Cannot read from TLS channel");
-            return -1;
+                error_setg_errno(errp, errno,
+                                 "Cannot read from TLS channel");
+                return -1;
+            }
+            got += ret;
+            done += ret;
+            /*
+             * A read stops at the end of a TLS record, only carry on
+             * with the next records if asked to wait for all the data.
+             */
+            if (ret == 0 || !(flags & QIO_CHANNEL_READ_FLAG_WAITALL)) {
+                break;
+            }
         }
-        got += ret;
-        if (ret < iov[i].iov_len) {
+        if (done < iov[i].iov_len) {
             break;
         }
     }
@@ -420,6 +420,27 @@ static void send_bitmap_complete(QEMUFile *f, DBMSaveState *s,
     send_bitmap_header(f, s, dbms, DIRTY_BITMAP_MIG_FLAG_COMPLETE);
 }
 
+static void send_bitmap_zeroes(QEMUFile *f, DBMSaveState *s,
+                               SaveBitmapState *dbms,
+                               uint64_t start_sector, uint32_t nr_sectors)
+{
+    uint32_t flags = DIRTY_BITMAP_MIG_FLAG_BITS | DIRTY_BITMAP_MIG_FLAG_ZEROES;
+
+    trace_send_bitmap_bits(flags, start_sector, nr_sectors, 0);
+
+    send_bitmap_header(f, s, dbms, flags);
+
+    qemu_put_be64(f, start_sector);
+    qemu_put_be32(f, nr_sectors);
+
+    /*
+     * if a block is zero we need to flush here since the network
+     * bandwidth is now a lot higher than the storage device bandwidth.
+     * thus if we queue zero blocks we slow down the migration.
+     */
+    qemu_fflush(f);
+}
+
 static void send_bitmap_bits(QEMUFile *f, DBMSaveState *s,
                              SaveBitmapState *dbms,
                              uint64_t start_sector, uint32_t nr_sectors)
@@ -440,8 +461,8 @@ static void send_bitmap_bits(QEMUFile *f, DBMSaveState *s,
 
     if (buffer_is_zero(buf, buf_size)) {
         g_free(buf);
-        buf = NULL;
-        flags |= DIRTY_BITMAP_MIG_FLAG_ZEROES;
+        send_bitmap_zeroes(f, s, dbms, start_sector, nr_sectors);
+        return;
     }
 
     trace_send_bitmap_bits(flags, start_sector, nr_sectors, buf_size);
@@ -450,16 +471,8 @@ static void send_bitmap_bits(QEMUFile *f, DBMSaveState *s,
 
     qemu_put_be64(f, start_sector);
     qemu_put_be32(f, nr_sectors);
-
-    /* if a block is zero we need to flush here since the network
-     * bandwidth is now a lot higher than the storage device bandwidth.
-     * thus if we queue zero blocks we slow down the migration. */
-    if (flags & DIRTY_BITMAP_MIG_FLAG_ZEROES) {
-        qemu_fflush(f);
-    } else {
-        qemu_put_be64(f, buf_size);
-        qemu_put_buffer(f, buf, buf_size);
-    }
+    qemu_put_be64(f, buf_size);
+    qemu_put_buffer(f, buf, buf_size);
 
     g_free(buf);
 }
@@ -691,12 +704,36 @@ fail:
 static void bulk_phase_send_chunk(QEMUFile *f, DBMSaveState *s,
                                   SaveBitmapState *dbms)
 {
-    uint32_t nr_sectors = MIN(dbms->total_sectors - dbms->cur_sector,
-                             dbms->sectors_per_chunk);
+    uint64_t left = dbms->total_sectors - dbms->cur_sector;
+    uint64_t clean;
+    int64_t next;
 
-    send_bitmap_bits(f, s, dbms, dbms->cur_sector, nr_sectors);
+    /*
+     * Send a clean run of the bitmap as one ZEROES record rather than one
+     * per chunk.  Only whole chunks are merged, so that the receiver sees
+     * the same alignment as before.
+     */
+    next = bdrv_dirty_bitmap_next_dirty(dbms->bitmap,
+                                        dbms->cur_sector << BDRV_SECTOR_BITS,
+                                        left << BDRV_SECTOR_BITS);
+    clean = next < 0 ? left : (next >> BDRV_SECTOR_BITS) - dbms->cur_sector;
+    if (clean >= left) {
+        clean = left;
+    } else {
+        clean = QEMU_ALIGN_DOWN(clean, dbms->sectors_per_chunk);
+    }
+    clean = MIN(clean, QEMU_ALIGN_DOWN(UINT32_MAX, dbms->sectors_per_chunk));
+
+    if (clean > dbms->sectors_per_chunk) {
+        send_bitmap_zeroes(f, s, dbms, dbms->cur_sector, clean);
+        dbms->cur_sector += clean;
+    } else {
+        uint32_t nr_sectors = MIN(left, dbms->sectors_per_chunk);
+
+        send_bitmap_bits(f, s, dbms, dbms->cur_sector, nr_sectors);
+        dbms->cur_sector += nr_sectors;
+    }
 
-    dbms->cur_sector += nr_sectors;
     if (dbms->cur_sector >= dbms->total_sectors) {
         dbms->bulk_completed = true;
     }
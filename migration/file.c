@@ -6,17 +6,26 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bitops.h"
 #include "qemu/cutils.h"
+#include "qemu/iov.h"
 #include "qapi/error.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
 #include "channel.h"
 #include "file.h"
 #include "migration.h"
+#include "options.h"
 #include "io/channel-file.h"
 #include "io/channel-util.h"
 #include "trace.h"
 
 #define OFFSET_OPTION ",offset="
 
+static struct FileOutgoingArgs {
+    char *fname;
+} outgoing_args;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -36,6 +45,95 @@ int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
     return 0;
 }
 
+/*
+ * Open another descriptor on the migration file for a multifd channel.
+ * The main channel has already created the file, and each channel only
+ * writes at the fixed offsets of the pages it is given.
+ */
+void file_send_channel_create(QIOTaskFunc f, void *data)
+{
+    QIOChannelFile *ioc;
+    QIOTask *task;
+    Error *err = NULL;
+
+    ioc = qio_channel_file_new_path(outgoing_args.fname, O_WRONLY, 0, &err);
+
+    task = qio_task_new(OBJECT(ioc), f, data, NULL);
+    if (!ioc) {
+        qio_task_set_error(task, err);
+    } else {
+        qio_channel_set_name(QIO_CHANNEL(ioc), "multifd-file-outgoing");
+    }
+    qio_task_complete(task);
+}
+
+int file_send_channel_destroy(QIOChannel *send)
+{
+    object_unref(OBJECT(send));
+    g_free(outgoing_args.fname);
+    outgoing_args.fname = NULL;
+    return 0;
+}
+
+static int file_pwritev_all(QIOChannel *ioc, const struct iovec *iov,
+                            unsigned int niov, off_t offset, Error **errp)
+{
+    g_autofree struct iovec *local_iov = g_memdup2(iov, niov * sizeof(*iov));
+    struct iovec *local = local_iov;
+
+    while (niov) {
+        ssize_t len = qio_channel_pwritev(ioc, local, niov, offset, errp);
+
+        if (len < 0) {
+            return -1;
+        }
+        if (len == 0) {
+            error_setg(errp, "Unable to write to file: no space left");
+            return -1;
+        }
+        iov_discard_front(&local, &niov, len);
+        offset += len;
+    }
+
+    return 0;
+}
+
+/*
+ * Write the pages in @iov, which all belong to @block, at their fixed
+ * offsets in the mapped-ram file and mark them in the block's file
+ * bitmap.  Runs of pages that are contiguous in guest memory are also
+ * contiguous in the file, so each run is written with one pwritev().
+ */
+int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
+                            int niov, RAMBlock *block, Error **errp)
+{
+    int page_bits = qemu_target_page_bits();
+    int start = 0;
+
+    for (int i = 0; i < niov; i++) {
+        uint8_t *base = iov[i].iov_base;
+        ram_addr_t offset;
+
+        if (i != niov - 1 && base + iov[i].iov_len == iov[i + 1].iov_base) {
+            continue;
+        }
+
+        offset = (uint8_t *)iov[start].iov_base - block->host;
+        if (file_pwritev_all(ioc, &iov[start], i - start + 1,
+                             block->pages_offset + offset, errp) < 0) {
+            return -1;
+        }
+
+        for (int j = start; j <= i; j++) {
+            offset = (uint8_t *)iov[j].iov_base - block->host;
+            set_bit_atomic(offset >> page_bits, block->file_bmap);
+        }
+        start = i + 1;
+    }
+
+    return 0;
+}
+
 void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp)
 {
@@ -56,6 +154,12 @@ void file_start_outgoing_migration(MigrationState *s,
     if (offset && qio_channel_io_seek(ioc, offset, SEEK_SET, errp) < 0) {
         return;
     }
+
+    if (migrate_mapped_ram() && migrate_multifd()) {
+        g_free(outgoing_args.fname);
+        outgoing_args.fname = g_strdup(filename);
+    }
+
     qio_channel_set_name(ioc, "migration-file-outgoing");
     migration_channel_connect(s, ioc, NULL, NULL);
 }
@@ -50,6 +50,8 @@ static void migration_global_dump(Monitor *mon)
                    ms->decompress_error_check ? "on" : "off");
     monitor_printf(mon, "clear-bitmap-shift: %u\n",
                    ms->clear_bitmap_shift);
+    monitor_printf(mon, "bitmap-sync-threads: %u\n",
+                   ms->bitmap_sync_threads);
 }
 
 void hmp_info_migrate(Monitor *mon, const QDict *qdict)
@@ -167,6 +169,8 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->xbzrle_cache->cache_miss);
         monitor_printf(mon, "xbzrle cache miss rate: %0.2f\n",
                        info->xbzrle_cache->cache_miss_rate);
+        monitor_printf(mon, "xbzrle cache hit rate: %0.2f\n",
+                       info->xbzrle_cache->cache_hit_rate);
         monitor_printf(mon, "xbzrle encoding rate: %0.2f\n",
                        info->xbzrle_cache->encoding_rate);
         monitor_printf(mon, "xbzrle overflow: %" PRIu64 "\n",
@@ -201,6 +205,25 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->dirty_limit_ring_full_time);
     }
 
+    if (info->convergence) {
+        MigrationConvergenceInfo *conv = info->convergence;
+
+        monitor_printf(mon, "convergence: bandwidth %" PRIu64
+                       " bytes/s, dirty rate %" PRIu64 " bytes/s\n",
+                       conv->bandwidth, conv->dirty_rate);
+        if (conv->converging) {
+            monitor_printf(mon, "predicted switchover: %" PRIu64
+                           " iterations, %" PRIu64 " ms\n",
+                           conv->iterations, conv->switchover_time);
+        } else {
+            monitor_printf(mon, "predicted switchover: not converging\n");
+        }
+        if (conv->has_throttled_vcpus) {
+            monitor_printf(mon, "dirty limit throttled vcpus: %" PRIu32 "\n",
+                           conv->throttled_vcpus);
+        }
+    }
+
     if (info->has_postcopy_blocktime) {
         monitor_printf(mon, "postcopy blocktime: %u\n",
                        info->postcopy_blocktime);
@@ -217,6 +240,17 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+    if (info->has_postcopy_fault_latency) {
+        Visitor *v;
+        char *str;
+        v = string_output_visitor_new(false, &str);
+        visit_type_uint64List(v, NULL, &info->postcopy_fault_latency,
+                              &error_abort);
+        visit_complete(v, &str);
+        monitor_printf(mon, "postcopy fault latency (log2 us): %s\n", str);
+        g_free(str);
+        visit_free(v);
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -230,6 +264,19 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "]\n");
     }
 
+    if (info->has_device_state_times) {
+        DeviceStateTimeList *t;
+
+        monitor_printf(mon, "device state times: [\n");
+
+        for (t = info->device_state_times; t; t = t->next) {
+            monitor_printf(mon, "\t%s/%u: %" PRId64 " us\n",
+                           t->value->idstr, t->value->instance_id,
+                           t->value->time);
+        }
+        monitor_printf(mon, "]\n");
+    }
+
     if (info->vfio) {
         monitor_printf(mon, "vfio device transferred: %" PRIu64 " kbytes\n",
                        info->vfio->transferred >> 10);
@@ -392,6 +439,11 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MODE),
             qapi_enum_lookup(&MigMode_lookup, params->mode));
+
+        assert(params->has_postcopy_preempt_channels);
+        monitor_printf(mon, "%s: %u\n",
+        MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_PREEMPT_CHANNELS),
+        params->postcopy_preempt_channels);
     }
 
     qapi_free_MigrationParameters(params);
@@ -679,6 +731,10 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_mode = true;
         visit_type_MigMode(v, param, &p->mode, &err);
         break;
+    case MIGRATION_PARAMETER_POSTCOPY_PREEMPT_CHANNELS:
+        p->has_postcopy_preempt_channels = true;
+        visit_type_uint8(v, param, &p->postcopy_preempt_channels, &err);
+        break;
     default:
         assert(0);
     }
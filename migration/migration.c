@@ -146,10 +146,23 @@ migration_channels_and_transport_compatible(MigrationAddress *addr,
         return false;
     }
 
+    if (migrate_mapped_ram() &&
+        addr->transport != MIGRATION_ADDRESS_TYPE_FILE) {
+        error_setg(errp, "Mapped-ram migration requires a file: URI");
+        return false;
+    }
+
+    if (migrate_multifd() && !migrate_mapped_ram() &&
+        addr->transport == MIGRATION_ADDRESS_TYPE_FILE) {
+        error_setg(errp, "Multifd migration to a file requires mapped-ram");
+        return false;
+    }
+
     return true;
 }
 
-static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp)
+static gint page_request_addr_cmp(gconstpointer ap, gconstpointer bp,
+                                  gpointer unused)
 {
     uintptr_t a = (uintptr_t) ap, b = (uintptr_t) bp;
 
@@ -167,6 +180,8 @@ int migration_stop_vm(RunState state)
 
 void migration_object_init(void)
 {
+    int i;
+
     /* This can only be called once. */
     assert(!current_migration);
     current_migration = MIGRATION_OBJ(object_new(TYPE_MIGRATION));
@@ -181,16 +196,22 @@ void migration_object_init(void)
     current_incoming->postcopy_remote_fds =
         g_array_new(FALSE, TRUE, sizeof(struct PostCopyFD));
     qemu_mutex_init(&current_incoming->rp_mutex);
-    qemu_mutex_init(&current_incoming->postcopy_prio_thread_mutex);
+    for (i = 0; i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+        PostcopyPreemptChannel *ch = &current_incoming->postcopy_preempt[i];
+
+        qemu_mutex_init(&ch->thread_mutex);
+        qemu_sem_init(&ch->file_done, 0);
+    }
     qemu_event_init(&current_incoming->main_thread_load_event, false);
     qemu_sem_init(&current_incoming->postcopy_pause_sem_dst, 0);
     qemu_sem_init(&current_incoming->postcopy_pause_sem_fault, 0);
     qemu_sem_init(&current_incoming->postcopy_pause_sem_fast_load, 0);
-    qemu_sem_init(&current_incoming->postcopy_qemufile_dst_done, 0);
 
     qemu_mutex_init(&current_incoming->page_request_mutex);
     qemu_cond_init(&current_incoming->page_request_cond);
-    current_incoming->page_requested = g_tree_new(page_request_addr_cmp);
+    /* The values are the times of the requests */
+    current_incoming->page_requested = g_tree_new_full(page_request_addr_cmp,
+                                                       NULL, NULL, g_free);
 
     migration_object_check(current_migration, &error_fatal);
 
@@ -237,6 +258,11 @@ void migration_shutdown(void)
      * something serious.
      */
     dirty_bitmap_mig_cancel_incoming();
+
+    if (current_incoming) {
+        qapi_free_DeviceStateTimeList(current_incoming->device_state_times);
+        current_incoming->device_state_times = NULL;
+    }
 }
 
 /* For outgoing */
@@ -269,6 +295,7 @@ void migration_incoming_transport_cleanup(MigrationIncomingState *mis)
 void migration_incoming_state_destroy(void)
 {
     struct MigrationIncomingState *mis = migration_incoming_get_current();
+    int i;
 
     multifd_load_cleanup();
     compress_threads_load_cleanup();
@@ -293,15 +320,28 @@ void migration_incoming_state_destroy(void)
     migration_incoming_transport_cleanup(mis);
     qemu_event_reset(&mis->main_thread_load_event);
 
+    /*
+     * query-migrate reports the load times of a completed migration; the
+     * times of a failed one are of no use to anybody.
+     */
+    if (mis->state != MIGRATION_STATUS_COMPLETED) {
+        qapi_free_DeviceStateTimeList(mis->device_state_times);
+        mis->device_state_times = NULL;
+    }
+
     if (mis->page_requested) {
         g_tree_destroy(mis->page_requested);
         mis->page_requested = NULL;
     }
 
-    if (mis->postcopy_qemufile_dst) {
-        migration_ioc_unregister_yank_from_file(mis->postcopy_qemufile_dst);
-        qemu_fclose(mis->postcopy_qemufile_dst);
-        mis->postcopy_qemufile_dst = NULL;
+    for (i = 0; i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+        PostcopyPreemptChannel *ch = &mis->postcopy_preempt[i];
+
+        if (ch->file) {
+            migration_ioc_unregister_yank_from_file(ch->file);
+            qemu_fclose(ch->file);
+            ch->file = NULL;
+        }
     }
 
     yank_unregister_instance(MIGRATION_YANK_INSTANCE);
@@ -393,12 +433,15 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
     WITH_QEMU_LOCK_GUARD(&mis->page_request_mutex) {
         received = ramblock_recv_bitmap_test_byte_offset(rb, start);
         if (!received && !g_tree_lookup(mis->page_requested, aligned)) {
+            int64_t *req_time = g_new(int64_t, 1);
+
             /*
              * The page has not been received, and it's not yet in the page
-             * request list.  Queue it.  Set the value of element to 1, so that
-             * things like g_tree_lookup() will return TRUE (1) when found.
+             * request list.  Queue it, with the time of the request for the
+             * fault latency statistics.
              */
-            g_tree_insert(mis->page_requested, aligned, (gpointer)1);
+            *req_time = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+            g_tree_insert(mis->page_requested, aligned, req_time);
             qatomic_inc(&mis->page_requested_count);
             trace_postcopy_page_req_add(aligned, mis->page_requested_count);
         }
@@ -735,6 +778,10 @@ static bool migration_incoming_setup(QEMUFile *f, Error **errp)
     if (!mis->from_src_file) {
         mis->from_src_file = f;
     }
+    if (mis->state != MIGRATION_STATUS_POSTCOPY_PAUSED) {
+        mis->postcopy_preempt_nr_channels =
+            migrate_postcopy_preempt_channels();
+    }
     qemu_file_set_blocking(f, false);
     return true;
 }
@@ -903,7 +950,7 @@ bool migration_has_all_channels(void)
     }
 
     if (migrate_postcopy_preempt()) {
-        return mis->postcopy_qemufile_dst != NULL;
+        return postcopy_preempt_all_channels_created(mis);
     }
 
     return true;
@@ -1061,6 +1108,15 @@ static void populate_time_info(MigrationInfo *info, MigrationState *s)
     }
 }
 
+static void populate_device_state_info(MigrationInfo *info,
+                                      DeviceStateTimeList *times)
+{
+    if (times) {
+        info->has_device_state_times = true;
+        info->device_state_times = QAPI_CLONE(DeviceStateTimeList, times);
+    }
+}
+
 static void populate_ram_info(MigrationInfo *info, MigrationState *s)
 {
     size_t page_size = qemu_target_page_size();
@@ -1094,6 +1150,7 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->xbzrle_cache->pages = xbzrle_counters.pages;
         info->xbzrle_cache->cache_miss = xbzrle_counters.cache_miss;
         info->xbzrle_cache->cache_miss_rate = xbzrle_counters.cache_miss_rate;
+        info->xbzrle_cache->cache_hit_rate = xbzrle_counters.cache_hit_rate;
         info->xbzrle_cache->encoding_rate = xbzrle_counters.encoding_rate;
         info->xbzrle_cache->overflow = xbzrle_counters.overflow;
     }
@@ -1119,6 +1176,25 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->has_dirty_limit_ring_full_time = true;
         info->dirty_limit_ring_full_time = dirtylimit_ring_full_time();
     }
+
+    if (s->state == MIGRATION_STATUS_ACTIVE && s->predict_bandwidth) {
+        MigrationConvergenceInfo *conv = g_malloc0(sizeof(*conv));
+
+        conv->bandwidth = s->predict_bandwidth;
+        conv->dirty_rate = s->predict_dirty_rate;
+        conv->converging = s->predict_iterations >= 0;
+        if (conv->converging) {
+            conv->has_iterations = true;
+            conv->iterations = s->predict_iterations;
+            conv->has_switchover_time = true;
+            conv->switchover_time = s->predict_switchover_time;
+        }
+        if (migrate_dirty_limit_adaptive()) {
+            conv->has_throttled_vcpus = true;
+            conv->throttled_vcpus = dirtylimit_limited_nvcpu();
+        }
+        info->convergence = conv;
+    }
 }
 
 static void populate_disk_info(MigrationInfo *info)
@@ -1174,6 +1250,7 @@ static void fill_source_migration_info(MigrationInfo *info)
         populate_time_info(info, s);
         populate_ram_info(info, s);
         populate_disk_info(info);
+        populate_device_state_info(info, s->device_state_times);
         migration_populate_vfio_info(info);
         break;
     case MIGRATION_STATUS_COLO:
@@ -1183,6 +1260,7 @@ static void fill_source_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         populate_time_info(info, s);
         populate_ram_info(info, s);
+        populate_device_state_info(info, s->device_state_times);
         migration_populate_vfio_info(info);
         break;
     case MIGRATION_STATUS_FAILED:
@@ -1230,6 +1308,7 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        populate_device_state_info(info, mis->device_state_times);
         break;
     }
     info->status = mis->state;
@@ -1585,11 +1664,14 @@ int migrate_init(MigrationState *s, Error **errp)
     s->setup_time = 0;
     s->start_postcopy = false;
     s->postcopy_after_devices = false;
+    s->postcopy_preempt_nr_channels = migrate_postcopy_preempt_channels();
     s->migration_thread_running = false;
     error_free(s->error);
     s->error = NULL;
     s->hostname = NULL;
     s->vmdesc = NULL;
+    qapi_free_DeviceStateTimeList(s->device_state_times);
+    s->device_state_times = NULL;
 
     migrate_set_state(&s->state, MIGRATION_STATUS_NONE, MIGRATION_STATUS_SETUP);
 
@@ -1598,6 +1680,10 @@ int migrate_init(MigrationState *s, Error **errp)
     s->vm_old_state = -1;
     s->iteration_initial_bytes = 0;
     s->threshold_size = 0;
+    s->predict_bandwidth = 0;
+    s->predict_dirty_rate = 0;
+    s->predict_iterations = 0;
+    s->predict_switchover_time = 0;
     s->switchover_acked = false;
     s->rdma_migration = false;
     /*
@@ -2138,6 +2224,7 @@ static bool migrate_handle_rp_resume_ack(MigrationState *s,
 static void migration_release_dst_files(MigrationState *ms)
 {
     QEMUFile *file;
+    int i;
 
     WITH_QEMU_LOCK_GUARD(&ms->qemu_file_lock) {
         /*
@@ -2149,15 +2236,19 @@ static void migration_release_dst_files(MigrationState *ms)
     }
 
     /*
-     * Do the same to postcopy fast path socket too if there is.  No
-     * locking needed because this qemufile should only be managed by
+     * Do the same to postcopy fast path sockets too if there are.  No
+     * locking needed because these qemufiles should only be managed by
      * return path thread.
      */
-    if (ms->postcopy_qemufile_src) {
-        migration_ioc_unregister_yank_from_file(ms->postcopy_qemufile_src);
-        qemu_file_shutdown(ms->postcopy_qemufile_src);
-        qemu_fclose(ms->postcopy_qemufile_src);
-        ms->postcopy_qemufile_src = NULL;
+    for (i = 0; i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+        QEMUFile *preempt_file = ms->postcopy_qemufile_src[i];
+
+        if (preempt_file) {
+            migration_ioc_unregister_yank_from_file(preempt_file);
+            qemu_file_shutdown(preempt_file);
+            qemu_fclose(preempt_file);
+            ms->postcopy_qemufile_src[i] = NULL;
+        }
     }
 
     qemu_fclose(file);
@@ -2931,11 +3022,12 @@ static MigThrError migration_detect_error(MigrationState *s)
 
     /*
      * Try to detect any file errors.  Note that postcopy_qemufile_src will
-     * be NULL when postcopy preempt is not enabled.
+     * be empty when postcopy preempt is not enabled.
      */
-    ret = qemu_file_get_error_obj_any(s->to_dst_file,
-                                      s->postcopy_qemufile_src,
-                                      &local_error);
+    ret = qemu_file_get_error_obj_any(s->to_dst_file, NULL, &local_error);
+    if (!ret) {
+        ret = postcopy_preempt_src_get_error(s, &local_error);
+    }
     if (!ret) {
         /* Everything is fine */
         assert(!local_error);
@@ -2992,6 +3084,44 @@ static void update_iteration_initial_status(MigrationState *s)
     s->iteration_initial_pages = ram_get_total_transferred_pages();
 }
 
+/*
+ * Predict when the migration can switch over, assuming the bandwidth and
+ * the dirty page rate stay the same.  Each iteration sends what was
+ * dirtied while the previous one was sent, so the remaining RAM shrinks
+ * by dirty rate / bandwidth per iteration until it is below the
+ * threshold; or never, if the guest dirties memory faster than it is
+ * sent.
+ */
+static void migration_predict_switchover(MigrationState *s,
+                                         double bw_per_ms)
+{
+    double dirty_per_ms = (double)stat64_get(&mig_stats.dirty_pages_rate) *
+                          qemu_target_page_size() / 1000;
+    double remaining = ram_bytes_remaining();
+    double time = 0;
+    int64_t iterations = 0;
+
+    s->predict_bandwidth = bw_per_ms * 1000;
+    s->predict_dirty_rate = dirty_per_ms * 1000;
+
+    while (remaining > s->threshold_size) {
+        if (dirty_per_ms >= bw_per_ms ||
+            iterations == MIGRATION_PREDICT_MAX_ITERATIONS) {
+            iterations = -1;
+            break;
+        }
+        time += remaining / bw_per_ms;
+        remaining = remaining * dirty_per_ms / bw_per_ms;
+        iterations++;
+    }
+
+    s->predict_iterations = iterations;
+    s->predict_switchover_time = iterations > 0 ? time : 0;
+    trace_migration_predict_switchover(s->predict_bandwidth,
+                                       s->predict_dirty_rate,
+                                       iterations, s->predict_switchover_time);
+}
+
 static void migration_update_counters(MigrationState *s,
                                       int64_t current_time)
 {
@@ -3043,6 +3173,10 @@ static void migration_update_counters(MigrationState *s,
             stat64_get(&mig_stats.dirty_bytes_last_sync) / expected_bw_per_ms;
     }
 
+    if (expected_bw_per_ms > 0) {
+        migration_predict_switchover(s, expected_bw_per_ms);
+    }
+
     migration_rate_reset();
 
     update_iteration_initial_status(s);
@@ -48,6 +48,12 @@ struct PostcopyBlocktimeContext;
  */
 #define CLEAR_BITMAP_SHIFT_MAX            31
 
+/*
+ * Past that many iterations, a migration is predicted not to converge:
+ * the dirty page rate is too close to the bandwidth.
+ */
+#define MIGRATION_PREDICT_MAX_ITERATIONS  100
+
 /* This is an abstraction of a "temp huge page" for postcopy's purpose */
 typedef struct {
     /*
@@ -72,6 +78,33 @@ typedef enum {
     PREEMPT_THREAD_QUIT,
 } PreemptThreadStatus;
 
+/* Buckets of MigrationIncomingState.postcopy_fault_latency */
+#define POSTCOPY_FAULT_LATENCY_BUCKETS 24
+
+/* Destination side of a postcopy preempt channel */
+typedef struct PostcopyPreemptChannel {
+    /* QEMUFile for postcopy only; it'll be handled by a separate thread */
+    QEMUFile *file;
+    /*
+     * When file is properly setup, this sem is posted.  One can wait on
+     * this semaphore to wait until the preempt channel is properly setup.
+     */
+    QemuSemaphore file_done;
+    /* Postcopy priority thread is used to receive postcopy requested pages */
+    QemuThread thread;
+    /*
+     * Used to sync between the ram load main thread and the fast ram load
+     * thread.  It protects file, which is the postcopy fast channel.
+     *
+     * The ram fast load thread will take it mostly for the whole lifecycle
+     * because it needs to continuously read data from the channel, and
+     * it'll only release this mutex if postcopy is interrupted, so that
+     * the ram load main thread will take this mutex over and properly
+     * release the broken channel.
+     */
+    QemuMutex thread_mutex;
+} PostcopyPreemptChannel;
+
 /* State for the incoming migration */
 struct MigrationIncomingState {
     QEMUFile *from_src_file;
@@ -121,34 +154,23 @@ struct MigrationIncomingState {
      * enabled.
      */
     unsigned int postcopy_channels;
-    /* QEMUFile for postcopy only; it'll be handled by a separate thread */
-    QEMUFile *postcopy_qemufile_dst;
     /*
-     * When postcopy_qemufile_dst is properly setup, this sem is posted.
-     * One can wait on this semaphore to wait until the preempt channel is
-     * properly setup.
+     * Number of postcopy preempt channels, taken from the parameter when
+     * the main channel is connected.  A recovered postcopy migration keeps
+     * the channels it started with.
      */
-    QemuSemaphore postcopy_qemufile_dst_done;
-    /* Postcopy priority thread is used to receive postcopy requested pages */
-    QemuThread postcopy_prio_thread;
+    unsigned int postcopy_preempt_nr_channels;
+    /*
+     * Postcopy preempt channels, the n-th one loads RAM_CHANNEL_POSTCOPY + n.
+     * Only the first postcopy_channels - RAM_CHANNEL_POSTCOPY are used.
+     */
+    PostcopyPreemptChannel postcopy_preempt[POSTCOPY_PREEMPT_CHANNELS_MAX];
     /*
      * Always set by the main vm load thread only, but can be read by the
-     * postcopy preempt thread.  "volatile" makes sure all reads will be
+     * postcopy preempt threads.  "volatile" makes sure all reads will be
      * up-to-date across cores.
      */
     volatile PreemptThreadStatus preempt_thread_status;
-    /*
-     * Used to sync between the ram load main thread and the fast ram load
-     * thread.  It protects postcopy_qemufile_dst, which is the postcopy
-     * fast channel.
-     *
-     * The ram fast load thread will take it mostly for the whole lifecycle
-     * because it needs to continuously read data from the channel, and
-     * it'll only release this mutex if postcopy is interrupted, so that
-     * the ram load main thread will take this mutex over and properly
-     * release the broken channel.
-     */
-    QemuMutex postcopy_prio_thread_mutex;
     /*
      * An array of temp host huge pages to be used, one for each postcopy
      * channel.
@@ -194,6 +216,9 @@ struct MigrationIncomingState {
     /* List of listening socket addresses  */
     SocketAddressList *socket_address_list;
 
+    /* Per-section load time, with capability 'parallel-device-state' */
+    DeviceStateTimeList *device_state_times;
+
     /* A tree of pages that we requested to the source VM */
     GTree *page_requested;
     /*
@@ -221,6 +246,12 @@ struct MigrationIncomingState {
      * wait until all pages received.
      */
     QemuCond page_request_cond;
+    /*
+     * Histogram of the time between requesting a page to the source and
+     * placing it, bucket N counting the requests resolved within 2^N us.
+     * Protected by page_request_mutex.
+     */
+    uint64_t postcopy_fault_latency[POSTCOPY_FAULT_LATENCY_BUCKETS];
 
     /*
      * Number of devices that have yet to approve switchover. When this reaches
@@ -259,13 +290,21 @@ struct MigrationState {
     QEMUBH *cleanup_bh;
     /* Protected by qemu_file_lock */
     QEMUFile *to_dst_file;
-    /* Postcopy specific transfer channel */
-    QEMUFile *postcopy_qemufile_src;
     /*
-     * It is posted when the preempt channel is established.  Note: this is
-     * used for both the start or recover of a postcopy migration.  We'll
-     * post to this sem every time a new preempt channel is created in the
-     * main thread, and we keep post() and wait() in pair.
+     * Number of postcopy preempt channels, taken from the parameter when
+     * the migration starts so that changing it meanwhile has no effect.
+     */
+    unsigned int postcopy_preempt_nr_channels;
+    /*
+     * Postcopy specific transfer channels, only the first
+     * postcopy_preempt_nr_channels are used.
+     */
+    QEMUFile *postcopy_qemufile_src[POSTCOPY_PREEMPT_CHANNELS_MAX];
+    /*
+     * It is posted when a preempt channel is established, or failed to.
+     * Note: this is used for both the start or recover of a postcopy
+     * migration.  We'll post to this sem every time a new preempt channel
+     * is created in the main thread, and we keep post() and wait() in pair.
      */
     QemuSemaphore postcopy_qemufile_src_sem;
     QIOChannelBuffer *bioc;
@@ -297,6 +336,15 @@ struct MigrationState {
      * measured bandwidth, or avail-switchover-bandwidth if specified.
      */
     int64_t threshold_size;
+    /*
+     * Switchover prediction, see migration_predict_switchover().  The
+     * bandwidth and dirty page rate are in bytes/s, the time is in ms.
+     * predict_iterations is negative if the migration doesn't converge.
+     */
+    uint64_t predict_bandwidth;
+    uint64_t predict_dirty_rate;
+    int64_t predict_iterations;
+    uint64_t predict_switchover_time;
 
     /* params from 'migrate-set-parameters' */
     MigrationParameters parameters;
@@ -455,6 +503,13 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * Number of threads that sync the dirty bitmap together with the
+     * migration thread, for guests large enough to make it worth it.
+     * 0 syncs from the migration thread only.
+     */
+    uint8_t bitmap_sync_threads;
+
     /*
      * This save hostname when out-going migration starts
      */
@@ -463,6 +518,9 @@ struct MigrationState {
     /* QEMU_VM_VMDESCRIPTION content filled for all non-iterable devices. */
     JSONWriter *vmdesc;
 
+    /* Per-section save time, with capability 'parallel-device-state' */
+    DeviceStateTimeList *device_state_times;
+
     /*
      * Indicates whether an ACK from the destination that it's OK to do
      * switchover has been received.
@@ -0,0 +1,290 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include "qemu/bswap.h"
+#include "exec/ramblock.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "multifd.h"
+
+/*
+ * Pages are compressed one at a time.  The packet data starts with one
+ * be32 per page holding its compressed size, followed by the pages.  A
+ * page whose size is the page size is sent uncompressed.
+ */
+
+/* A page has to shrink by at least 1/8th to be sent compressed */
+#define LZ4_MIN_SAVING_SHIFT 3
+
+/* Pages tried in a RAMBlock before compression can be skipped there */
+#define LZ4_ADAPTIVE_MIN_TRIED 256
+/* The RAMBlock counters are halved every that many pages */
+#define LZ4_ADAPTIVE_DECAY 4096
+/* While skipping, one page out of that many is still tried */
+#define LZ4_ADAPTIVE_PROBE 16
+
+struct lz4_data {
+    /* page sizes followed by the page data */
+    uint8_t *buf;
+    /* size of buf */
+    uint32_t buf_len;
+    /* pages skipped since the last probe */
+    uint32_t skipped;
+};
+
+static struct lz4_data *lz4_data_new(uint32_t page_count)
+{
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    /* Uncompressed pages are the worst case */
+    z->buf_len = page_count * sizeof(uint32_t) + MULTIFD_PACKET_SIZE;
+    z->buf = g_try_malloc(z->buf_len);
+    if (!z->buf) {
+        g_free(z);
+        return NULL;
+    }
+    return z;
+}
+
+static void lz4_data_free(struct lz4_data *z)
+{
+    g_free(z->buf);
+    g_free(z);
+}
+
+/* Multifd lz4 compression */
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = lz4_data_new(p->page_count);
+
+    if (!z) {
+        error_setg(errp, "multifd %u: out of memory for lz4 buffer", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    lz4_data_free(p->data);
+    p->data = NULL;
+}
+
+/*
+ * Decide whether a page of @block is worth compressing.  When nearly all
+ * recent attempts in the block were useless, skip compression but keep
+ * probing so that the block is picked up again once its content changes.
+ */
+static bool lz4_should_compress(struct lz4_data *z, RAMBlock *block)
+{
+    uint32_t tried = qatomic_read(&block->compress_tried);
+    uint32_t poor = qatomic_read(&block->compress_poor);
+
+    if (tried < LZ4_ADAPTIVE_MIN_TRIED || poor < tried - tried / 8) {
+        return true;
+    }
+    if (++z->skipped >= LZ4_ADAPTIVE_PROBE) {
+        z->skipped = 0;
+        return true;
+    }
+    return false;
+}
+
+static void lz4_account(RAMBlock *block, bool poor)
+{
+    uint32_t tried = qatomic_fetch_inc(&block->compress_tried) + 1;
+
+    if (poor) {
+        qatomic_inc(&block->compress_poor);
+    }
+    if (tried >= LZ4_ADAPTIVE_DECAY) {
+        /* Racing channels may lose updates, which is fine for a heuristic */
+        qatomic_set(&block->compress_tried, tried / 2);
+        qatomic_set(&block->compress_poor,
+                    qatomic_read(&block->compress_poor) / 2);
+    }
+}
+
+/**
+ * lz4_send_prepare: prepare data to be able to send
+ *
+ * Compress each page on its own into the channel buffer, or copy it
+ * there as is when compressing does not pay off.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+    RAMBlock *block = p->pages->block;
+    uint32_t max_size = p->page_size - (p->page_size >> LZ4_MIN_SAVING_SHIFT);
+    uint32_t *sizes = (uint32_t *)z->buf;
+    uint8_t *out = z->buf + p->normal_num * sizeof(uint32_t);
+    uint32_t i;
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = block->host + p->normal[i];
+        int size = 0;
+
+        if (lz4_should_compress(z, block)) {
+            size = LZ4_compress_default((const char *)page, (char *)out,
+                                        p->page_size, max_size);
+            lz4_account(block, size <= 0);
+        }
+        if (size <= 0) {
+            memcpy(out, page, p->page_size);
+            size = p->page_size;
+        }
+        sizes[i] = cpu_to_be32(size);
+        out += size;
+    }
+
+    p->iov[p->iovs_num].iov_base = z->buf;
+    p->iov[p->iovs_num].iov_len = out - z->buf;
+    p->iovs_num++;
+    p->next_packet_size = out - z->buf;
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = lz4_data_new(p->page_count);
+
+    if (!z) {
+        error_setg(errp, "multifd %u: out of memory for lz4 buffer", p->id);
+        return -1;
+    }
+    p->data = z;
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    lz4_data_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the packet data, and uncompress or copy each page into place.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t sizes_len = p->normal_num * sizeof(uint32_t);
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t *sizes = (uint32_t *)z->buf;
+    uint8_t *in, *end;
+    uint32_t i;
+    int ret;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size < sizes_len || in_size > z->buf_len) {
+        error_setg(errp, "multifd %u: packet size received %u is invalid",
+                   p->id, in_size);
+        return -1;
+    }
+
+    ret = multifd_recv_read(p, z->buf, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    in = z->buf + sizes_len;
+    end = z->buf + in_size;
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+        uint32_t size = be32_to_cpu(sizes[i]);
+
+        if (size == 0 || size > p->page_size || size > end - in) {
+            error_setg(errp, "multifd %u: page %u has invalid size %u",
+                       p->id, i, size);
+            return -1;
+        }
+
+        if (size == p->page_size) {
+            memcpy(page, in, size);
+        } else if (LZ4_decompress_safe((const char *)in, (char *)page,
+                                       size, p->page_size) != p->page_size) {
+            error_setg(errp, "multifd %u: failed to uncompress page %u",
+                       p->id, i);
+            return -1;
+        }
+        in += size;
+    }
+
+    if (in != end) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size, (uint32_t)(in - z->buf));
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
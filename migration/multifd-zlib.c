@@ -256,7 +256,7 @@ static int zlib_recv_pages(MultiFDRecvParams *p, Error **errp)
                    p->id, flags, MULTIFD_FLAG_ZLIB);
         return -1;
     }
-    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+    ret = multifd_recv_read(p, z->zbuff, in_size, errp);
 
     if (ret != 0) {
         return ret;
@@ -252,7 +252,7 @@ static int zstd_recv_pages(MultiFDRecvParams *p, Error **errp)
                    p->id, flags, MULTIFD_FLAG_ZSTD);
         return -1;
     }
-    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+    ret = multifd_recv_read(p, z->zbuff, in_size, errp);
 
     if (ret != 0) {
         return ret;
@@ -11,6 +11,7 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/cutils.h"
 #include "qemu/rcu.h"
 #include "exec/target_page.h"
 #include "sysemu/sysemu.h"
@@ -18,9 +19,11 @@
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "ram.h"
+#include "xbzrle.h"
 #include "migration.h"
 #include "migration-stats.h"
 #include "socket.h"
+#include "file.h"
 #include "tls.h"
 #include "qemu-file.h"
 #include "trace.h"
@@ -45,6 +48,35 @@ typedef struct {
     uint64_t unused2[4];    /* Reserved for future use */
 } __attribute__((packed)) MultiFDInit_t;
 
+/**
+ * multifd_recv_readv: read packet data from a multifd channel
+ *
+ * The channels are in blocking mode, so ask for all the data before
+ * the read returns: a packet then takes a single system call instead
+ * of one for each chunk the socket happened to have buffered.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @iov: where to read the data, usually guest pages
+ * @niov: number of elements in @iov
+ * @errp: pointer to an error
+ */
+int multifd_recv_readv(MultiFDRecvParams *p, const struct iovec *iov,
+                       size_t niov, Error **errp)
+{
+    return qio_channel_readv_full_all(p->c, iov, niov, NULL, NULL,
+                                      QIO_CHANNEL_READ_FLAG_WAITALL, errp);
+}
+
+int multifd_recv_read(MultiFDRecvParams *p, void *buf, size_t len,
+                      Error **errp)
+{
+    struct iovec iov = { .iov_base = buf, .iov_len = len };
+
+    return multifd_recv_readv(p, &iov, 1, errp);
+}
+
 /* Multifd without compression */
 
 /**
@@ -75,6 +107,45 @@ static void nocomp_send_cleanup(MultiFDSendParams *p, Error **errp)
     return;
 }
 
+/* Size of the XBZRLE packet data buffer, the worst case is all raw pages */
+static size_t multifd_xbzrle_buf_size(uint32_t page_count, uint32_t page_size)
+{
+    return page_count * (sizeof(uint32_t) + page_size);
+}
+
+/**
+ * nocomp_send_prepare_xbzrle: XBZRLE encode the pages of a packet
+ *
+ * Pages that miss the cache or do not encode well are copied as is.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void nocomp_send_prepare_xbzrle(MultiFDSendParams *p)
+{
+    XBZRLECacheStats stats = {};
+    uint32_t *lens = (uint32_t *)p->xbzrle_buf;
+    uint8_t *out = p->xbzrle_buf + p->normal_num * sizeof(uint32_t);
+
+    for (int i = 0; i < p->normal_num; i++) {
+        int len = xbzrle_multifd_encode_page(p->pages->block, p->normal[i],
+                                             p->xbzrle_page, out, &stats);
+
+        if (len < 0) {
+            memcpy(out, p->xbzrle_page, p->page_size);
+            len = p->page_size;
+        }
+        lens[i] = cpu_to_be32(len);
+        out += len;
+    }
+    xbzrle_multifd_account(&stats);
+
+    p->iov[p->iovs_num].iov_base = p->xbzrle_buf;
+    p->iov[p->iovs_num].iov_len = out - p->xbzrle_buf;
+    p->iovs_num++;
+    p->next_packet_size = out - p->xbzrle_buf;
+    p->flags |= MULTIFD_FLAG_NOCOMP | MULTIFD_FLAG_XBZRLE;
+}
+
 /**
  * nocomp_send_prepare: prepare date to be able to send
  *
@@ -90,6 +161,11 @@ static int nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
 {
     MultiFDPages_t *pages = p->pages;
 
+    if (p->xbzrle_buf && xbzrle_multifd_active()) {
+        nocomp_send_prepare_xbzrle(p);
+        return 0;
+    }
+
     for (int i = 0; i < p->normal_num; i++) {
         p->iov[p->iovs_num].iov_base = pages->block->host + p->normal[i];
         p->iov[p->iovs_num].iov_len = p->page_size;
@@ -127,6 +203,70 @@ static void nocomp_recv_cleanup(MultiFDRecvParams *p)
 {
 }
 
+/**
+ * nocomp_recv_pages_xbzrle: read a packet of XBZRLE encoded pages
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int nocomp_recv_pages_xbzrle(MultiFDRecvParams *p, Error **errp)
+{
+    size_t buf_size = multifd_xbzrle_buf_size(p->page_count, p->page_size);
+    uint32_t in_size = p->next_packet_size;
+    uint32_t lens_size = p->normal_num * sizeof(uint32_t);
+    uint32_t *lens;
+    uint8_t *in, *end;
+    int ret;
+
+    if (in_size < lens_size || in_size > buf_size) {
+        error_setg(errp, "multifd %u: packet size received %u is invalid",
+                   p->id, in_size);
+        return -1;
+    }
+    if (!p->xbzrle_buf) {
+        p->xbzrle_buf = g_malloc(buf_size);
+    }
+
+    ret = multifd_recv_read(p, p->xbzrle_buf, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    lens = (uint32_t *)p->xbzrle_buf;
+    in = p->xbzrle_buf + lens_size;
+    end = p->xbzrle_buf + in_size;
+
+    for (int i = 0; i < p->normal_num; i++) {
+        uint8_t *page = p->host + p->normal[i];
+        uint32_t len = be32_to_cpu(lens[i]);
+
+        if (len > p->page_size || len > end - in) {
+            error_setg(errp, "multifd %u: page %d has invalid length %u",
+                       p->id, i, len);
+            return -1;
+        }
+
+        if (len == p->page_size) {
+            memcpy(page, in, len);
+        } else if (len &&
+                   xbzrle_decode_buffer(in, len, page, p->page_size) == -1) {
+            error_setg(errp, "multifd %u: failed to decode XBZRLE page %d",
+                       p->id, i);
+            return -1;
+        }
+        in += len;
+    }
+
+    if (in != end) {
+        error_setg(errp, "multifd %u: packet size received %u size expected %u",
+                   p->id, in_size, (uint32_t)(in - p->xbzrle_buf));
+        return -1;
+    }
+    return 0;
+}
+
 /**
  * nocomp_recv_pages: read the data from the channel into actual pages
  *
@@ -146,11 +286,14 @@ static int nocomp_recv_pages(MultiFDRecvParams *p, Error **errp)
                    p->id, flags, MULTIFD_FLAG_NOCOMP);
         return -1;
     }
+    if (p->flags & MULTIFD_FLAG_XBZRLE) {
+        return nocomp_recv_pages_xbzrle(p, errp);
+    }
     for (int i = 0; i < p->normal_num; i++) {
         p->iov[i].iov_base = p->host + p->normal[i];
         p->iov[i].iov_len = p->page_size;
     }
-    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+    return multifd_recv_readv(p, p->iov, p->normal_num, errp);
 }
 
 static MultiFDMethods multifd_nocomp_ops = {
@@ -265,6 +408,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->flags = cpu_to_be32(p->flags);
     packet->pages_alloc = cpu_to_be32(p->pages->allocated);
     packet->normal_pages = cpu_to_be32(p->normal_num);
+    packet->zero_pages = cpu_to_be32(p->zero_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
 
@@ -278,6 +422,12 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
 
         packet->offset[i] = cpu_to_be64(temp);
     }
+
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t temp = p->zero[i];
+
+        packet->offset[p->normal_num + i] = cpu_to_be64(temp);
+    }
 }
 
 static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
@@ -323,10 +473,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    p->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->zero_num > packet->pages_alloc - p->normal_num) {
+        error_setg(errp, "multifd: received packet "
+                   "with %u zero pages and expected maximum zero pages are %u",
+                   p->zero_num, packet->pages_alloc - p->normal_num) ;
+        return -1;
+    }
+
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->normal_num == 0) {
+    if (p->normal_num == 0 && p->zero_num == 0) {
         return 0;
     }
 
@@ -352,6 +510,18 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         p->normal[i] = offset;
     }
 
+    for (i = 0; i < p->zero_num; i++) {
+        uint64_t offset = be64_to_cpu(packet->offset[p->normal_num + i]);
+
+        if (offset > (p->block->used_length - p->page_size)) {
+            error_setg(errp, "multifd: offset too long %" PRIu64
+                       " (max " RAM_ADDR_FMT ")",
+                       offset, p->block->used_length);
+            return -1;
+        }
+        p->zero[i] = offset;
+    }
+
     return 0;
 }
 
@@ -511,6 +681,9 @@ static void multifd_send_terminate_threads(Error *err)
 
 static int multifd_send_channel_destroy(QIOChannel *send)
 {
+    if (migrate_mapped_ram()) {
+        return file_send_channel_destroy(send);
+    }
     return socket_send_channel_destroy(send);
 }
 
@@ -552,6 +725,12 @@ void multifd_save_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
+        g_free(p->xbzrle_buf);
+        p->xbzrle_buf = NULL;
+        g_free(p->xbzrle_page);
+        p->xbzrle_page = NULL;
         multifd_send_state->ops->send_cleanup(p, &local_err);
         if (local_err) {
             migrate_set_error(migrate_get_current(), local_err);
@@ -654,18 +833,23 @@ static void *multifd_send_thread(void *opaque)
     Error *local_err = NULL;
     int ret = 0;
     bool use_zero_copy_send = migrate_zero_copy_send();
+    bool use_zero_page = migrate_multifd_zero_page();
+    /* With mapped-ram, pages go to fixed file offsets without packets */
+    bool use_mapped_ram = migrate_mapped_ram();
 
     thread = migration_threads_add(p->name, qemu_get_thread_id());
 
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
-    if (multifd_send_initial_packet(p, &local_err) < 0) {
-        ret = -1;
-        goto out;
+    if (!use_mapped_ram) {
+        if (multifd_send_initial_packet(p, &local_err) < 0) {
+            ret = -1;
+            goto out;
+        }
+        /* initial packet */
+        p->num_packets = 1;
     }
-    /* initial packet */
-    p->num_packets = 1;
 
     while (true) {
         qemu_sem_post(&multifd_send_state->channels_ready);
@@ -678,18 +862,41 @@ static void *multifd_send_thread(void *opaque)
 
         if (p->pending_job) {
             uint64_t packet_num = p->packet_num;
+            RAMBlock *block = p->pages->block;
             uint32_t flags;
             p->normal_num = 0;
+            p->zero_num = 0;
 
-            if (use_zero_copy_send) {
+            if (use_zero_copy_send || use_mapped_ram) {
                 p->iovs_num = 0;
             } else {
                 p->iovs_num = 1;
             }
 
+            /*
+             * Zero pages are detected here rather than in the migration
+             * thread so that scanning them scales with the channel count;
+             * only their offsets go on the wire.
+             */
             for (int i = 0; i < p->pages->num; i++) {
-                p->normal[p->normal_num] = p->pages->offset[i];
-                p->normal_num++;
+                ram_addr_t offset = p->pages->offset[i];
+
+                if (use_zero_page &&
+                    buffer_is_zero(p->pages->block->host + offset,
+                                   p->page_size)) {
+                    p->zero[p->zero_num] = offset;
+                    p->zero_num++;
+                } else {
+                    p->normal[p->normal_num] = offset;
+                    p->normal_num++;
+                }
+            }
+
+            /* A stale copy of a page that is now zero must be replaced */
+            if (p->zero_num && p->xbzrle_buf && xbzrle_multifd_active()) {
+                memset(p->xbzrle_page, 0, p->page_size);
+                xbzrle_multifd_zero_pages(p->pages->block, p->zero,
+                                          p->zero_num, p->xbzrle_page);
             }
 
             if (p->normal_num) {
@@ -704,34 +911,55 @@ static void *multifd_send_thread(void *opaque)
             p->flags = 0;
             p->num_packets++;
             p->total_normal_pages += p->normal_num;
+            p->total_zero_pages += p->zero_num;
             p->pages->num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, p->normal_num, flags,
-                               p->next_packet_size);
+            if (use_zero_page) {
+                stat64_add(&mig_stats.normal_pages, p->normal_num);
+                stat64_add(&mig_stats.zero_pages, p->zero_num);
+            }
+
+            trace_multifd_send(p->id, packet_num, p->normal_num, p->zero_num,
+                               flags, p->next_packet_size);
 
-            if (use_zero_copy_send) {
-                /* Send header first, without zerocopy */
-                ret = qio_channel_write_all(p->c, (void *)p->packet,
-                                            p->packet_len, &local_err);
+            if (use_mapped_ram) {
+                ret = file_write_ramblock_iov(p->c, p->iov, p->iovs_num,
+                                              block, &local_err);
                 if (ret != 0) {
                     break;
                 }
+                /* A page that is zero now must not be restored from old data */
+                for (int i = 0; i < p->zero_num; i++) {
+                    clear_bit_atomic(p->zero[i] >> qemu_target_page_bits(),
+                                     block->file_bmap);
+                }
+                stat64_add(&mig_stats.multifd_bytes, p->next_packet_size);
             } else {
-                /* Send header using the same writev call */
-                p->iov[0].iov_len = p->packet_len;
-                p->iov[0].iov_base = p->packet;
-            }
+                if (use_zero_copy_send) {
+                    /* Send header first, without zerocopy */
+                    ret = qio_channel_write_all(p->c, (void *)p->packet,
+                                                p->packet_len, &local_err);
+                    if (ret != 0) {
+                        break;
+                    }
+                } else {
+                    /* Send header using the same writev call */
+                    p->iov[0].iov_len = p->packet_len;
+                    p->iov[0].iov_base = p->packet;
+                }
 
-            ret = qio_channel_writev_full_all(p->c, p->iov, p->iovs_num, NULL,
-                                              0, p->write_flags, &local_err);
-            if (ret != 0) {
-                break;
-            }
+                ret = qio_channel_writev_full_all(p->c, p->iov, p->iovs_num,
+                                                  NULL, 0, p->write_flags,
+                                                  &local_err);
+                if (ret != 0) {
+                    break;
+                }
 
-            stat64_add(&mig_stats.multifd_bytes,
-                       p->next_packet_size + p->packet_len);
+                stat64_add(&mig_stats.multifd_bytes,
+                           p->next_packet_size + p->packet_len);
+            }
             p->next_packet_size = 0;
             qemu_mutex_lock(&p->mutex);
             p->pending_job--;
@@ -762,7 +990,8 @@ out:
 
     rcu_unregister_thread();
     migration_threads_remove(thread);
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -896,6 +1125,10 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
 
 static void multifd_new_send_channel_create(gpointer opaque)
 {
+    if (migrate_mapped_ram()) {
+        file_send_channel_create(multifd_new_send_channel_async, opaque);
+        return;
+    }
     socket_send_channel_create(multifd_new_send_channel_async, opaque);
 }
 
@@ -936,8 +1169,14 @@ int multifd_save_setup(Error **errp)
         /* We need one extra place for the packet header */
         p->iov = g_new0(struct iovec, page_count + 1);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->page_size = qemu_target_page_size();
         p->page_count = page_count;
+        if (migrate_xbzrle()) {
+            p->xbzrle_buf = g_malloc(multifd_xbzrle_buf_size(page_count,
+                                                             p->page_size));
+            p->xbzrle_page = g_malloc(p->page_size);
+        }
 
         if (migrate_zero_copy_send()) {
             p->write_flags = QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
@@ -1008,9 +1247,19 @@ static void multifd_recv_terminate_threads(Error *err)
     }
 }
 
+/*
+ * With mapped-ram the destination reads the pages straight from the
+ * file while loading the RAM setup section, so no multifd channels
+ * are created on the receive side.
+ */
+static bool multifd_recv_use_channels(void)
+{
+    return migrate_multifd() && !migrate_mapped_ram();
+}
+
 void multifd_load_shutdown(void)
 {
-    if (migrate_multifd()) {
+    if (multifd_recv_use_channels()) {
         multifd_recv_terminate_threads(NULL);
     }
 }
@@ -1019,7 +1268,7 @@ void multifd_load_cleanup(void)
 {
     int i;
 
-    if (!migrate_multifd()) {
+    if (!multifd_recv_use_channels()) {
         return;
     }
     multifd_recv_terminate_threads(NULL);
@@ -1053,6 +1302,10 @@ void multifd_load_cleanup(void)
         p->iov = NULL;
         g_free(p->normal);
         p->normal = NULL;
+        g_free(p->zero);
+        p->zero = NULL;
+        g_free(p->xbzrle_buf);
+        p->xbzrle_buf = NULL;
         multifd_recv_state->ops->recv_cleanup(p);
     }
     qemu_sem_destroy(&multifd_recv_state->sem_sync);
@@ -1066,7 +1319,7 @@ void multifd_recv_sync_main(void)
 {
     int i;
 
-    if (!migrate_multifd()) {
+    if (!multifd_recv_use_channels()) {
         return;
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -1099,14 +1352,19 @@ static void *multifd_recv_thread(void *opaque)
     rcu_register_thread();
 
     while (true) {
+        struct iovec iov = {
+            .iov_base = (void *)p->packet,
+            .iov_len = p->packet_len,
+        };
         uint32_t flags;
 
         if (p->quit) {
             break;
         }
 
-        ret = qio_channel_read_all_eof(p->c, (void *)p->packet,
-                                       p->packet_len, &local_err);
+        ret = qio_channel_readv_full_all_eof(p->c, &iov, 1, NULL, NULL,
+                                             QIO_CHANNEL_READ_FLAG_WAITALL,
+                                             &local_err);
         if (ret == 0 || ret == -1) {   /* 0: EOF  -1: Error */
             break;
         }
@@ -1121,10 +1379,11 @@ static void *multifd_recv_thread(void *opaque)
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, p->normal_num, flags,
-                           p->next_packet_size);
+        trace_multifd_recv(p->id, p->packet_num, p->normal_num, p->zero_num,
+                           flags, p->next_packet_size);
         p->num_packets++;
         p->total_normal_pages += p->normal_num;
+        p->total_zero_pages += p->zero_num;
         qemu_mutex_unlock(&p->mutex);
 
         if (p->normal_num) {
@@ -1134,6 +1393,10 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        for (int i = 0; i < p->zero_num; i++) {
+            ram_handle_zero(p->host + p->zero[i], p->page_size);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1149,7 +1412,8 @@ static void *multifd_recv_thread(void *opaque)
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->total_normal_pages,
+                                  p->total_zero_pages);
 
     return NULL;
 }
@@ -1164,7 +1428,7 @@ int multifd_load_setup(Error **errp)
      * Return successfully if multiFD recv state is already initialised
      * or multiFD is not enabled.
      */
-    if (multifd_recv_state || !migrate_multifd()) {
+    if (multifd_recv_state || !multifd_recv_use_channels()) {
         return 0;
     }
 
@@ -1188,6 +1452,7 @@ int multifd_load_setup(Error **errp)
         p->name = g_strdup_printf("multifdrecv_%d", i);
         p->iov = g_new0(struct iovec, page_count);
         p->normal = g_new0(ram_addr_t, page_count);
+        p->zero = g_new0(ram_addr_t, page_count);
         p->page_count = page_count;
         p->page_size = qemu_target_page_size();
     }
@@ -1210,7 +1475,7 @@ bool multifd_recv_all_channels_created(void)
 {
     int thread_count = migrate_multifd_channels();
 
-    if (!migrate_multifd()) {
+    if (!multifd_recv_use_channels()) {
         return true;
     }
 
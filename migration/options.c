@@ -53,12 +53,16 @@
 #define DEFAULT_MIGRATE_CPU_THROTTLE_INCREMENT 10
 #define DEFAULT_MIGRATE_MAX_CPU_THROTTLE 99
 
+/* Threads syncing the dirty bitmap next to the migration thread */
+#define DEFAULT_MIGRATE_BITMAP_SYNC_THREADS 3
+
 /* Migration XBZRLE default cache size */
 #define DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE (64 * 1024 * 1024)
 
 /* The delay time (in ms) between two COLO checkpoints */
 #define DEFAULT_MIGRATE_X_CHECKPOINT_DELAY (200 * 100)
 #define DEFAULT_MIGRATE_MULTIFD_CHANNELS 2
+#define DEFAULT_MIGRATE_POSTCOPY_PREEMPT_CHANNELS 1
 #define DEFAULT_MIGRATE_MULTIFD_COMPRESSION MULTIFD_COMPRESSION_NONE
 /* 0: means nocompress, 1: best speed, ... 9: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
@@ -98,6 +102,8 @@ Property migration_properties[] = {
                       multifd_flush_after_each_section, false),
     DEFINE_PROP_UINT8("x-clear-bitmap-shift", MigrationState,
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
+    DEFINE_PROP_UINT8("x-bitmap-sync-threads", MigrationState,
+                      bitmap_sync_threads, DEFAULT_MIGRATE_BITMAP_SYNC_THREADS),
     DEFINE_PROP_BOOL("x-preempt-pre-7-2", MigrationState,
                      preempt_pre_7_2, false),
 
@@ -179,6 +185,9 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_MODE("mode", MigrationState,
                       parameters.mode,
                       MIG_MODE_NORMAL),
+    DEFINE_PROP_UINT8("postcopy-preempt-channels", MigrationState,
+                      parameters.postcopy_preempt_channels,
+                      DEFAULT_MIGRATE_POSTCOPY_PREEMPT_CHANNELS),
 
     /* Migration capabilities */
     DEFINE_PROP_MIG_CAP("x-xbzrle", MIGRATION_CAPABILITY_XBZRLE),
@@ -195,6 +204,8 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-block", MIGRATION_CAPABILITY_BLOCK),
     DEFINE_PROP_MIG_CAP("x-return-path", MIGRATION_CAPABILITY_RETURN_PATH),
     DEFINE_PROP_MIG_CAP("x-multifd", MIGRATION_CAPABILITY_MULTIFD),
+    DEFINE_PROP_MIG_CAP("x-multifd-zero-page",
+                        MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE),
     DEFINE_PROP_MIG_CAP("x-background-snapshot",
             MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT),
 #ifdef CONFIG_LINUX
@@ -204,6 +215,12 @@ Property migration_properties[] = {
     DEFINE_PROP_MIG_CAP("x-switchover-ack",
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-parallel-device-state",
+                        MIGRATION_CAPABILITY_PARALLEL_DEVICE_STATE),
+    DEFINE_PROP_MIG_CAP("x-dirty-limit-adaptive",
+                        MIGRATION_CAPABILITY_DIRTY_LIMIT_ADAPTIVE),
+    DEFINE_PROP_MIG_CAP("x-io-uring", MIGRATION_CAPABILITY_IO_URING),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -256,6 +273,13 @@ bool migrate_dirty_limit(void)
     return s->capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
 }
 
+bool migrate_dirty_limit_adaptive(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT_ADAPTIVE];
+}
+
 bool migrate_events(void)
 {
     MigrationState *s = migrate_get_current();
@@ -270,6 +294,13 @@ bool migrate_ignore_shared(void)
     return s->capabilities[MIGRATION_CAPABILITY_X_IGNORE_SHARED];
 }
 
+bool migrate_io_uring(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_IO_URING];
+}
+
 bool migrate_late_block_activate(void)
 {
     MigrationState *s = migrate_get_current();
@@ -277,6 +308,13 @@ bool migrate_late_block_activate(void)
     return s->capabilities[MIGRATION_CAPABILITY_LATE_BLOCK_ACTIVATE];
 }
 
+bool migrate_mapped_ram(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
 bool migrate_multifd(void)
 {
     MigrationState *s = migrate_get_current();
@@ -284,6 +322,20 @@ bool migrate_multifd(void)
     return s->capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+bool migrate_multifd_zero_page(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE];
+}
+
+bool migrate_parallel_device_state(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_PARALLEL_DEVICE_STATE];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s = migrate_get_current();
@@ -444,6 +496,7 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_LATE_BLOCK_ACTIVATE,
     MIGRATION_CAPABILITY_RETURN_PATH,
     MIGRATION_CAPABILITY_MULTIFD,
+    MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE,
     MIGRATION_CAPABILITY_PAUSE_BEFORE_SWITCHOVER,
     MIGRATION_CAPABILITY_AUTO_CONVERGE,
     MIGRATION_CAPABILITY_RELEASE_RAM,
@@ -454,6 +507,17 @@ INITIALIZE_MIGRATE_CAPS_SET(check_caps_background_snapshot,
     MIGRATION_CAPABILITY_VALIDATE_UUID,
     MIGRATION_CAPABILITY_ZERO_COPY_SEND);
 
+/* Mapped-ram compatibility check list */
+static const
+INITIALIZE_MIGRATE_CAPS_SET(check_caps_mapped_ram,
+    MIGRATION_CAPABILITY_XBZRLE,
+    MIGRATION_CAPABILITY_COMPRESS,
+    MIGRATION_CAPABILITY_POSTCOPY_RAM,
+    MIGRATION_CAPABILITY_X_COLO,
+    MIGRATION_CAPABILITY_BLOCK,
+    MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT,
+    MIGRATION_CAPABILITY_ZERO_COPY_SEND);
+
 static bool migrate_incoming_started(void)
 {
     return !!migration_incoming_get_current()->transport_data;
@@ -575,6 +639,13 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
     }
 #endif
 
+#ifndef CONFIG_LINUX_IO_URING
+    if (new_caps[MIGRATION_CAPABILITY_IO_URING]) {
+        error_setg(errp, "io_uring support not built in");
+        return false;
+    }
+#endif
+
     if (new_caps[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT]) {
         if (!new_caps[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
             error_setg(errp, "Postcopy preempt requires postcopy-ram");
@@ -610,6 +681,36 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        int idx;
+
+        for (idx = 0; idx < check_caps_mapped_ram.size; idx++) {
+            int incomp_cap = check_caps_mapped_ram.caps[idx];
+            if (new_caps[incomp_cap]) {
+                error_setg(errp,
+                           "Mapped-ram migration is incompatible with '%s'",
+                           MigrationCapability_str(incomp_cap));
+                return false;
+            }
+        }
+
+        /* Pages are stored uncompressed at their fixed offsets */
+        if (migrate_multifd_compression()) {
+            error_setg(errp,
+                       "Mapped-ram migration is incompatible with "
+                       "multifd compression");
+            return false;
+        }
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE]) {
+        if (!new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
+            error_setg(errp, "Capability 'multifd-zero-page' requires "
+                             "capability 'multifd'");
+            return false;
+        }
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_SWITCHOVER_ACK]) {
         if (!new_caps[MIGRATION_CAPABILITY_RETURN_PATH]) {
             error_setg(errp, "Capability 'switchover-ack' requires capability "
@@ -631,9 +732,19 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_DIRTY_LIMIT_ADAPTIVE] &&
+        !new_caps[MIGRATION_CAPABILITY_DIRTY_LIMIT]) {
+        error_setg(errp, "Capability 'dirty-limit-adaptive' requires "
+                         "capability 'dirty-limit'");
+        return false;
+    }
+
     if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
-        if (new_caps[MIGRATION_CAPABILITY_XBZRLE]) {
-            error_setg(errp, "Multifd is not compatible with xbzrle");
+        /* XBZRLE pages are carried by the uncompressed multifd method */
+        if (new_caps[MIGRATION_CAPABILITY_XBZRLE] &&
+            migrate_multifd_compression()) {
+            error_setg(errp, "Multifd compression is not compatible with "
+                       "xbzrle");
             return false;
         }
     }
@@ -837,6 +948,13 @@ MigMode migrate_mode(void)
     return s->parameters.mode;
 }
 
+int migrate_postcopy_preempt_channels(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->parameters.postcopy_preempt_channels;
+}
+
 int migrate_multifd_channels(void)
 {
     MigrationState *s = migrate_get_current();
@@ -1011,6 +1129,8 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->vcpu_dirty_limit = s->parameters.vcpu_dirty_limit;
     params->has_mode = true;
     params->mode = s->parameters.mode;
+    params->has_postcopy_preempt_channels = true;
+    params->postcopy_preempt_channels = s->parameters.postcopy_preempt_channels;
 
     return params;
 }
@@ -1047,6 +1167,7 @@ void migrate_params_init(MigrationParameters *params)
     params->has_x_vcpu_dirty_limit_period = true;
     params->has_vcpu_dirty_limit = true;
     params->has_mode = true;
+    params->has_postcopy_preempt_channels = true;
 }
 
 /*
@@ -1138,6 +1259,16 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_postcopy_preempt_channels &&
+        (params->postcopy_preempt_channels < 1 ||
+         params->postcopy_preempt_channels > POSTCOPY_PREEMPT_CHANNELS_MAX)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_preempt_channels",
+                   "a value between 1 and "
+                   stringify(POSTCOPY_PREEMPT_CHANNELS_MAX));
+        return false;
+    }
+
     if (params->has_multifd_zlib_level &&
         (params->multifd_zlib_level > 9)) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "multifd_zlib_level",
@@ -1206,6 +1337,20 @@ bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (migrate_mapped_ram() &&
+        params->has_multifd_compression && params->multifd_compression) {
+        error_setg(errp,
+                   "Mapped-ram migration is incompatible with "
+                   "multifd compression");
+        return false;
+    }
+
+    if (migrate_multifd() && migrate_xbzrle() &&
+        params->has_multifd_compression && params->multifd_compression) {
+        error_setg(errp, "Multifd compression is not compatible with xbzrle");
+        return false;
+    }
+
 #ifdef CONFIG_LINUX
     if (migrate_zero_copy_send() &&
         ((params->has_multifd_compression && params->multifd_compression) ||
@@ -1348,6 +1493,10 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_mode) {
         dest->mode = params->mode;
     }
+
+    if (params->has_postcopy_preempt_channels) {
+        dest->postcopy_preempt_channels = params->postcopy_preempt_channels;
+    }
 }
 
 static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
@@ -1492,6 +1641,11 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_mode) {
         s->parameters.mode = params->mode;
     }
+
+    if (params->has_postcopy_preempt_channels) {
+        s->parameters.postcopy_preempt_channels =
+            params->postcopy_preempt_channels;
+    }
 }
 
 void qmp_migrate_set_parameters(MigrateSetParameters *params, Error **errp)
@@ -30,10 +30,15 @@ bool migrate_colo(void);
 bool migrate_compress(void);
 bool migrate_dirty_bitmaps(void);
 bool migrate_dirty_limit(void);
+bool migrate_dirty_limit_adaptive(void);
 bool migrate_events(void);
 bool migrate_ignore_shared(void);
+bool migrate_io_uring(void);
 bool migrate_late_block_activate(void);
+bool migrate_mapped_ram(void);
 bool migrate_multifd(void);
+bool migrate_multifd_zero_page(void);
+bool migrate_parallel_device_state(void);
 bool migrate_pause_before_switchover(void);
 bool migrate_postcopy_blocktime(void);
 bool migrate_postcopy_preempt(void);
@@ -85,6 +90,7 @@ uint64_t migrate_avail_switchover_bandwidth(void);
 uint64_t migrate_max_postcopy_bandwidth(void);
 MigMode migrate_mode(void);
 int migrate_multifd_channels(void);
+int migrate_postcopy_preempt_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
@@ -17,12 +17,20 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/thread.h"
+#include "qemu/rcu.h"
 #include "page_cache.h"
 #include "trace.h"
 
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* number of pages that an address can be cached in */
+#define PAGE_CACHE_WAYS 4
+
+/* maximum number of separately locked parts of the cache */
+#define PAGE_CACHE_MAX_SHARDS 64
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
@@ -31,11 +39,23 @@ struct CacheItem {
     uint8_t *it_data;
 };
 
+/*
+ * The cache is set-associative: an address maps to a set of
+ * PAGE_CACHE_WAYS items and can be stored in any of them.  When the
+ * set is full, the least recently used item is evicted unless it is
+ * still fresh.  Sets are spread over shards, each with its own lock,
+ * so that several threads can use the cache at once.
+ */
 struct PageCache {
+    struct rcu_head rcu;
     CacheItem *page_cache;
+    QemuMutex *locks;
     size_t page_size;
     size_t max_num_items;
     size_t num_items;
+    size_t num_sets;
+    unsigned int ways;
+    unsigned int num_shards;
 };
 
 PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
@@ -58,7 +78,7 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     }
 
     /* We prefer not to abort if there is no memory */
-    cache = g_try_malloc(sizeof(*cache));
+    cache = g_try_malloc0(sizeof(*cache));
     if (!cache) {
         error_setg(errp, "Failed to allocate cache");
         return NULL;
@@ -66,6 +86,9 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
     cache->page_size = page_size;
     cache->num_items = 0;
     cache->max_num_items = num_pages;
+    cache->ways = MIN(num_pages, PAGE_CACHE_WAYS);
+    cache->num_sets = num_pages / cache->ways;
+    cache->num_shards = MIN(cache->num_sets, PAGE_CACHE_MAX_SHARDS);
 
     trace_migration_pagecache_init(cache->max_num_items);
 
@@ -84,6 +107,11 @@ PageCache *cache_init(uint64_t new_size, size_t page_size, Error **errp)
         cache->page_cache[i].it_addr = -1;
     }
 
+    cache->locks = g_new(QemuMutex, cache->num_shards);
+    for (i = 0; i < cache->num_shards; i++) {
+        qemu_mutex_init(&cache->locks[i]);
+    }
+
     return cache;
 }
 
@@ -97,34 +125,64 @@ void cache_fini(PageCache *cache)
     for (i = 0; i < cache->max_num_items; i++) {
         g_free(cache->page_cache[i].it_data);
     }
+    for (i = 0; i < cache->num_shards; i++) {
+        qemu_mutex_destroy(&cache->locks[i]);
+    }
 
+    g_free(cache->locks);
     g_free(cache->page_cache);
     cache->page_cache = NULL;
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+void cache_fini_rcu(PageCache *cache)
+{
+    call_rcu(cache, cache_fini, rcu);
+}
+
+static size_t cache_get_set(const PageCache *cache, uint64_t address)
+{
+    g_assert(cache->num_sets);
+    return (address / cache->page_size) & (cache->num_sets - 1);
+}
+
+static QemuMutex *cache_get_lock(PageCache *cache, uint64_t addr)
+{
+    return &cache->locks[cache_get_set(cache, addr) & (cache->num_shards - 1)];
+}
+
+void cache_lock(PageCache *cache, uint64_t addr)
+{
+    qemu_mutex_lock(cache_get_lock(cache, addr));
+}
+
+void cache_unlock(PageCache *cache, uint64_t addr)
 {
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    qemu_mutex_unlock(cache_get_lock(cache, addr));
 }
 
 static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
 {
-    size_t pos;
+    CacheItem *set;
+    unsigned int i;
 
     g_assert(cache);
     g_assert(cache->page_cache);
 
-    pos = cache_get_cache_pos(cache, addr);
-
-    return &cache->page_cache[pos];
+    set = &cache->page_cache[cache_get_set(cache, addr) * cache->ways];
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].it_addr == addr) {
+            return &set[i];
+        }
+    }
+    return NULL;
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? it->it_data : NULL;
 }
 
 bool cache_is_cached(const PageCache *cache, uint64_t addr,
@@ -134,7 +192,7 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
 
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_addr == addr) {
+    if (it) {
         /* update the it_age when the cache hit */
         it->it_age = current_age;
         return true;
@@ -145,17 +203,31 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
                  uint64_t current_age)
 {
+    CacheItem *set, *it;
+    unsigned int i;
 
-    CacheItem *it;
-
-    /* actual update of entry */
     it = cache_get_by_addr(cache, addr);
 
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
-        return -1;
+    if (!it) {
+        /* pick a free item, or else the least recently used one */
+        set = &cache->page_cache[cache_get_set(cache, addr) * cache->ways];
+        it = &set[0];
+        for (i = 0; i < cache->ways; i++) {
+            if (!set[i].it_data) {
+                it = &set[i];
+                break;
+            }
+            if (set[i].it_age < it->it_age) {
+                it = &set[i];
+            }
+        }
+
+        if (it->it_data && it->it_age + CACHED_PAGE_LIFETIME > current_age) {
+            /* the cache page is fresh, don't replace it */
+            return -1;
+        }
     }
+
     /* allocate page */
     if (!it->it_data) {
         it->it_data = g_try_malloc(cache->page_size);
@@ -163,7 +235,7 @@ int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
             trace_migration_pagecache_insert();
             return -1;
         }
-        cache->num_items++;
+        qatomic_inc(&cache->num_items);
     }
 
     memcpy(it->it_data, pdata, cache->page_size);
@@ -35,6 +35,35 @@ PageCache *cache_init(uint64_t cache_size, size_t page_size, Error **errp);
  */
 void cache_fini(PageCache *cache);
 
+/**
+ * cache_fini_rcu: free all cache resources after an RCU grace period
+ *
+ * Used when other threads may still be looking at the cache from
+ * within an RCU read-side critical section.
+ *
+ * @cache pointer to the PageCache struct
+ */
+void cache_fini_rcu(PageCache *cache);
+
+/**
+ * cache_lock: lock the part of the cache holding an address
+ *
+ * The lock must be held around cache_is_cached(), get_cached_data()
+ * and cache_insert(), and for as long as the cached data is used.
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_lock(PageCache *cache, uint64_t addr);
+
+/**
+ * cache_unlock: unlock the part of the cache holding an address
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_unlock(PageCache *cache, uint64_t addr);
+
 /**
  * cache_is_cached: Checks to see if the page is cached
  *
@@ -59,7 +88,8 @@ uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
 
 /**
  * cache_insert: insert the page into the cache. the page cache
- * will dup the data on insert. the previous value will be overwritten
+ * will dup the data on insert. the previous value will be overwritten,
+ * otherwise the least recently used page of its set is evicted
  *
  * Returns -1 when the page isn't inserted into cache
  *
@@ -89,10 +89,10 @@ int postcopy_notify(enum PostcopyNotifyReason reason, Error **errp)
  */
 void postcopy_thread_create(MigrationIncomingState *mis,
                             QemuThread *thread, const char *name,
-                            void *(*fn)(void *), int joinable)
+                            void *(*fn)(void *), void *opaque, int joinable)
 {
     qemu_sem_init(&mis->thread_sync_sem, 0);
-    qemu_thread_create(thread, name, fn, mis, joinable);
+    qemu_thread_create(thread, name, fn, opaque, joinable);
     qemu_sem_wait(&mis->thread_sync_sem);
     qemu_sem_destroy(&mis->thread_sync_sem);
 }
@@ -177,10 +177,24 @@ static uint32List *get_vcpu_blocktime_list(PostcopyBlocktimeContext *ctx)
     return list;
 }
 
+static uint64List *get_fault_latency_list(MigrationIncomingState *mis)
+{
+    uint64List *list = NULL;
+    int i;
+
+    QEMU_LOCK_GUARD(&mis->page_request_mutex);
+    for (i = POSTCOPY_FAULT_LATENCY_BUCKETS - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(list, mis->postcopy_fault_latency[i]);
+    }
+
+    return list;
+}
+
 /*
  * This function just populates MigrationInfo from postcopy's
- * blocktime context. It will not populate MigrationInfo,
- * unless postcopy-blocktime capability was set.
+ * fault latency histogram and blocktime context. It will not
+ * populate the blocktime, unless postcopy-blocktime capability
+ * was set.
  *
  * @info: pointer to MigrationInfo to populate
  */
@@ -189,6 +203,11 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     MigrationIncomingState *mis = migration_incoming_get_current();
     PostcopyBlocktimeContext *bc = mis->blocktime_ctx;
 
+    if (migration_incoming_postcopy_advised()) {
+        info->has_postcopy_fault_latency = true;
+        info->postcopy_fault_latency = get_fault_latency_list(mis);
+    }
+
     if (!bc) {
         return;
     }
@@ -597,7 +616,9 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
     trace_postcopy_ram_incoming_cleanup_entry();
 
     if (mis->preempt_thread_status == PREEMPT_THREAD_CREATED) {
-        /* Notify the fast load thread to quit */
+        unsigned int i;
+
+        /* Notify the fast load threads to quit */
         mis->preempt_thread_status = PREEMPT_THREAD_QUIT;
         /*
          * Update preempt_thread_status before reading count.  Note: mutex
@@ -606,7 +627,7 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
          */
         smp_mb();
         /*
-         * It's possible that the preempt thread is still handling the last
+         * It's possible that the preempt threads are still handling the last
          * pages to arrive which were requested by guest page faults.
          * Making sure nothing is left behind by waiting on the condvar if
          * that unlikely case happened.
@@ -616,17 +637,21 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
                 /*
                  * It is guaranteed to receive a signal later, because the
                  * count>0 now, so it's destined to be decreased to zero
-                 * very soon by the preempt thread.
+                 * very soon by the preempt threads.
                  */
                 qemu_cond_wait(&mis->page_request_cond,
                                &mis->page_request_mutex);
             }
         }
-        /* Notify the fast load thread to quit */
-        if (mis->postcopy_qemufile_dst) {
-            qemu_file_shutdown(mis->postcopy_qemufile_dst);
+        /* Notify the fast load threads to quit */
+        for (i = 0; i < postcopy_preempt_channels(mis); i++) {
+            PostcopyPreemptChannel *ch = &mis->postcopy_preempt[i];
+
+            if (ch->file) {
+                qemu_file_shutdown(ch->file);
+            }
+            qemu_thread_join(&ch->thread);
         }
-        qemu_thread_join(&mis->postcopy_prio_thread);
         mis->preempt_thread_status = PREEMPT_THREAD_NONE;
     }
 
@@ -1166,8 +1191,9 @@ static int postcopy_temp_pages_setup(MigrationIncomingState *mis)
     void *temp_page;
 
     if (migrate_postcopy_preempt()) {
-        /* If preemption enabled, need extra channel for urgent requests */
-        mis->postcopy_channels = RAM_CHANNEL_MAX;
+        /* If preemption enabled, need extra channels for urgent requests */
+        mis->postcopy_channels = RAM_CHANNEL_POSTCOPY +
+                                 mis->postcopy_preempt_nr_channels;
     } else {
         /* Both precopy/postcopy on the same channel */
         mis->postcopy_channels = 1;
@@ -1242,7 +1268,8 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     }
 
     postcopy_thread_create(mis, &mis->fault_thread, "fault-default",
-                           postcopy_ram_fault_thread, QEMU_THREAD_JOINABLE);
+                           postcopy_ram_fault_thread, mis,
+                           QEMU_THREAD_JOINABLE);
     mis->have_fault_thread = true;
 
     /* Mark so that we get notified of accesses to unwritten areas */
@@ -1257,12 +1284,20 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     }
 
     if (migrate_postcopy_preempt()) {
+        unsigned int i;
+
         /*
-         * This thread needs to be created after the temp pages because
-         * it'll fetch RAM_CHANNEL_POSTCOPY PostcopyTmpPage immediately.
+         * These threads need to be created after the temp pages because
+         * they'll fetch their PostcopyTmpPage immediately.
          */
-        postcopy_thread_create(mis, &mis->postcopy_prio_thread, "fault-fast",
-                               postcopy_preempt_thread, QEMU_THREAD_JOINABLE);
+        for (i = 0; i < postcopy_preempt_channels(mis); i++) {
+            g_autofree char *name = g_strdup_printf("fault-fast/%u", i);
+
+            postcopy_thread_create(mis, &mis->postcopy_preempt[i].thread, name,
+                                   postcopy_preempt_thread,
+                                   &mis->postcopy_preempt[i],
+                                   QEMU_THREAD_JOINABLE);
+        }
         mis->preempt_thread_status = PREEMPT_THREAD_CREATED;
     }
 
@@ -1271,6 +1306,17 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     return 0;
 }
 
+/* Called with page_request_mutex held */
+static void postcopy_fault_latency_add(MigrationIncomingState *mis,
+                                       int64_t req_time)
+{
+    int64_t latency = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - req_time;
+    int bucket = latency > 0 ? 64 - clz64(latency) : 0;
+
+    bucket = MIN(bucket, POSTCOPY_FAULT_LATENCY_BUCKETS - 1);
+    mis->postcopy_fault_latency[bucket]++;
+}
+
 static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
                                void *from_addr, uint64_t pagesize, RAMBlock *rb)
 {
@@ -1299,7 +1345,10 @@ static int qemu_ufd_copy_ioctl(MigrationIncomingState *mis, void *host_addr,
          * If this page resolves a page fault for a previous recorded faulted
          * address, take a special note to maintain the requested page list.
          */
-        if (g_tree_lookup(mis->page_requested, host_addr)) {
+        int64_t *req_time = g_tree_lookup(mis->page_requested, host_addr);
+
+        if (req_time) {
+            postcopy_fault_latency_add(mis, *req_time);
             g_tree_remove(mis->page_requested, host_addr);
             int left_pages = qatomic_dec_fetch(&mis->page_requested_count);
 
@@ -1608,16 +1657,80 @@ void postcopy_unregister_shared_ufd(struct PostCopyFD *pcfd)
     }
 }
 
+/*
+ * Number of postcopy preempt channels of the incoming migration, valid
+ * once postcopy is set up.
+ */
+unsigned int postcopy_preempt_channels(MigrationIncomingState *mis)
+{
+    return mis->postcopy_channels - RAM_CHANNEL_POSTCOPY;
+}
+
+bool postcopy_preempt_all_channels_created(MigrationIncomingState *mis)
+{
+    int i;
+
+    for (i = 0; i < mis->postcopy_preempt_nr_channels; i++) {
+        if (!mis->postcopy_preempt[i].file) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file)
 {
+    int i;
+
+    /*
+     * The channels all carry the same kind of data, so they are used in
+     * the order they get connected.
+     */
+    for (i = 0; i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+        if (!mis->postcopy_preempt[i].file) {
+            break;
+        }
+    }
+    if (i == POSTCOPY_PREEMPT_CHANNELS_MAX) {
+        error_report("%s: too many postcopy preempt channels", __func__);
+        qemu_fclose(file);
+        return;
+    }
+
     /*
      * The new loading channel has its own threads, so it needs to be
      * blocked too.  It's by default true, just be explicit.
      */
     qemu_file_set_blocking(file, true);
-    mis->postcopy_qemufile_dst = file;
-    qemu_sem_post(&mis->postcopy_qemufile_dst_done);
-    trace_postcopy_preempt_new_channel();
+    mis->postcopy_preempt[i].file = file;
+    qemu_sem_post(&mis->postcopy_preempt[i].file_done);
+    trace_postcopy_preempt_new_channel(i);
+}
+
+/* Returns the first error of the incoming postcopy preempt channels */
+int postcopy_preempt_dst_get_error(MigrationIncomingState *mis)
+{
+    int i, ret = 0;
+
+    for (i = 0; !ret && i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+        if (mis->postcopy_preempt[i].file) {
+            ret = qemu_file_get_error(mis->postcopy_preempt[i].file);
+        }
+    }
+    return ret;
+}
+
+/* Returns the first error of the outgoing postcopy preempt channels */
+int postcopy_preempt_src_get_error(MigrationState *s, Error **errp)
+{
+    int i, ret = 0;
+
+    for (i = 0; !ret && i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+        if (s->postcopy_qemufile_src[i]) {
+            ret = qemu_file_get_error_obj(s->postcopy_qemufile_src[i], errp);
+        }
+    }
+    return ret;
 }
 
 /*
@@ -1632,9 +1745,18 @@ postcopy_preempt_send_channel_done(MigrationState *s,
         migrate_set_error(s, local_err);
         error_free(local_err);
     } else {
+        int i;
+
+        /* Completions are handled in the main thread, one at a time */
+        for (i = 0; i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+            if (!s->postcopy_qemufile_src[i]) {
+                break;
+            }
+        }
+        assert(i < POSTCOPY_PREEMPT_CHANNELS_MAX);
         migration_ioc_register_yank(ioc);
-        s->postcopy_qemufile_src = qemu_file_new_output(ioc);
-        trace_postcopy_preempt_new_channel();
+        s->postcopy_qemufile_src[i] = qemu_file_new_output(ioc);
+        trace_postcopy_preempt_new_channel(i);
     }
 
     /*
@@ -1686,12 +1808,14 @@ out:
 }
 
 /*
- * This function will kick off an async task to establish the preempt
- * channel, and wait until the connection setup completed.  Returns 0 if
- * channel established, -1 for error.
+ * This function will kick off async tasks to establish the preempt
+ * channels, and wait until the connection setups completed.  Returns 0 if
+ * channels established, -1 for error.
  */
 int postcopy_preempt_establish_channel(MigrationState *s)
 {
+    int i;
+
     /* If preempt not enabled, no need to wait */
     if (!migrate_postcopy_preempt()) {
         return 0;
@@ -1707,26 +1831,38 @@ int postcopy_preempt_establish_channel(MigrationState *s)
     }
 
     /*
-     * We need the postcopy preempt channel to be established before
+     * We need the postcopy preempt channels to be established before
      * starting doing anything.
      */
-    qemu_sem_wait(&s->postcopy_qemufile_src_sem);
+    for (i = 0; i < s->postcopy_preempt_nr_channels; i++) {
+        qemu_sem_wait(&s->postcopy_qemufile_src_sem);
+    }
 
-    return s->postcopy_qemufile_src ? 0 : -1;
+    for (i = 0; i < s->postcopy_preempt_nr_channels; i++) {
+        if (!s->postcopy_qemufile_src[i]) {
+            return -1;
+        }
+    }
+    return 0;
 }
 
 void postcopy_preempt_setup(MigrationState *s)
 {
-    /* Kick an async task to connect */
-    socket_send_channel_create(postcopy_preempt_send_channel_new, s);
+    int i;
+
+    /* Kick async tasks to connect */
+    for (i = 0; i < s->postcopy_preempt_nr_channels; i++) {
+        socket_send_channel_create(postcopy_preempt_send_channel_new, s);
+    }
 }
 
-static void postcopy_pause_ram_fast_load(MigrationIncomingState *mis)
+static void postcopy_pause_ram_fast_load(MigrationIncomingState *mis,
+                                         PostcopyPreemptChannel *ch)
 {
     trace_postcopy_pause_fast_load();
-    qemu_mutex_unlock(&mis->postcopy_prio_thread_mutex);
+    qemu_mutex_unlock(&ch->thread_mutex);
     qemu_sem_wait(&mis->postcopy_pause_sem_fast_load);
-    qemu_mutex_lock(&mis->postcopy_prio_thread_mutex);
+    qemu_mutex_lock(&ch->thread_mutex);
     trace_postcopy_pause_fast_load_continued();
 }
 
@@ -1737,7 +1873,9 @@ static bool preempt_thread_should_run(MigrationIncomingState *mis)
 
 void *postcopy_preempt_thread(void *opaque)
 {
-    MigrationIncomingState *mis = opaque;
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    PostcopyPreemptChannel *ch = opaque;
+    int channel = RAM_CHANNEL_POSTCOPY + (ch - mis->postcopy_preempt);
     int ret;
 
     trace_postcopy_preempt_thread_entry();
@@ -1750,22 +1888,21 @@ void *postcopy_preempt_thread(void *opaque)
      * The preempt channel is established in asynchronous way.  Wait
      * for its completion.
      */
-    qemu_sem_wait(&mis->postcopy_qemufile_dst_done);
+    qemu_sem_wait(&ch->file_done);
 
     /* Sending RAM_SAVE_FLAG_EOS to terminate this thread */
-    qemu_mutex_lock(&mis->postcopy_prio_thread_mutex);
+    qemu_mutex_lock(&ch->thread_mutex);
     while (preempt_thread_should_run(mis)) {
-        ret = ram_load_postcopy(mis->postcopy_qemufile_dst,
-                                RAM_CHANNEL_POSTCOPY);
+        ret = ram_load_postcopy(ch->file, channel);
         /* If error happened, go into recovery routine */
         if (ret && preempt_thread_should_run(mis)) {
-            postcopy_pause_ram_fast_load(mis);
+            postcopy_pause_ram_fast_load(mis, ch);
         } else {
             /* We're done */
             break;
         }
     }
-    qemu_mutex_unlock(&mis->postcopy_prio_thread_mutex);
+    qemu_mutex_unlock(&ch->thread_mutex);
 
     rcu_unregister_thread();
 
@@ -138,7 +138,7 @@ int postcopy_notify(enum PostcopyNotifyReason reason, Error **errp);
 
 void postcopy_thread_create(MigrationIncomingState *mis,
                             QemuThread *thread, const char *name,
-                            void *(*fn)(void *), int joinable);
+                            void *(*fn)(void *), void *opaque, int joinable);
 
 struct PostCopyFD;
 
@@ -184,14 +184,24 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd, uint64_t client_addr,
 int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
                                  uint64_t client_addr, uint64_t offset);
 
-/* Hard-code channels for now for postcopy preemption */
+/* Maximum number of postcopy preempt channels */
+#define POSTCOPY_PREEMPT_CHANNELS_MAX 8
+
+/*
+ * Channel RAM_CHANNEL_POSTCOPY + n is the n-th postcopy preempt channel,
+ * see migrate_postcopy_preempt_channels().
+ */
 enum PostcopyChannels {
     RAM_CHANNEL_PRECOPY = 0,
     RAM_CHANNEL_POSTCOPY = 1,
-    RAM_CHANNEL_MAX,
+    RAM_CHANNEL_MAX = RAM_CHANNEL_POSTCOPY + POSTCOPY_PREEMPT_CHANNELS_MAX,
 };
 
+unsigned int postcopy_preempt_channels(MigrationIncomingState *mis);
+bool postcopy_preempt_all_channels_created(MigrationIncomingState *mis);
 void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file);
+int postcopy_preempt_dst_get_error(MigrationIncomingState *mis);
+int postcopy_preempt_src_get_error(MigrationState *s, Error **errp);
 void postcopy_preempt_setup(MigrationState *s);
 int postcopy_preempt_establish_channel(MigrationState *s);
 
@@ -290,6 +290,119 @@ int qemu_fflush(QEMUFile *f)
     return f->last_error;
 }
 
+/*
+ * Get the position in the underlying channel that the next byte
+ * read from or written to @f corresponds to.  Pending writes are
+ * flushed first.
+ */
+off_t qemu_get_offset(QEMUFile *f)
+{
+    off_t pos;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    }
+
+    pos = qio_channel_io_seek(f->ioc, 0, SEEK_CUR, NULL);
+    if (pos < 0) {
+        return pos;
+    }
+
+    return pos - (f->buf_size - f->buf_index);
+}
+
+/*
+ * Move the position of @f in the underlying channel, dropping any
+ * read-ahead data and flushing any pending writes.
+ */
+void qemu_set_offset(QEMUFile *f, off_t off, int whence)
+{
+    Error *err = NULL;
+    off_t ret;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else if (whence == SEEK_CUR) {
+        /* Account for data that was read ahead into the buffer */
+        off -= f->buf_size - f->buf_index;
+    }
+
+    ret = qio_channel_io_seek(f->ioc, off, whence, &err);
+    if (ret == (off_t)-1) {
+        qemu_file_set_error_obj(f, -EIO, err);
+    }
+
+    if (!qemu_file_is_writable(f)) {
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+}
+
+/*
+ * Write @buflen bytes of @buf at the absolute position @pos of the
+ * underlying channel, without moving the stream position of @f.
+ */
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        off_t pos)
+{
+    Error *err = NULL;
+
+    if (f->last_error) {
+        return;
+    }
+
+    while (buflen) {
+        ssize_t ret = qio_channel_pwrite(f->ioc, (char *)buf, buflen,
+                                         pos, &err);
+        if (ret < 0) {
+            qemu_file_set_error_obj(f, -EIO, err);
+            return;
+        }
+        if (ret == 0) {
+            qemu_file_set_error(f, -ENOSPC);
+            return;
+        }
+        stat64_add(&mig_stats.qemu_file_transferred, ret);
+        buf += ret;
+        buflen -= ret;
+        pos += ret;
+    }
+}
+
+/*
+ * Read @buflen bytes into @buf from the absolute position @pos of
+ * the underlying channel, without moving the stream position of @f.
+ *
+ * Returns the number of bytes read, which is less than @buflen only
+ * on error or end of file.
+ */
+size_t qemu_get_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                          off_t pos)
+{
+    Error *err = NULL;
+    size_t done = 0;
+
+    if (f->last_error) {
+        return 0;
+    }
+
+    while (done < buflen) {
+        ssize_t ret = qio_channel_pread(f->ioc, (char *)buf + done,
+                                        buflen - done, pos + done, &err);
+        if (ret < 0) {
+            qemu_file_set_error_obj(f, -EIO, err);
+            break;
+        }
+        if (ret == 0) {
+            qemu_file_set_error(f, -EIO);
+            break;
+        }
+        done += ret;
+    }
+
+    return done;
+}
+
 /*
  * Attempt to fill the buffer from the underlying file
  * Returns the number of bytes read, or negative value for an error.
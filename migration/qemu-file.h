@@ -78,4 +78,11 @@ int qemu_file_get_to_fd(QEMUFile *f, int fd, size_t size);
 
 QIOChannel *qemu_file_get_ioc(QEMUFile *file);
 
+off_t qemu_get_offset(QEMUFile *f);
+void qemu_set_offset(QEMUFile *f, off_t off, int whence);
+void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                        off_t pos);
+size_t qemu_get_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                          off_t pos);
+
 #endif
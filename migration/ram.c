@@ -31,6 +31,7 @@
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
+#include "qemu/units.h"
 #include "qemu/main-loop.h"
 #include "xbzrle.h"
 #include "ram-compress.h"
@@ -94,6 +95,33 @@
 #define RAM_SAVE_FLAG_MULTIFD_FLUSH    0x200
 /* We can't use any flag that is bigger than 0x200 */
 
+/*
+ * mapped-ram migration supports O_DIRECT, so we need to make sure the
+ * userspace buffer, the IO operation size and the file offset are
+ * aligned according to the underlying device's block size.  The first
+ * two are already aligned to page size, but we need to add padding to
+ * the file to align the offset.  We cannot read the block size
+ * dynamically because the migration file can be moved between
+ * different systems, so use 1M to cover most block sizes and to keep
+ * the file offset aligned at page size as well.
+ */
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT 0x100000
+
+/* Largest read issued when restoring a run of pages from a mapped-ram file */
+#define MAPPED_RAM_LOAD_RUN_SIZE (8 * MiB)
+
+#define MAPPED_RAM_HDR_VERSION 1
+struct MappedRamHeader {
+    uint32_t version;
+    /* The target's page size, so we know how many pages are in the bitmap */
+    uint64_t page_size;
+    /* The offset in the migration file where the pages bitmap is stored */
+    uint64_t bitmap_offset;
+    /* The offset in the migration file where the pages are stored */
+    uint64_t pages_offset;
+} QEMU_PACKED;
+typedef struct MappedRamHeader MappedRamHeader;
+
 XBZRLECacheStats xbzrle_counters;
 
 /* used by the search for pages to send */
@@ -123,8 +151,12 @@ static struct {
     uint8_t *encoded_buf;
     /* buffer for storing page content */
     uint8_t *current_buf;
-    /* Cache for XBZRLE, Protected by lock. */
+    /*
+     * Cache for XBZRLE.  The pointer is replaced under lock and read
+     * with RCU; the pages are protected by the cache's own locks.
+     */
     PageCache *cache;
+    /* Protects the cache pointer and multifd updates of xbzrle_counters */
     QemuMutex lock;
     /* it will store a page full of zeros */
     uint8_t *zero_target_page;
@@ -185,8 +217,9 @@ int xbzrle_cache_resize(uint64_t new_size, Error **errp)
             goto out;
         }
 
-        cache_fini(XBZRLE.cache);
-        XBZRLE.cache = new_cache;
+        /* multifd channels may still be using the old cache */
+        cache_fini_rcu(XBZRLE.cache);
+        qatomic_rcu_set(&XBZRLE.cache, new_cache);
     }
 out:
     XBZRLE_cache_unlock();
@@ -557,6 +590,130 @@ void mig_throttle_counter_reset(void)
     rs->bytes_xfer_prev = migration_transferred_bytes();
 }
 
+/**
+ * xbzrle_multifd_active: whether multifd channels should XBZRLE pages
+ *
+ * Like the migration thread, start after the first round, once the
+ * cache may hold pages.
+ */
+bool xbzrle_multifd_active(void)
+{
+    return migrate_xbzrle() && ram_state &&
+           qatomic_read(&ram_state->xbzrle_started) &&
+           !migration_in_postcopy();
+}
+
+/**
+ * xbzrle_multifd_encode_page: XBZRLE encode a page from a multifd channel
+ *
+ * Copies the page into @cur, then encodes it against the cached copy
+ * and updates the cache, the same way save_xbzrle_page() does.
+ *
+ * Returns the length of the encoded data in @out, which is 0 when the
+ * page did not change, or -1 when @cur has to be sent as is.
+ *
+ * @block: block that contains the page
+ * @offset: offset inside the block for the page
+ * @cur: buffer of one page for the copy of the page
+ * @out: buffer of one page for the encoded data
+ * @stats: counters for the channel, see xbzrle_multifd_account()
+ */
+int xbzrle_multifd_encode_page(RAMBlock *block, ram_addr_t offset,
+                               uint8_t *cur, uint8_t *out,
+                               XBZRLECacheStats *stats)
+{
+    ram_addr_t addr = block->offset + offset;
+    uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
+    PageCache *cache;
+    uint8_t *prev_cached_page;
+    int encoded_len = -1;
+
+    memcpy(cur, block->host + offset, TARGET_PAGE_SIZE);
+
+    RCU_READ_LOCK_GUARD();
+    cache = qatomic_rcu_read(&XBZRLE.cache);
+    if (!cache) {
+        return -1;
+    }
+
+    cache_lock(cache, addr);
+    if (!cache_is_cached(cache, addr, generation)) {
+        stats->cache_miss++;
+        cache_insert(cache, addr, cur, generation);
+    } else {
+        stats->pages++;
+        prev_cached_page = get_cached_data(cache, addr);
+        /*
+         * One byte short of a page, so that the receiver can tell an
+         * encoded page from a raw one by its length.
+         */
+        encoded_len = xbzrle_encode_buffer(prev_cached_page, cur,
+                                           TARGET_PAGE_SIZE, out,
+                                           TARGET_PAGE_SIZE - 1);
+        if (encoded_len != 0) {
+            memcpy(prev_cached_page, cur, TARGET_PAGE_SIZE);
+        }
+        if (encoded_len == -1) {
+            stats->overflow++;
+            stats->bytes += TARGET_PAGE_SIZE;
+        } else {
+            stats->bytes += encoded_len;
+        }
+    }
+    cache_unlock(cache, addr);
+
+    return encoded_len;
+}
+
+/**
+ * xbzrle_multifd_zero_pages: update the cache for pages sent as zero
+ *
+ * See xbzrle_cache_zero_page().
+ *
+ * @block: block that contains the pages
+ * @offsets: offsets inside the block of the pages
+ * @num: number of pages
+ * @zero_page: a page full of zeros
+ */
+void xbzrle_multifd_zero_pages(RAMBlock *block, ram_addr_t *offsets,
+                               uint32_t num, uint8_t *zero_page)
+{
+    uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
+    PageCache *cache;
+    uint32_t i;
+
+    RCU_READ_LOCK_GUARD();
+    cache = qatomic_rcu_read(&XBZRLE.cache);
+    if (!cache) {
+        return;
+    }
+
+    for (i = 0; i < num; i++) {
+        ram_addr_t addr = block->offset + offsets[i];
+
+        cache_lock(cache, addr);
+        cache_insert(cache, addr, zero_page, generation);
+        cache_unlock(cache, addr);
+    }
+}
+
+/**
+ * xbzrle_multifd_account: add the counters of a multifd channel
+ *
+ * Channels count locally and add their counters once per packet.
+ *
+ * @stats: counters accumulated by xbzrle_multifd_encode_page()
+ */
+void xbzrle_multifd_account(XBZRLECacheStats *stats)
+{
+    qemu_mutex_lock(&XBZRLE.lock);
+    xbzrle_counters.cache_miss += stats->cache_miss;
+    xbzrle_counters.pages += stats->pages;
+    xbzrle_counters.bytes += stats->bytes;
+    xbzrle_counters.overflow += stats->overflow;
+    qemu_mutex_unlock(&XBZRLE.lock);
+}
+
 /**
  * xbzrle_cache_zero_page: insert a zero page in the XBZRLE cache
  *
@@ -570,10 +727,17 @@ void mig_throttle_counter_reset(void)
  */
 static void xbzrle_cache_zero_page(ram_addr_t current_addr)
 {
+    PageCache *cache;
+
+    RCU_READ_LOCK_GUARD();
+    cache = qatomic_rcu_read(&XBZRLE.cache);
+
     /* We don't care if this fails to allocate a new cache page
      * as long as it updated an old one */
-    cache_insert(XBZRLE.cache, current_addr, XBZRLE.zero_target_page,
+    cache_lock(cache, current_addr);
+    cache_insert(cache, current_addr, XBZRLE.zero_target_page,
                  stat64_get(&mig_stats.dirty_sync_count));
+    cache_unlock(cache, current_addr);
 }
 
 #define ENCODING_FLAG_XBZRLE 0x1
@@ -587,30 +751,32 @@ static void xbzrle_cache_zero_page(ram_addr_t current_addr)
  *
  * @rs: current RAM state
  * @pss: current PSS channel
+ * @cache: XBZRLE cache, locked for @current_addr by the caller
  * @current_data: pointer to the address of the page contents
  * @current_addr: addr of the page
  * @block: block that contains the page we want to send
  * @offset: offset inside the block for the page
  */
 static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
-                            uint8_t **current_data, ram_addr_t current_addr,
-                            RAMBlock *block, ram_addr_t offset)
+                            PageCache *cache, uint8_t **current_data,
+                            ram_addr_t current_addr, RAMBlock *block,
+                            ram_addr_t offset)
 {
     int encoded_len = 0, bytes_xbzrle;
     uint8_t *prev_cached_page;
     QEMUFile *file = pss->pss_channel;
     uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
 
-    if (!cache_is_cached(XBZRLE.cache, current_addr, generation)) {
+    if (!cache_is_cached(cache, current_addr, generation)) {
         xbzrle_counters.cache_miss++;
         if (!rs->last_stage) {
-            if (cache_insert(XBZRLE.cache, current_addr, *current_data,
+            if (cache_insert(cache, current_addr, *current_data,
                              generation) == -1) {
                 return -1;
             } else {
                 /* update *current_data when the page has been
                    inserted into cache */
-                *current_data = get_cached_data(XBZRLE.cache, current_addr);
+                *current_data = get_cached_data(cache, current_addr);
             }
         }
         return -1;
@@ -628,7 +794,7 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
      * guest page is good for xbzrle encoding.
      */
     xbzrle_counters.pages++;
-    prev_cached_page = get_cached_data(XBZRLE.cache, current_addr);
+    prev_cached_page = get_cached_data(cache, current_addr);
 
     /* save current buffer into memory */
     memcpy(XBZRLE.current_buf, *current_data, TARGET_PAGE_SIZE);
@@ -680,6 +846,54 @@ static int save_xbzrle_page(RAMState *rs, PageSearchStatus *pss,
     return 1;
 }
 
+/**
+ * ramblock_find_next_dirty: find the next dirty page of a ramblock
+ *
+ * Returns the index of the first dirty page at or after @start, or
+ * @size when there is none.  Regions whose summary bit is clear are
+ * skipped without looking at the bitmap, and the summary bit of a
+ * region found clean is cleared on the way.
+ *
+ * @rb: RAMBlock to search
+ * @size: page to stop the search at
+ * @start: page to start the search from
+ */
+static unsigned long ramblock_find_next_dirty(RAMBlock *rb, unsigned long size,
+                                              unsigned long start)
+{
+    unsigned long pages = rb->used_length >> TARGET_PAGE_BITS;
+    unsigned long regions;
+
+    if (!rb->bmap_summary) {
+        return find_next_bit(rb->bmap, size, start);
+    }
+
+    regions = DIV_ROUND_UP(size, 1UL << RAMBLOCK_BMAP_SUMMARY_SHIFT);
+    while (start < size) {
+        unsigned long region = start >> RAMBLOCK_BMAP_SUMMARY_SHIFT;
+        unsigned long region_start, region_end, page;
+
+        region = find_next_bit(rb->bmap_summary, regions, region);
+        if (region >= regions) {
+            break;
+        }
+        region_start = region << RAMBLOCK_BMAP_SUMMARY_SHIFT;
+        region_end = region_start + (1UL << RAMBLOCK_BMAP_SUMMARY_SHIFT);
+        start = MAX(start, region_start);
+
+        page = find_next_bit(rb->bmap, MIN(region_end, size), start);
+        if (page < MIN(region_end, size)) {
+            return page;
+        }
+        /* Only forget about the region if all of it was looked at */
+        if (start == region_start && size >= MIN(region_end, pages)) {
+            clear_bit(region, rb->bmap_summary);
+        }
+        start = region_end;
+    }
+    return size;
+}
+
 /**
  * pss_find_next_dirty: find the next dirty page of current ramblock
  *
@@ -695,7 +909,6 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
 {
     RAMBlock *rb = pss->block;
     unsigned long size = rb->used_length >> TARGET_PAGE_BITS;
-    unsigned long *bitmap = rb->bmap;
 
     if (migrate_ram_is_ignored(rb)) {
         /* Points directly to the end, so we know no dirty page */
@@ -712,7 +925,7 @@ static void pss_find_next_dirty(PageSearchStatus *pss)
         size = MIN(size, pss->host_page_end);
     }
 
-    pss->page = find_next_bit(bitmap, size, pss->page);
+    pss->page = ramblock_find_next_dirty(rb, size, pss->page);
 }
 
 static void migration_clear_memory_region_dirty_bitmap(RAMBlock *rb,
@@ -904,6 +1117,188 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * Pages of a RAMBlock synced by one job of the bitmap sync threads, a
+ * multiple of BITS_PER_LONG so that jobs never share a bitmap word.
+ */
+#define BITMAP_SYNC_CHUNK_PAGES (1UL << 18)
+
+typedef struct BitmapSyncJob {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} BitmapSyncJob;
+
+/*
+ * Worker threads that split the sync of the dirty bitmap by RAMBlock
+ * range.  Only the migration thread queues jobs, and it waits for all
+ * of them to be done, helping with them in the meantime.
+ */
+typedef struct BitmapSyncThreads {
+    QemuThread *threads;
+    unsigned int num_threads;
+    /* Protects everything below */
+    QemuMutex lock;
+    /* Signalled when jobs are queued, or the threads have to quit */
+    QemuCond work_cond;
+    /* Signalled when all the queued jobs are done */
+    QemuCond done_cond;
+    BitmapSyncJob *jobs;
+    unsigned int num_jobs;
+    unsigned int next_job;
+    unsigned int jobs_done;
+    uint64_t num_dirty;
+    bool quit;
+} BitmapSyncThreads;
+
+static BitmapSyncThreads *bitmap_sync_threads;
+
+/* Called with BitmapSyncThreads.lock held, which is dropped to run a job */
+static void bitmap_sync_run_job(BitmapSyncThreads *st)
+{
+    BitmapSyncJob *job = &st->jobs[st->next_job++];
+    uint64_t num_dirty;
+
+    qemu_mutex_unlock(&st->lock);
+    WITH_RCU_READ_LOCK_GUARD() {
+        num_dirty = cpu_physical_memory_sync_dirty_bitmap(job->block,
+                                                          job->start,
+                                                          job->length);
+    }
+    qemu_mutex_lock(&st->lock);
+
+    st->num_dirty += num_dirty;
+    if (++st->jobs_done == st->num_jobs) {
+        qemu_cond_signal(&st->done_cond);
+    }
+}
+
+static void *bitmap_sync_thread(void *opaque)
+{
+    BitmapSyncThreads *st = opaque;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&st->lock);
+    while (!st->quit) {
+        if (st->next_job < st->num_jobs) {
+            bitmap_sync_run_job(st);
+        } else {
+            qemu_cond_wait(&st->work_cond, &st->lock);
+        }
+    }
+    qemu_mutex_unlock(&st->lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void bitmap_sync_threads_cleanup(void)
+{
+    BitmapSyncThreads *st = bitmap_sync_threads;
+    unsigned int i;
+
+    if (!st) {
+        return;
+    }
+
+    qemu_mutex_lock(&st->lock);
+    st->quit = true;
+    qemu_cond_broadcast(&st->work_cond);
+    qemu_mutex_unlock(&st->lock);
+
+    for (i = 0; i < st->num_threads; i++) {
+        qemu_thread_join(&st->threads[i]);
+    }
+
+    qemu_cond_destroy(&st->done_cond);
+    qemu_cond_destroy(&st->work_cond);
+    qemu_mutex_destroy(&st->lock);
+    g_free(st->threads);
+    g_free(st);
+    bitmap_sync_threads = NULL;
+}
+
+/*
+ * Start the bitmap sync threads, unless the guest is too small for a
+ * sync to be worth splitting.  Called with RCU critical section.
+ */
+static void bitmap_sync_threads_setup(void)
+{
+    unsigned int num_threads = migrate_get_current()->bitmap_sync_threads;
+    BitmapSyncThreads *st;
+    unsigned int i;
+
+    if (!num_threads ||
+        (ram_bytes_total() >> TARGET_PAGE_BITS) < 2 * BITMAP_SYNC_CHUNK_PAGES) {
+        return;
+    }
+
+    st = g_new0(BitmapSyncThreads, 1);
+    qemu_mutex_init(&st->lock);
+    qemu_cond_init(&st->work_cond);
+    qemu_cond_init(&st->done_cond);
+    st->threads = g_new0(QemuThread, num_threads);
+    st->num_threads = num_threads;
+
+    for (i = 0; i < num_threads; i++) {
+        qemu_thread_create(&st->threads[i], "mig/src/bmsync",
+                           bitmap_sync_thread, st, QEMU_THREAD_JOINABLE);
+    }
+    bitmap_sync_threads = st;
+}
+
+/*
+ * Sync the dirty bitmap of all the RAMBlocks with the sync threads.
+ * Called with RCU critical section and RAMState.bitmap_mutex held.
+ */
+static void bitmap_sync_threads_run(RAMState *rs)
+{
+    BitmapSyncThreads *st = bitmap_sync_threads;
+    unsigned int num_jobs = 0;
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        num_jobs += DIV_ROUND_UP(block->used_length >> TARGET_PAGE_BITS,
+                                 BITMAP_SYNC_CHUNK_PAGES);
+    }
+
+    qemu_mutex_lock(&st->lock);
+    st->jobs = g_new(BitmapSyncJob, num_jobs);
+    st->num_jobs = 0;
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t chunk = BITMAP_SYNC_CHUNK_PAGES << TARGET_PAGE_BITS;
+        ram_addr_t start;
+
+        for (start = 0; start < block->used_length; start += chunk) {
+            BitmapSyncJob *job = &st->jobs[st->num_jobs++];
+
+            job->block = block;
+            job->start = start;
+            job->length = MIN(chunk, block->used_length - start);
+        }
+    }
+    st->next_job = 0;
+    st->jobs_done = 0;
+    st->num_dirty = 0;
+    trace_migration_bitmap_sync_threads(st->num_jobs, st->num_threads);
+    qemu_cond_broadcast(&st->work_cond);
+
+    while (st->next_job < st->num_jobs) {
+        bitmap_sync_run_job(st);
+    }
+    while (st->jobs_done < st->num_jobs) {
+        qemu_cond_wait(&st->done_cond, &st->lock);
+    }
+
+    rs->migration_dirty_pages += st->num_dirty;
+    rs->num_dirty_pages_period += st->num_dirty;
+    g_free(st->jobs);
+    st->jobs = NULL;
+    st->num_jobs = 0;
+    qemu_mutex_unlock(&st->lock);
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -927,9 +1322,14 @@ uint64_t ram_pagesize_summary(void)
 
 uint64_t ram_get_total_transferred_pages(void)
 {
-    return stat64_get(&mig_stats.normal_pages) +
-        stat64_get(&mig_stats.zero_pages) +
-        compress_ram_pages() + xbzrle_counters.pages;
+    uint64_t pages = stat64_get(&mig_stats.normal_pages) +
+        stat64_get(&mig_stats.zero_pages) + compress_ram_pages();
+
+    /* multifd already counts the pages it encoded as normal pages */
+    if (!migrate_multifd()) {
+        pages += xbzrle_counters.pages;
+    }
+    return pages;
 }
 
 static void migration_update_rates(RAMState *rs, int64_t end_time)
@@ -947,9 +1347,16 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
 
     if (migrate_xbzrle()) {
         double encoded_size, unencoded_size;
+        uint64_t hits, lookups;
 
+        /* multifd channels may be adding to the counters */
+        XBZRLE_cache_lock();
         xbzrle_counters.cache_miss_rate = (double)(xbzrle_counters.cache_miss -
             rs->xbzrle_cache_miss_prev) / page_count;
+        hits = xbzrle_counters.pages - rs->xbzrle_pages_prev;
+        lookups = hits + xbzrle_counters.cache_miss -
+                  rs->xbzrle_cache_miss_prev;
+        xbzrle_counters.cache_hit_rate = lookups ? (double)hits / lookups : 0;
         rs->xbzrle_cache_miss_prev = xbzrle_counters.cache_miss;
         unencoded_size = (xbzrle_counters.pages - rs->xbzrle_pages_prev) *
                          TARGET_PAGE_SIZE;
@@ -961,6 +1368,7 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
         }
         rs->xbzrle_pages_prev = xbzrle_counters.pages;
         rs->xbzrle_bytes_prev = xbzrle_counters.bytes;
+        XBZRLE_cache_unlock();
     }
     compress_update_rates(page_count);
 }
@@ -968,7 +1376,8 @@ static void migration_update_rates(RAMState *rs, int64_t end_time)
 /*
  * Enable dirty-limit to throttle down the guest
  */
-static void migration_dirty_limit_guest(void)
+static void migration_dirty_limit_guest(RAMState *rs,
+                                        uint64_t bytes_dirty_threshold)
 {
     /*
      * dirty page rate quota for all vCPUs fetched from
@@ -977,6 +1386,22 @@ static void migration_dirty_limit_guest(void)
     static int64_t quota_dirtyrate;
     MigrationState *s = migrate_get_current();
 
+    if (migrate_dirty_limit_adaptive()) {
+        /*
+         * Throttle only the vCPUs that dirty memory the fastest, so that
+         * the guest dirties at most what can be sent in the same time.
+         */
+        uint64_t period = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
+                          rs->time_last_bitmap_sync;
+        uint64_t total_quota = bytes_dirty_threshold * 1000 / period / MiB;
+        int nvcpu;
+
+        nvcpu = dirtylimit_set_total(MAX(total_quota, 1),
+                                     s->parameters.vcpu_dirty_limit);
+        trace_migration_dirty_limit_adaptive(total_quota, nvcpu);
+        return;
+    }
+
     /*
      * If dirty limit already enabled and migration parameter
      * vcpu-dirty-limit untouched.
@@ -1026,7 +1451,7 @@ static void migration_trigger_throttle(RAMState *rs)
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
         } else if (migrate_dirty_limit()) {
-            migration_dirty_limit_guest();
+            migration_dirty_limit_guest(rs, bytes_dirty_threshold);
         }
     }
 }
@@ -1047,8 +1472,12 @@ static void migration_bitmap_sync(RAMState *rs, bool last_stage)
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
+        if (bitmap_sync_threads) {
+            bitmap_sync_threads_run(rs);
+        } else {
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                ramblock_sync_dirty_bitmap(rs, block);
+            }
         }
         stat64_set(&mig_stats.dirty_bytes_last_sync, ram_bytes_remaining());
     }
@@ -1127,6 +1556,13 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
         return 0;
     }
 
+    if (migrate_mapped_ram()) {
+        /* Zero pages are not written, the destination page stays zero */
+        clear_bit_atomic(offset >> TARGET_PAGE_BITS, pss->block->file_bmap);
+        stat64_add(&mig_stats.zero_pages, 1);
+        return 1;
+    }
+
     len += save_page_header(pss, file, pss->block, offset | RAM_SAVE_FLAG_ZERO);
     qemu_put_byte(file, 0);
     len += 1;
@@ -1140,9 +1576,7 @@ static int save_zero_page(RAMState *rs, PageSearchStatus *pss,
      * page would be stale.
      */
     if (rs->xbzrle_started) {
-        XBZRLE_cache_lock();
         xbzrle_cache_zero_page(pss->block->offset + offset);
-        XBZRLE_cache_unlock();
     }
 
     return len;
@@ -1190,6 +1624,15 @@ static int save_normal_page(PageSearchStatus *pss, RAMBlock *block,
 {
     QEMUFile *file = pss->pss_channel;
 
+    if (migrate_mapped_ram()) {
+        qemu_put_buffer_at(file, buf, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset);
+        set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
+        ram_transferred_add(TARGET_PAGE_SIZE);
+        stat64_add(&mig_stats.normal_pages, 1);
+        return 1;
+    }
+
     ram_transferred_add(save_page_header(pss, pss->pss_channel, block,
                                          offset | RAM_SAVE_FLAG_PAGE));
     if (async) {
@@ -1224,13 +1667,16 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
     ram_addr_t current_addr = block->offset + offset;
+    PageCache *cache = NULL;
 
     p = block->host + offset;
     trace_ram_save_page(block->idstr, (uint64_t)offset, p);
 
-    XBZRLE_cache_lock();
     if (rs->xbzrle_started && !migration_in_postcopy()) {
-        pages = save_xbzrle_page(rs, pss, &p, current_addr,
+        cache = qatomic_rcu_read(&XBZRLE.cache);
+        /* Held until the page is sent, as it may be sent from the cache */
+        cache_lock(cache, current_addr);
+        pages = save_xbzrle_page(rs, pss, cache, &p, current_addr,
                                  block, offset);
         if (!rs->last_stage) {
             /* Can't send this cached data async, since the cache page
@@ -1245,7 +1691,9 @@ static int ram_save_page(RAMState *rs, PageSearchStatus *pss)
         pages = save_normal_page(pss, block, offset, p, send_async);
     }
 
-    XBZRLE_cache_unlock();
+    if (cache) {
+        cache_unlock(cache, current_addr);
+    }
 
     return pages;
 }
@@ -1256,7 +1704,10 @@ static int ram_save_multifd_page(QEMUFile *file, RAMBlock *block,
     if (multifd_queue_page(file, block, offset) < 0) {
         return -1;
     }
-    stat64_add(&mig_stats.normal_pages, 1);
+    /* With multifd-zero-page the channel accounts the page once classified */
+    if (!migrate_multifd_zero_page()) {
+        stat64_add(&mig_stats.normal_pages, 1);
+    }
 
     return 1;
 }
@@ -1360,7 +1811,7 @@ static int find_dirty_block(RAMState *rs, PageSearchStatus *pss)
             pss->complete_round = true;
             /* After the first round, enable XBZRLE. */
             if (migrate_xbzrle()) {
-                rs->xbzrle_started = true;
+                qatomic_set(&rs->xbzrle_started, true);
             }
         }
         /* Didn't find anything this time, but try again on the new block */
@@ -1945,18 +2396,26 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
     if (postcopy_preempt_active()) {
         ram_addr_t page_start = start >> TARGET_PAGE_BITS;
         size_t page_size = qemu_ram_pagesize(ramblock);
-        PageSearchStatus *pss = &ram_state->pss[RAM_CHANNEL_POSTCOPY];
+        /*
+         * Spread the requests across the preempt channels by host page, so
+         * that the destination loads them in parallel.  A host page always
+         * goes through the same channel, as it can't be split across them.
+         */
+        int channel = ((ramblock->offset + start) / page_size) %
+                      migrate_get_current()->postcopy_preempt_nr_channels;
+        PageSearchStatus *pss = &rs->pss[RAM_CHANNEL_POSTCOPY + channel];
         int ret = 0;
 
         qemu_mutex_lock(&rs->bitmap_mutex);
 
         pss_init(pss, ramblock, page_start);
         /*
-         * Always use the preempt channel, and make sure it's there.  It's
+         * Always use a preempt channel, and make sure it's there.  It's
          * safe to access without lock, because when rp-thread is running
          * we should be the only one who operates on the qemufile
          */
-        pss->pss_channel = migrate_get_current()->postcopy_qemufile_src;
+        pss->pss_channel =
+            migrate_get_current()->postcopy_qemufile_src[channel];
         assert(pss->pss_channel);
 
         /*
@@ -2046,6 +2505,13 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    /*
+     * Do not use multifd in postcopy as one whole host page should be
+     * placed.  Meanwhile postcopy requires atomic update of pages, so even
+     * if host page size == guest page size the dest guest during run may
+     * still see partially copied pages which is data corruption.
+     */
+    bool use_multifd = migrate_multifd() && !migration_in_postcopy();
     int res;
 
     if (control_save_page(pss, offset, &res)) {
@@ -2056,17 +2522,13 @@ static int ram_save_target_page_legacy(RAMState *rs, PageSearchStatus *pss)
         return 1;
     }
 
-    if (save_zero_page(rs, pss, offset)) {
+    /* The multifd channels look for zero pages themselves if enabled */
+    if ((!use_multifd || !migrate_multifd_zero_page()) &&
+        save_zero_page(rs, pss, offset)) {
         return 1;
     }
 
-    /*
-     * Do not use multifd in postcopy as one whole host page should be
-     * placed.  Meanwhile postcopy requires atomic update of pages, so even
-     * if host page size == guest page size the dest guest during run may
-     * still see partially copied pages which is data corruption.
-     */
-    if (migrate_multifd() && !migration_in_postcopy()) {
+    if (use_multifd) {
         return ram_save_multifd_page(pss->pss_channel, block, offset);
     }
 
@@ -2376,7 +2838,7 @@ static void xbzrle_cleanup(void)
 {
     XBZRLE_cache_lock();
     if (XBZRLE.cache) {
-        cache_fini(XBZRLE.cache);
+        cache_fini_rcu(XBZRLE.cache);
         g_free(XBZRLE.encoded_buf);
         g_free(XBZRLE.current_buf);
         g_free(XBZRLE.zero_target_page);
@@ -2413,8 +2875,13 @@ static void ram_save_cleanup(void *opaque)
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->bmap_summary);
+        block->bmap_summary = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
+    bitmap_sync_threads_cleanup();
     xbzrle_cleanup();
     compress_threads_save_cleanup();
     ram_state_cleanup(rsp);
@@ -2591,6 +3058,7 @@ static void postcopy_chunk_hostpages_pass(MigrationState *ms, RAMBlock *block)
                  * that weren't previously dirty.
                  */
                 rs->migration_dirty_pages += !test_and_set_bit(page, bitmap);
+                ramblock_bmap_summary_set(block, page);
             }
         }
 
@@ -2751,7 +3219,7 @@ static void ram_list_init_bitmaps(void)
 {
     MigrationState *ms = migrate_get_current();
     RAMBlock *block;
-    unsigned long pages;
+    unsigned long pages, regions;
     uint8_t shift;
 
     /* Skip setting bitmap if there is no RAM */
@@ -2780,6 +3248,9 @@ static void ram_list_init_bitmaps(void)
              */
             block->bmap = bitmap_new(pages);
             bitmap_set(block->bmap, 0, pages);
+            regions = DIV_ROUND_UP(pages, 1UL << RAMBLOCK_BMAP_SUMMARY_SHIFT);
+            block->bmap_summary = bitmap_new(regions);
+            bitmap_set(block->bmap_summary, 0, regions);
             block->clear_bmap_shift = shift;
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
         }
@@ -2807,6 +3278,7 @@ static void ram_init_bitmaps(RAMState *rs)
         ram_list_init_bitmaps();
         /* We don't use dirty log with background snapshots */
         if (!migrate_background_snapshot()) {
+            bitmap_sync_threads_setup();
             memory_global_dirty_log_start(GLOBAL_DIRTY_MIGRATION);
             migration_bitmap_sync_precopy(rs, false);
         }
@@ -2917,6 +3389,63 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
     }
 }
 
+/* Write the header of @block and lay out its bitmap and pages in the file */
+static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
+{
+    g_autofree MappedRamHeader *header = NULL;
+    size_t header_size, bitmap_size;
+    long num_pages;
+    off_t block_offset;
+
+    header = g_new0(MappedRamHeader, 1);
+    header_size = sizeof(MappedRamHeader);
+
+    num_pages = block->used_length >> TARGET_PAGE_BITS;
+    bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+
+    block_offset = qemu_get_offset(file);
+    if (block_offset < 0) {
+        qemu_file_set_error(file, -EINVAL);
+        return;
+    }
+
+    /*
+     * Save the file offsets of where the bitmap and the pages should
+     * go as they are written at the end of migration and during the
+     * iterative phase, respectively.
+     */
+    block->bitmap_offset = block_offset + header_size;
+    block->pages_offset = ROUND_UP(block->bitmap_offset + bitmap_size,
+                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+    block->file_bmap = bitmap_new(num_pages);
+
+    header->version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
+    header->page_size = cpu_to_be64(TARGET_PAGE_SIZE);
+    header->bitmap_offset = cpu_to_be64(block->bitmap_offset);
+    header->pages_offset = cpu_to_be64(block->pages_offset);
+
+    qemu_put_buffer(file, (uint8_t *) header, header_size);
+
+    /* prepare offset for next ramblock */
+    qemu_set_offset(file, block->pages_offset + block->used_length, SEEK_SET);
+}
+
+/* Write the bitmaps of pages that have data in a mapped-ram file */
+static void mapped_ram_save_bitmaps(QEMUFile *file)
+{
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+
+    RAMBLOCK_FOREACH_MIGRATABLE(block) {
+        long num_pages = block->used_length >> TARGET_PAGE_BITS;
+        size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+
+        qemu_put_buffer_at(file, (uint8_t *)block->file_bmap, bitmap_size,
+                           block->bitmap_offset);
+    }
+}
+
 /*
  * Each of ram_save_setup, ram_save_iterate and ram_save_complete has
  * long-running RCU critical section.  When rcu-reclaims in the code
@@ -2966,6 +3495,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_mapped_ram()) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -3188,6 +3720,11 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         return ret;
     }
 
+    /* All pages have landed in the file, record which ones */
+    if (migrate_mapped_ram()) {
+        mapped_ram_save_bitmaps(f);
+    }
+
     if (migrate_multifd() && !migrate_multifd_flush_after_each_section()) {
         qemu_put_be64(f, RAM_SAVE_FLAG_MULTIFD_FLUSH);
     }
@@ -3789,6 +4326,189 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+typedef struct MappedRamLoadWorker {
+    QemuThread thread;
+    QIOChannel *ioc;
+    RAMBlock *block;
+    unsigned long *bitmap;
+    /* Range of pages of the block this worker restores */
+    unsigned long start;
+    unsigned long end;
+    Error *err;
+} MappedRamLoadWorker;
+
+static int mapped_ram_pread_all(QIOChannel *ioc, uint8_t *buf, size_t len,
+                                off_t pos, Error **errp)
+{
+    while (len) {
+        ssize_t ret = qio_channel_pread(ioc, (char *)buf, len, pos, errp);
+
+        if (ret < 0) {
+            return -1;
+        }
+        if (ret == 0) {
+            error_setg(errp, "Unexpected end of migration file");
+            return -1;
+        }
+        buf += ret;
+        len -= ret;
+        pos += ret;
+    }
+
+    return 0;
+}
+
+/*
+ * Read every run of pages marked in the bitmap straight into guest
+ * memory.  Pages never written by the source are skipped.
+ */
+static void *mapped_ram_load_worker(void *opaque)
+{
+    MappedRamLoadWorker *w = opaque;
+    unsigned long max_run = MAPPED_RAM_LOAD_RUN_SIZE >> TARGET_PAGE_BITS;
+    unsigned long page = find_next_bit(w->bitmap, w->end, w->start);
+
+    while (page < w->end) {
+        unsigned long run_end = find_next_zero_bit(w->bitmap, w->end, page);
+        ram_addr_t offset = (ram_addr_t)page << TARGET_PAGE_BITS;
+        void *host;
+
+        run_end = MIN(run_end, page + max_run);
+
+        host = host_from_ram_block_offset(w->block, offset);
+        if (!host) {
+            error_setg(&w->err, "Illegal RAM offset " RAM_ADDR_FMT, offset);
+            break;
+        }
+
+        if (mapped_ram_pread_all(w->ioc, host,
+                                 (run_end - page) << TARGET_PAGE_BITS,
+                                 w->block->pages_offset + offset,
+                                 &w->err) < 0) {
+            break;
+        }
+        ramblock_recv_bitmap_set_range(w->block, host, run_end - page);
+
+        page = find_next_bit(w->bitmap, w->end, run_end);
+    }
+
+    return NULL;
+}
+
+static void mapped_ram_load_ramblock(QEMUFile *f, RAMBlock *block,
+                                     unsigned long *bitmap,
+                                     unsigned long num_pages, Error **errp)
+{
+    ERRP_GUARD();
+    unsigned long max_run = MAPPED_RAM_LOAD_RUN_SIZE >> TARGET_PAGE_BITS;
+    int nr_workers = migrate_multifd() ? migrate_multifd_channels() : 1;
+    g_autofree MappedRamLoadWorker *workers = NULL;
+    unsigned long chunk;
+    int i;
+
+    /* Do not spin up threads for blocks smaller than a few reads */
+    nr_workers = MAX(MIN(nr_workers, DIV_ROUND_UP(num_pages, max_run)), 1);
+    chunk = DIV_ROUND_UP(num_pages, nr_workers);
+    workers = g_new0(MappedRamLoadWorker, nr_workers);
+
+    for (i = 0; i < nr_workers; i++) {
+        MappedRamLoadWorker *w = &workers[i];
+
+        w->ioc = qemu_file_get_ioc(f);
+        w->block = block;
+        w->bitmap = bitmap;
+        w->start = i * chunk;
+        w->end = MIN(w->start + chunk, num_pages);
+
+        if (nr_workers == 1) {
+            mapped_ram_load_worker(w);
+        } else {
+            qemu_thread_create(&w->thread, "mapped-ram-load",
+                               mapped_ram_load_worker, w,
+                               QEMU_THREAD_JOINABLE);
+        }
+    }
+
+    for (i = 0; i < nr_workers; i++) {
+        MappedRamLoadWorker *w = &workers[i];
+
+        if (nr_workers > 1) {
+            qemu_thread_join(&w->thread);
+        }
+        if (w->err) {
+            if (*errp) {
+                error_free(w->err);
+            } else {
+                error_propagate(errp, w->err);
+            }
+        }
+    }
+}
+
+static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                      ram_addr_t length, Error **errp)
+{
+    ERRP_GUARD();
+    g_autofree unsigned long *bitmap = NULL;
+    MappedRamHeader header;
+    size_t bitmap_size;
+    long num_pages;
+
+    if (qemu_get_buffer(f, (uint8_t *)&header, sizeof(header)) !=
+        sizeof(header)) {
+        error_setg(errp, "Could not read mapped-ram header of block %s",
+                   block->idstr);
+        return;
+    }
+
+    header.version = be32_to_cpu(header.version);
+    if (header.version > MAPPED_RAM_HDR_VERSION) {
+        error_setg(errp, "Migration mapped-ram capability version not "
+                   "supported (expected <= %d, found %d)",
+                   MAPPED_RAM_HDR_VERSION, header.version);
+        return;
+    }
+
+    header.page_size = be64_to_cpu(header.page_size);
+    if (header.page_size != TARGET_PAGE_SIZE) {
+        error_setg(errp, "Mapped-ram page size mismatch for block %s: "
+                   "%" PRIu64 " != %d", block->idstr, header.page_size,
+                   TARGET_PAGE_SIZE);
+        return;
+    }
+
+    block->bitmap_offset = be64_to_cpu(header.bitmap_offset);
+    block->pages_offset = be64_to_cpu(header.pages_offset);
+
+    if (!QEMU_IS_ALIGNED(block->pages_offset,
+                         MAPPED_RAM_FILE_OFFSET_ALIGNMENT)) {
+        error_setg(errp, "Mapped-ram pages of block %s are at unaligned "
+                   "file offset 0x%" PRIx64, block->idstr,
+                   block->pages_offset);
+        return;
+    }
+
+    num_pages = length >> TARGET_PAGE_BITS;
+    bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+    bitmap = g_malloc0(bitmap_size);
+
+    if (qemu_get_buffer_at(f, (uint8_t *)bitmap, bitmap_size,
+                           block->bitmap_offset) != bitmap_size) {
+        error_setg(errp, "Error reading mapped-ram bitmap of block %s",
+                   block->idstr);
+        return;
+    }
+
+    mapped_ram_load_ramblock(f, block, bitmap, num_pages, errp);
+    if (*errp) {
+        error_prepend(errp, "Error restoring block %s: ", block->idstr);
+        return;
+    }
+
+    /* Skip the pages region to get to the next ramblock header */
+    qemu_set_offset(f, block->pages_offset + length, SEEK_SET);
+}
+
 static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
 {
     int ret = 0;
@@ -3832,6 +4552,15 @@ static int parse_ramblock(QEMUFile *f, RAMBlock *block, ram_addr_t length)
             return -EINVAL;
         }
     }
+    if (migrate_mapped_ram()) {
+        Error *local_err = NULL;
+
+        parse_ramblock_mapped_ram(f, block, length, &local_err);
+        if (local_err) {
+            error_report_err(local_err);
+            return -EINVAL;
+        }
+    }
     ret = rdma_block_notification_handle(f, block->idstr);
     if (ret < 0) {
         qemu_file_set_error(f, ret);
@@ -4179,6 +4908,10 @@ bool ram_dirty_bitmap_reload(MigrationState *s, RAMBlock *block, Error **errp)
      * dirty bitmap for this ramblock.
      */
     bitmap_complement(block->bmap, block->bmap, nbits);
+    if (block->bmap_summary) {
+        bitmap_set(block->bmap_summary, 0,
+                   DIV_ROUND_UP(nbits, 1UL << RAMBLOCK_BMAP_SUMMARY_SHIFT));
+    }
 
     /* Clear dirty bits of discarded ranges that we don't want to migrate. */
     ramblock_dirty_bitmap_clear_discarded_pages(block);
@@ -4217,8 +4950,12 @@ static int ram_resume_prepare(MigrationState *s, void *opaque)
 
 void postcopy_preempt_shutdown_file(MigrationState *s)
 {
-    qemu_put_be64(s->postcopy_qemufile_src, RAM_SAVE_FLAG_EOS);
-    qemu_fflush(s->postcopy_qemufile_src);
+    int i;
+
+    for (i = 0; i < s->postcopy_preempt_nr_channels; i++) {
+        qemu_put_be64(s->postcopy_qemufile_src[i], RAM_SAVE_FLAG_EOS);
+        qemu_fflush(s->postcopy_qemufile_src[i]);
+    }
 }
 
 static SaveVMHandlers savevm_ram_handlers = {
@@ -45,6 +45,13 @@ extern XBZRLECacheStats xbzrle_counters;
         if (!qemu_ram_is_migratable(block)) {} else
 
 int xbzrle_cache_resize(uint64_t new_size, Error **errp);
+bool xbzrle_multifd_active(void);
+int xbzrle_multifd_encode_page(RAMBlock *block, ram_addr_t offset,
+                               uint8_t *cur, uint8_t *out,
+                               XBZRLECacheStats *stats);
+void xbzrle_multifd_zero_pages(RAMBlock *block, ram_addr_t *offsets,
+                               uint32_t num, uint8_t *zero_page);
+void xbzrle_multifd_account(XBZRLECacheStats *stats);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_total(void);
 void mig_throttle_counter_reset(void);
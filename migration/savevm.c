@@ -1531,34 +1531,241 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
     return 0;
 }
 
-int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
-                                                    bool in_postcopy,
-                                                    bool inactivate_disks)
+/*
+ * Maximum number of threads serializing one priority level of device
+ * state with capability 'parallel-device-state'.
+ */
+#define SAVEVM_DEVICE_STATE_THREADS 8
+
+typedef struct SaveDeviceStateJob {
+    SaveStateEntry *se;
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    JSONWriter *vmdesc;
+    int64_t time_us;
+    int ret;
+} SaveDeviceStateJob;
+
+typedef struct SaveDeviceStateBatch {
+    SaveDeviceStateJob *jobs;
+    int num;
+    /* Index of the next job to run, updated atomically */
+    int next;
+} SaveDeviceStateBatch;
+
+static void savevm_add_device_state_time(DeviceStateTimeList **list,
+                                         SaveStateEntry *se, int64_t time_us)
+{
+    DeviceStateTime *t = g_new0(DeviceStateTime, 1);
+
+    t->idstr = g_strdup(se->idstr);
+    t->instance_id = se->instance_id;
+    t->time = time_us;
+
+    while (*list) {
+        list = &(*list)->next;
+    }
+    QAPI_LIST_APPEND(list, t);
+}
+
+static void save_device_state_job_run(SaveDeviceStateJob *job)
+{
+    int64_t start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+    job->ret = vmstate_save(job->f, job->se, job->vmdesc);
+    if (!job->ret) {
+        qemu_fflush(job->f);
+        job->ret = qemu_file_get_error(job->f);
+    }
+
+    job->time_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME) - start_ts;
+    trace_vmstate_downtime_save("non-iterable", job->se->idstr,
+                                job->se->instance_id, job->time_us);
+}
+
+/*
+ * Only VMSDs that declare their hooks safe without the BQL are serialized
+ * by the worker threads.  Everything else, including old style handlers,
+ * is run by the migration thread.
+ */
+static bool save_device_state_job_parallel(SaveDeviceStateJob *job)
+{
+    return job->se->vmsd && job->se->vmsd->parallel_save;
+}
+
+static void *save_device_state_thread(void *opaque)
+{
+    SaveDeviceStateBatch *batch = opaque;
+    int i;
+
+    rcu_register_thread();
+
+    while ((i = qatomic_fetch_inc(&batch->next)) < batch->num) {
+        if (save_device_state_job_parallel(&batch->jobs[i])) {
+            save_device_state_job_run(&batch->jobs[i]);
+        }
+    }
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+/*
+ * Serialize the sections in @entries, which all have the same priority,
+ * into one buffer each, then write the buffers to @f in list order.
+ * Sections whose VMSD sets parallel_save are handed to a pool of threads;
+ * the others are serialized by the migration thread, which keeps the BQL
+ * for the whole batch so the devices cannot change underneath the workers.
+ */
+static int qemu_savevm_state_save_batch(QEMUFile *f, JSONWriter *vmdesc,
+                                        SaveStateEntry **entries, int num)
 {
     MigrationState *ms = migrate_get_current();
-    int64_t start_ts_each, end_ts_each;
-    JSONWriter *vmdesc = ms->vmdesc;
-    int vmdesc_len;
+    SaveDeviceStateBatch batch = {
+        .jobs = g_new0(SaveDeviceStateJob, num),
+        .num = num,
+    };
+    int nr_parallel = 0, nr_threads;
+    QemuThread *threads;
+    SaveDeviceStateJob *job;
+    int i, ret = 0;
+
+    /* Create the channels here, QOM type initialization is not thread safe */
+    for (i = 0; i < num; i++) {
+        job = &batch.jobs[i];
+        job->se = entries[i];
+        job->bioc = qio_channel_buffer_new(4096);
+        qio_channel_set_name(QIO_CHANNEL(job->bioc),
+                             "migration-device-state-buffer");
+        job->f = qemu_file_new_output(QIO_CHANNEL(job->bioc));
+        job->vmdesc = vmdesc ? json_writer_new(false) : NULL;
+        if (save_device_state_job_parallel(job)) {
+            nr_parallel++;
+        }
+    }
+
+    nr_threads = MIN(nr_parallel, SAVEVM_DEVICE_STATE_THREADS);
+    threads = g_new0(QemuThread, nr_threads);
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_create(&threads[i], "mig/src/devstate",
+                           save_device_state_thread, &batch,
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    for (i = 0; i < num; i++) {
+        job = &batch.jobs[i];
+        if (!save_device_state_job_parallel(job)) {
+            save_device_state_job_run(job);
+        }
+    }
+
+    for (i = 0; i < nr_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+
+    for (i = 0; i < num; i++) {
+        job = &batch.jobs[i];
+
+        if (!ret && job->ret) {
+            ret = job->ret;
+        }
+        if (!ret) {
+            qemu_put_buffer(f, job->bioc->data, job->bioc->usage);
+            if (vmdesc && *json_writer_get(job->vmdesc)) {
+                json_writer_raw(vmdesc, NULL, json_writer_get(job->vmdesc));
+            }
+            savevm_add_device_state_time(&ms->device_state_times, job->se,
+                                         job->time_us);
+        }
+
+        json_writer_free(job->vmdesc);
+        qemu_fclose(job->f);
+        object_unref(OBJECT(job->bioc));
+    }
+
+    g_free(threads);
+    g_free(batch.jobs);
+    return ret;
+}
+
+static int qemu_savevm_state_non_iterable_parallel(QEMUFile *f,
+                                                   JSONWriter *vmdesc)
+{
+    g_autofree SaveStateEntry **entries = NULL;
     SaveStateEntry *se;
+    int num = 0;
     int ret;
 
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        num++;
+    }
+    entries = g_new(SaveStateEntry *, num);
+    num = 0;
+
+    /*
+     * The handler list is sorted by priority; a batch must complete
+     * before the sections of the next priority level are saved.
+     */
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (se->vmsd && se->vmsd->early_setup) {
             /* Already saved during qemu_savevm_state_setup(). */
             continue;
         }
 
-        start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        if (num &&
+            save_state_priority(se) != save_state_priority(entries[0])) {
+            ret = qemu_savevm_state_save_batch(f, vmdesc, entries, num);
+            if (ret) {
+                return ret;
+            }
+            num = 0;
+        }
+        entries[num++] = se;
+    }
+
+    if (num) {
+        return qemu_savevm_state_save_batch(f, vmdesc, entries, num);
+    }
+    return 0;
+}
+
+int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
+                                                    bool in_postcopy,
+                                                    bool inactivate_disks)
+{
+    MigrationState *ms = migrate_get_current();
+    int64_t start_ts_each, end_ts_each;
+    JSONWriter *vmdesc = ms->vmdesc;
+    int vmdesc_len;
+    SaveStateEntry *se;
+    int ret;
 
-        ret = vmstate_save(f, se, vmdesc);
+    if (migrate_parallel_device_state()) {
+        ret = qemu_savevm_state_non_iterable_parallel(f, vmdesc);
         if (ret) {
             qemu_file_set_error(f, ret);
             return ret;
         }
+    } else {
+        QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+            if (se->vmsd && se->vmsd->early_setup) {
+                /* Already saved during qemu_savevm_state_setup(). */
+                continue;
+            }
 
-        end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
-        trace_vmstate_downtime_save("non-iterable", se->idstr, se->instance_id,
-                                    end_ts_each - start_ts_each);
+            start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+            ret = vmstate_save(f, se, vmdesc);
+            if (ret) {
+                qemu_file_set_error(f, ret);
+                return ret;
+            }
+
+            end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+            trace_vmstate_downtime_save("non-iterable", se->idstr,
+                                        se->instance_id,
+                                        end_ts_each - start_ts_each);
+        }
     }
 
     if (inactivate_disks) {
@@ -2126,7 +2333,8 @@ static int loadvm_postcopy_handle_listen(MigrationIncomingState *mis)
 
     mis->have_listen_thread = true;
     postcopy_thread_create(mis, &mis->listen_thread, "postcopy/listen",
-                           postcopy_ram_listen_thread, QEMU_THREAD_DETACHED);
+                           postcopy_ram_listen_thread, mis,
+                           QEMU_THREAD_DETACHED);
     trace_loadvm_postcopy_handle_listen("return");
 
     return 0;
@@ -2290,14 +2498,20 @@ static int loadvm_postcopy_handle_resume(MigrationIncomingState *mis)
     qemu_sem_post(&mis->postcopy_pause_sem_fault);
 
     if (migrate_postcopy_preempt()) {
+        unsigned int i;
+
         /*
-         * The preempt channel will be created in async manner, now let's
-         * wait for it and make sure it's created.
+         * The preempt channels will be created in async manner, now let's
+         * wait for them and make sure they're created.
          */
-        qemu_sem_wait(&mis->postcopy_qemufile_dst_done);
-        assert(mis->postcopy_qemufile_dst);
-        /* Kick the fast ram load thread too */
-        qemu_sem_post(&mis->postcopy_pause_sem_fast_load);
+        for (i = 0; i < postcopy_preempt_channels(mis); i++) {
+            qemu_sem_wait(&mis->postcopy_preempt[i].file_done);
+            assert(mis->postcopy_preempt[i].file);
+        }
+        /* Kick the fast ram load threads too */
+        for (i = 0; i < postcopy_preempt_channels(mis); i++) {
+            qemu_sem_post(&mis->postcopy_pause_sem_fast_load);
+        }
     }
 
     return 0;
@@ -2623,6 +2837,10 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
         end_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
         trace_vmstate_downtime_load("non-iterable", se->idstr,
                                     se->instance_id, end_ts - start_ts);
+        if (migrate_parallel_device_state()) {
+            savevm_add_device_state_time(&mis->device_state_times, se,
+                                         end_ts - start_ts);
+        }
     }
 
     if (!check_section_footer(f, se)) {
@@ -2807,17 +3025,22 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
 
     /*
      * NOTE: this must happen before reset the PostcopyTmpPages below,
-     * otherwise it's racy to reset those fields when the fast load thread
-     * can be accessing it in parallel.
+     * otherwise it's racy to reset those fields when the fast load threads
+     * can be accessing them in parallel.
      */
-    if (mis->postcopy_qemufile_dst) {
-        qemu_file_shutdown(mis->postcopy_qemufile_dst);
+    for (i = 0; i < POSTCOPY_PREEMPT_CHANNELS_MAX; i++) {
+        PostcopyPreemptChannel *ch = &mis->postcopy_preempt[i];
+
+        if (!ch->file) {
+            continue;
+        }
+        qemu_file_shutdown(ch->file);
         /* Take the mutex to make sure the fast ram load thread halted */
-        qemu_mutex_lock(&mis->postcopy_prio_thread_mutex);
-        migration_ioc_unregister_yank_from_file(mis->postcopy_qemufile_dst);
-        qemu_fclose(mis->postcopy_qemufile_dst);
-        mis->postcopy_qemufile_dst = NULL;
-        qemu_mutex_unlock(&mis->postcopy_prio_thread_mutex);
+        qemu_mutex_lock(&ch->thread_mutex);
+        migration_ioc_unregister_yank_from_file(ch->file);
+        qemu_fclose(ch->file);
+        ch->file = NULL;
+        qemu_mutex_unlock(&ch->thread_mutex);
     }
 
     /* Current state can be either ACTIVE or RECOVER */
@@ -2858,7 +3081,10 @@ retry:
     while (true) {
         section_type = qemu_get_byte(f);
 
-        ret = qemu_file_get_error_obj_any(f, mis->postcopy_qemufile_dst, NULL);
+        ret = qemu_file_get_error(f);
+        if (!ret) {
+            ret = postcopy_preempt_dst_get_error(mis);
+        }
         if (ret) {
             break;
         }
@@ -2935,6 +3161,9 @@ int qemu_loadvm_state(QEMUFile *f)
         return -EINVAL;
     }
 
+    qapi_free_DeviceStateTimeList(mis->device_state_times);
+    mis->device_state_times = NULL;
+
     ret = qemu_loadvm_state_header(f);
     if (ret) {
         return ret;
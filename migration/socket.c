@@ -35,11 +35,46 @@ struct SocketOutgoingArgs {
     SocketAddress *saddr;
 } outgoing_args;
 
+static void socket_channel_enable_io_uring(QIOChannelSocket *sioc)
+{
+    Error *local_err = NULL;
+
+    if (!migrate_io_uring()) {
+        return;
+    }
+    if (qio_channel_socket_enable_io_uring(sioc, &local_err) < 0) {
+        /* Plain system calls still work */
+        warn_report_err(local_err);
+    }
+}
+
+struct SocketSendChannelData {
+    QIOTaskFunc f;
+    void *data;
+};
+
+static void socket_send_channel_connected(QIOTask *task, gpointer opaque)
+{
+    struct SocketSendChannelData *d = opaque;
+    QIOChannelSocket *sioc = QIO_CHANNEL_SOCKET(qio_task_get_source(task));
+
+    /* The task error is left for the real callback to consume */
+    if (sioc->fd != -1) {
+        socket_channel_enable_io_uring(sioc);
+    }
+    d->f(task, d->data);
+}
+
 void socket_send_channel_create(QIOTaskFunc f, void *data)
 {
     QIOChannelSocket *sioc = qio_channel_socket_new();
+    struct SocketSendChannelData *d = g_new0(struct SocketSendChannelData, 1);
+
+    d->f = f;
+    d->data = data;
     qio_channel_socket_connect_async(sioc, outgoing_args.saddr,
-                                     f, data, NULL, NULL);
+                                     socket_send_channel_connected,
+                                     d, g_free, NULL);
 }
 
 QIOChannel *socket_send_channel_create_sync(Error **errp)
@@ -56,6 +91,7 @@ QIOChannel *socket_send_channel_create_sync(Error **errp)
         object_unref(OBJECT(sioc));
         return NULL;
     }
+    socket_channel_enable_io_uring(sioc);
 
     return QIO_CHANNEL(sioc);
 }
@@ -99,6 +135,7 @@ static void socket_outgoing_migration(QIOTask *task,
     }
 
     trace_migration_socket_outgoing_connected(data->hostname);
+    socket_channel_enable_io_uring(QIO_CHANNEL_SOCKET(sioc));
 
     if (migrate_zero_copy_send() &&
         !qio_channel_has_feature(sioc, QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
@@ -150,6 +187,7 @@ static void socket_accept_incoming_migration(QIONetListener *listener,
     }
 
     qio_channel_set_name(QIO_CHANNEL(cioc), "migration-socket-incoming");
+    socket_channel_enable_io_uring(cioc);
     migration_channel_process_incoming(QIO_CHANNEL(cioc));
 }
 
@@ -175,6 +213,7 @@ void socket_start_incoming_migration(SocketAddress *saddr,
     if (migrate_multifd()) {
         num = migrate_multifd_channels();
     } else if (migrate_postcopy_preempt()) {
+        /* The number of preempt channels is fixed only later */
         num = RAM_CHANNEL_MAX;
     }
 
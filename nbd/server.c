@@ -2046,6 +2046,100 @@ static int coroutine_fn nbd_co_send_chunk_read(NBDClient *client,
     return nbd_co_send_iov(client, iov, 3, errp);
 }
 
+/*
+ * Send a successful reply to the read @request carrying @size bytes at
+ * @offset, either as a data chunk (the final one if @final) or as a simple
+ * reply, depending on the negotiated mode.  The payload is passed from the
+ * image file to the socket by the block layer, without being copied
+ * through userspace.
+ *
+ * Returns -ENOTSUP without having sent anything if the export or the
+ * connection cannot do this, in which case the caller reads the data
+ * itself.  Any other failure may leave a partial reply behind, so it
+ * ends the connection.
+ */
+static int coroutine_fn nbd_co_splice_read(NBDClient *client,
+                                           NBDRequest *request,
+                                           uint64_t offset,
+                                           uint64_t size,
+                                           bool final,
+                                           Error **errp)
+{
+    NBDSimpleReply simple;
+    NBDReply hdr;
+    NBDStructuredReadData chunk;
+    struct iovec iov[3];
+    struct iovec *hdr_iov = iov;
+    unsigned int hdr_niov;
+    QEMUIOVector qiov;
+    uint64_t progress = 0;
+    bool sent = false;
+    int64_t ret;
+
+    assert(size && size <= NBD_MAX_BUFFER_SIZE);
+
+    /* TLS needs to see the data */
+    if (client->ioc != QIO_CHANNEL(client->sioc)) {
+        return -ENOTSUP;
+    }
+
+    if (client->mode >= NBD_MODE_STRUCTURED) {
+        iov[0].iov_base = &hdr;
+        iov[1].iov_base = &chunk;
+        iov[1].iov_len = sizeof(chunk);
+        /* Only used by set_be_chunk() to account for the payload */
+        iov[2].iov_base = NULL;
+        iov[2].iov_len = size;
+        set_be_chunk(client, iov, 3, final ? NBD_REPLY_FLAG_DONE : 0,
+                     NBD_REPLY_TYPE_OFFSET_DATA, request);
+        stq_be_p(&chunk.offset, offset);
+        hdr_niov = 2;
+    } else {
+        set_be_simple_reply(&simple, 0, request->cookie);
+        iov[0].iov_base = &simple;
+        iov[0].iov_len = sizeof(simple);
+        hdr_niov = 1;
+    }
+
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+
+    for (;;) {
+        qemu_iovec_init_external(&qiov, hdr_iov, hdr_niov);
+        ret = blk_co_splice_read(client->exp->common.blk, offset + progress,
+                                 size - progress, client->sioc->fd, &qiov);
+        if (ret < 0) {
+            break;
+        }
+
+        sent |= ret > 0;
+        ret -= iov_discard_front(&hdr_iov, &hdr_niov, ret);
+        progress += ret;
+        if (!hdr_niov && progress == size) {
+            ret = 0;
+            break;
+        }
+
+        /*
+         * The socket is full.  The block layer does not wait for it, so
+         * that no thread pool worker blocks on a slow client.
+         */
+        qio_channel_yield(client->ioc, G_IO_OUT);
+    }
+
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+
+    trace_nbd_co_splice_read(request->cookie, offset, size, ret);
+    if (ret == -ENOTSUP && !sent) {
+        return ret;
+    } else if (ret < 0) {
+        error_setg_errno(errp, -ret, "sending data from file failed");
+        return -EIO;
+    }
+    return 0;
+}
+
 static int coroutine_fn nbd_co_send_chunk_error(NBDClient *client,
                                                 NBDRequest *request,
                                                 uint32_t error,
@@ -2123,14 +2217,20 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
             stl_be_p(&chunk.length, pnum);
             ret = nbd_co_send_iov(client, iov, 2, errp);
         } else {
-            ret = blk_co_pread(exp->common.blk, offset + progress, pnum,
-                               data + progress, 0);
-            if (ret < 0) {
-                error_setg_errno(errp, -ret, "reading from file failed");
-                break;
+            ret = nbd_co_splice_read(client, request, offset + progress,
+                                     pnum, final, errp);
+            if (ret == -ENOTSUP) {
+                ret = blk_co_pread(exp->common.blk, offset + progress, pnum,
+                                   data + progress, 0);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "reading from file failed");
+                    break;
+                }
+                ret = nbd_co_send_chunk_read(client, request,
+                                             offset + progress,
+                                             data + progress, pnum, final,
+                                             errp);
             }
-            ret = nbd_co_send_chunk_read(client, request, offset + progress,
-                                         data + progress, pnum, final, errp);
         }
 
         if (ret < 0) {
@@ -2750,6 +2850,14 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
                                        data, request->len, errp);
     }
 
+    if (request->len) {
+        ret = nbd_co_splice_read(client, request, request->from,
+                                 request->len, true, errp);
+        if (ret != -ENOTSUP) {
+            return ret;
+        }
+    }
+
     ret = blk_co_pread(exp->common.blk, request->from, request->len, data, 0);
     if (ret < 0) {
         return nbd_send_generic_reply(client, request, ret,
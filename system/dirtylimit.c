@@ -444,6 +444,104 @@ static void dirtylimit_cleanup(void)
     dirtylimit_state_finalize();
 }
 
+/*
+ * Dirty page rate a vCPU could reach: the measured one, or its quota if
+ * it is limited, since the limit keeps its rate below the quota.
+ */
+static uint64_t dirtylimit_vcpu_demand(int cpu_index)
+{
+    VcpuDirtyLimitState *state = dirtylimit_vcpu_get_state(cpu_index);
+    uint64_t rate = vcpu_dirty_rate_get(cpu_index);
+
+    return state->enabled ? MAX(rate, state->quota) : rate;
+}
+
+static int dirtylimit_rate_cmp(const void *a, const void *b)
+{
+    uint64_t rate_a = *(const uint64_t *)a;
+    uint64_t rate_b = *(const uint64_t *)b;
+
+    return rate_a < rate_b ? -1 : rate_a > rate_b;
+}
+
+/*
+ * Keep the sum of the vCPU dirty page rates within @total_quota MB/s,
+ * limiting only the vCPUs that dirty memory the fastest.  They all get
+ * the same quota, the largest one that lets every slower vCPU keep its
+ * current rate, but never less than @min_quota.  Limits are only ever
+ * tightened, until they are cancelled altogether.
+ *
+ * The per-vCPU dirty page rates are not known until dirty limit is in
+ * service, so the first call only starts measuring them.
+ *
+ * Returns the number of vCPUs that are limited.
+ */
+int dirtylimit_set_total(uint64_t total_quota, uint64_t min_quota)
+{
+    g_autofree uint64_t *rates = NULL;
+    uint64_t budget = total_quota;
+    uint64_t quota = 0;
+    CPUState *cpu;
+    int nvcpu = 0;
+    int limited_nvcpu;
+    int i;
+
+    dirtylimit_state_lock();
+
+    if (!dirtylimit_in_service()) {
+        dirtylimit_init();
+        dirtylimit_state_unlock();
+        return 0;
+    }
+
+    rates = g_new(uint64_t, dirtylimit_state->max_cpus);
+    CPU_FOREACH(cpu) {
+        rates[nvcpu++] = dirtylimit_vcpu_demand(cpu->cpu_index);
+    }
+    qsort(rates, nvcpu, sizeof(*rates), dirtylimit_rate_cmp);
+
+    /* Find the quota for which the sum of the capped rates fits */
+    for (i = 0; i < nvcpu; i++) {
+        if (rates[i] * (nvcpu - i) > budget) {
+            quota = MAX(budget / (nvcpu - i), min_quota);
+            break;
+        }
+        budget -= rates[i];
+    }
+
+    if (quota) {
+        CPU_FOREACH(cpu) {
+            VcpuDirtyLimitState *state =
+                dirtylimit_vcpu_get_state(cpu->cpu_index);
+
+            if (dirtylimit_vcpu_demand(cpu->cpu_index) > quota &&
+                (!state->enabled || state->quota > quota)) {
+                dirtylimit_set_vcpu(cpu->cpu_index, quota, true);
+            }
+        }
+    }
+
+    limited_nvcpu = dirtylimit_state->limited_nvcpu;
+    trace_dirtylimit_set_total(total_quota, quota, limited_nvcpu);
+    dirtylimit_state_unlock();
+
+    return limited_nvcpu;
+}
+
+/* Return the number of vCPUs under dirty limit */
+int dirtylimit_limited_nvcpu(void)
+{
+    int limited_nvcpu = 0;
+
+    dirtylimit_state_lock();
+    if (dirtylimit_in_service()) {
+        limited_nvcpu = dirtylimit_state->limited_nvcpu;
+    }
+    dirtylimit_state_unlock();
+
+    return limited_nvcpu;
+}
+
 /*
  * dirty page rate limit is not allowed to set if migration
  * is running with dirty-limit capability enabled.
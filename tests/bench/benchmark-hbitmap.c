@@ -0,0 +1,174 @@
+/*
+ * Hierarchical bitmap speed benchmark
+ *
+ * Times the operations an incremental backup does on its dirty bitmap:
+ * looking for dirty areas and clean bits, merging one bitmap into
+ * another and (de)serializing it, on bitmaps with dense and sparse
+ * dirtiness.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/hbitmap.h"
+
+/* Bits in each bitmap: a 1 TiB disk tracked at 64 KiB granularity */
+#define BENCH_BITS      (16 * MiB)
+#define BENCH_ROUNDS    16
+
+typedef struct BenchOpts {
+    const char *name;
+    /* one dirty run of @run bits every @stride bits */
+    uint64_t stride;
+    uint64_t run;
+} BenchOpts;
+
+static HBitmap *bench_bitmap_new(const BenchOpts *opts)
+{
+    HBitmap *hb = hbitmap_alloc(BENCH_BITS, 0);
+    uint64_t i;
+
+    for (i = 0; i < BENCH_BITS; i += opts->stride) {
+        hbitmap_set(hb, i, MIN(opts->run, BENCH_BITS - i));
+    }
+    return hb;
+}
+
+static void bench_report(const char *op, const BenchOpts *opts)
+{
+    g_test_message("hbitmap %s(%s): %.2f Gbit/sec", op, opts->name,
+                   (double)BENCH_BITS * BENCH_ROUNDS / 1e9 /
+                   g_test_timer_last());
+}
+
+static void test_next_dirty_area_speed(const void *opaque)
+{
+    const BenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    int64_t start, count;
+    uint64_t found = 0;
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = 0;
+        while (hbitmap_next_dirty_area(hb, start, BENCH_BITS, INT64_MAX,
+                                       &start, &count)) {
+            found += count;
+            start += count;
+        }
+    }
+    g_test_timer_elapsed();
+    g_assert(found == hbitmap_count(hb) * BENCH_ROUNDS);
+    bench_report("next_dirty_area", opts);
+
+    hbitmap_free(hb);
+}
+
+static void test_next_zero_speed(const void *opaque)
+{
+    const BenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    int64_t start, next;
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        start = 0;
+        while (start < BENCH_BITS) {
+            next = hbitmap_next_zero(hb, start, BENCH_BITS - start);
+            if (next < 0) {
+                break;
+            }
+            next = hbitmap_next_dirty(hb, next, BENCH_BITS - next);
+            if (next < 0) {
+                break;
+            }
+            start = next;
+        }
+    }
+    g_test_timer_elapsed();
+    bench_report("next_zero", opts);
+
+    hbitmap_free(hb);
+}
+
+static void test_merge_speed(const void *opaque)
+{
+    const BenchOpts *opts = opaque;
+    HBitmap *src = bench_bitmap_new(opts);
+    HBitmap *dst = hbitmap_alloc(BENCH_BITS, 0);
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        hbitmap_merge(dst, src, dst);
+    }
+    g_test_timer_elapsed();
+    g_assert(hbitmap_count(dst) == hbitmap_count(src));
+    bench_report("merge", opts);
+
+    hbitmap_free(src);
+    hbitmap_free(dst);
+}
+
+static void test_serialize_speed(const void *opaque)
+{
+    const BenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    HBitmap *copy = hbitmap_alloc(BENCH_BITS, 0);
+    uint64_t size = hbitmap_serialization_size(hb, 0, BENCH_BITS);
+    g_autofree uint8_t *buf = g_malloc(size);
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < BENCH_ROUNDS; i++) {
+        hbitmap_serialize_part(hb, buf, 0, BENCH_BITS);
+        hbitmap_deserialize_part(copy, buf, 0, BENCH_BITS, true);
+    }
+    g_test_timer_elapsed();
+    g_assert(hbitmap_count(copy) == hbitmap_count(hb));
+    bench_report("serialize", opts);
+
+    hbitmap_free(hb);
+    hbitmap_free(copy);
+}
+
+int main(int argc, char **argv)
+{
+    static const BenchOpts opts[] = {
+        { .name = "sparse", .stride = 64 * KiB + 1, .run = 1 },
+        { .name = "scattered", .stride = 97, .run = 3 },
+        { .name = "dense", .stride = 4 * KiB, .run = 4 * KiB - 5 },
+        { .name = "full", .stride = BENCH_BITS, .run = BENCH_BITS },
+    };
+    char *name;
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(opts); i++) {
+        name = g_strdup_printf("/hbitmap/benchmark/next_dirty_area/%s",
+                               opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_next_dirty_area_speed);
+        g_free(name);
+
+        name = g_strdup_printf("/hbitmap/benchmark/next_zero/%s",
+                               opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_next_zero_speed);
+        g_free(name);
+
+        name = g_strdup_printf("/hbitmap/benchmark/merge/%s", opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_merge_speed);
+        g_free(name);
+
+        name = g_strdup_printf("/hbitmap/benchmark/serialize/%s",
+                               opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_serialize_speed);
+        g_free(name);
+    }
+
+    return g_test_run();
+}
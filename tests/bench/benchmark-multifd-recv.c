@@ -0,0 +1,214 @@
+/*
+ * Multifd receive speed benchmark
+ *
+ * Streams multifd-like packets over loopback TCP connections, one per
+ * channel, and reads them back the way the migration destination does:
+ * a packet header holding the page offsets, then the pages themselves
+ * straight into a buffer standing for guest RAM.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/thread.h"
+#include "qemu/module.h"
+#include "qemu/sockets.h"
+#include "qapi/error.h"
+#include "io/channel-socket.h"
+
+#define BENCH_PAGE_SIZE         4096
+#define BENCH_PAGES_PER_PACKET  128
+/* Guest RAM received into by each channel */
+#define BENCH_RAM_PAGES         (64 * MiB / BENCH_PAGE_SIZE)
+/* Data sent through each channel */
+#define BENCH_CHANNEL_BYTES     (1 * GiB)
+
+typedef struct BenchPacket {
+    uint32_t magic;
+    uint32_t pages;
+    uint64_t offset[BENCH_PAGES_PER_PACKET];
+} BenchPacket;
+
+typedef struct BenchOpts {
+    int channels;
+    int flags;
+} BenchOpts;
+
+typedef struct BenchChannel {
+    QIOChannel *src;
+    QIOChannel *dst;
+    QemuThread send_thread;
+    QemuThread recv_thread;
+    uint8_t *ram;
+    int flags;
+} BenchChannel;
+
+static void *bench_send_thread(void *opaque)
+{
+    BenchChannel *c = opaque;
+    g_autofree uint8_t *pages = g_malloc(BENCH_PAGES_PER_PACKET *
+                                         BENCH_PAGE_SIZE);
+    struct iovec iov[BENCH_PAGES_PER_PACKET + 1];
+    BenchPacket packet = {
+        .magic = 0x11223344,
+        .pages = BENCH_PAGES_PER_PACKET,
+    };
+    size_t sent = 0;
+    uint64_t page = 0;
+    int i;
+
+    memset(pages, 0x5a, BENCH_PAGES_PER_PACKET * BENCH_PAGE_SIZE);
+    iov[0].iov_base = &packet;
+    iov[0].iov_len = sizeof(packet);
+    for (i = 0; i < BENCH_PAGES_PER_PACKET; i++) {
+        iov[i + 1].iov_base = pages + i * BENCH_PAGE_SIZE;
+        iov[i + 1].iov_len = BENCH_PAGE_SIZE;
+    }
+
+    while (sent < BENCH_CHANNEL_BYTES) {
+        /* Scatter the pages over guest RAM, as dirty pages would be */
+        for (i = 0; i < BENCH_PAGES_PER_PACKET; i++) {
+            page = (page + 7919) % BENCH_RAM_PAGES;
+            packet.offset[i] = page * BENCH_PAGE_SIZE;
+        }
+        qio_channel_writev_all(c->src, iov, G_N_ELEMENTS(iov), &error_abort);
+        sent += BENCH_PAGES_PER_PACKET * BENCH_PAGE_SIZE;
+    }
+    return NULL;
+}
+
+static void *bench_recv_thread(void *opaque)
+{
+    BenchChannel *c = opaque;
+    struct iovec iov[BENCH_PAGES_PER_PACKET];
+    BenchPacket packet;
+    struct iovec packet_iov = {
+        .iov_base = &packet,
+        .iov_len = sizeof(packet),
+    };
+    size_t received = 0;
+    int i;
+
+    while (received < BENCH_CHANNEL_BYTES) {
+        qio_channel_readv_full_all(c->dst, &packet_iov, 1, NULL, NULL,
+                                   c->flags, &error_abort);
+        g_assert(packet.magic == 0x11223344);
+        for (i = 0; i < packet.pages; i++) {
+            iov[i].iov_base = c->ram + packet.offset[i];
+            iov[i].iov_len = BENCH_PAGE_SIZE;
+        }
+        qio_channel_readv_full_all(c->dst, iov, packet.pages, NULL, NULL,
+                                   c->flags, &error_abort);
+        received += packet.pages * BENCH_PAGE_SIZE;
+    }
+    return NULL;
+}
+
+static void bench_channel_setup(BenchChannel *c, int flags)
+{
+    QIOChannelSocket *lioc = qio_channel_socket_new();
+    SocketAddress *laddr;
+    SocketAddress addr = {
+        .type = SOCKET_ADDRESS_TYPE_INET,
+        .u.inet = {
+            .host = (char *)"127.0.0.1",
+            .port = (char *)"0",
+        },
+    };
+
+    qio_channel_socket_listen_sync(lioc, &addr, 1, &error_abort);
+    laddr = qio_channel_socket_get_local_address(lioc, &error_abort);
+
+    c->src = QIO_CHANNEL(qio_channel_socket_new());
+    qio_channel_socket_connect_sync(QIO_CHANNEL_SOCKET(c->src), laddr,
+                                    &error_abort);
+    qio_channel_set_delay(c->src, false);
+    qio_channel_set_blocking(c->src, true, &error_abort);
+
+    qio_channel_wait(QIO_CHANNEL(lioc), G_IO_IN);
+    c->dst = QIO_CHANNEL(qio_channel_socket_accept(lioc, &error_abort));
+    g_assert(c->dst);
+    qio_channel_set_blocking(c->dst, true, &error_abort);
+
+    c->ram = g_malloc0((size_t)BENCH_RAM_PAGES * BENCH_PAGE_SIZE);
+    c->flags = flags;
+
+    qapi_free_SocketAddress(laddr);
+    object_unref(OBJECT(lioc));
+}
+
+static void bench_channel_cleanup(BenchChannel *c)
+{
+    object_unref(OBJECT(c->src));
+    object_unref(OBJECT(c->dst));
+    g_free(c->ram);
+}
+
+static void test_multifd_recv_speed(const void *opaque)
+{
+    const BenchOpts *opts = opaque;
+    g_autofree BenchChannel *c = g_new0(BenchChannel, opts->channels);
+    double total = (double)BENCH_CHANNEL_BYTES * opts->channels;
+    int i;
+
+    for (i = 0; i < opts->channels; i++) {
+        bench_channel_setup(&c[i], opts->flags);
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < opts->channels; i++) {
+        qemu_thread_create(&c[i].recv_thread, "bench-recv",
+                           bench_recv_thread, &c[i], QEMU_THREAD_JOINABLE);
+        qemu_thread_create(&c[i].send_thread, "bench-send",
+                           bench_send_thread, &c[i], QEMU_THREAD_JOINABLE);
+    }
+    for (i = 0; i < opts->channels; i++) {
+        qemu_thread_join(&c[i].send_thread);
+        qemu_thread_join(&c[i].recv_thread);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("multifd recv(%s): %d channels %.2f MB/sec, "
+                   "%.2f MB/sec per channel",
+                   opts->flags & QIO_CHANNEL_READ_FLAG_WAITALL ?
+                   "waitall" : "default", opts->channels,
+                   total / MiB / g_test_timer_last(),
+                   total / MiB / g_test_timer_last() / opts->channels);
+
+    for (i = 0; i < opts->channels; i++) {
+        bench_channel_cleanup(&c[i]);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char name[64];
+
+    g_test_init(&argc, &argv, NULL);
+    module_call_init(MODULE_INIT_QOM);
+    socket_init();
+
+#define TEST_ONE(n, f, fname)                                   \
+    BenchOpts opts ## n ## fname = {                            \
+        .channels = n, .flags = f,                              \
+    };                                                          \
+    memset(name, 0, sizeof(name));                              \
+    snprintf(name, sizeof(name),                                \
+             "/migration/benchmark/multifd-recv/%s/channels-%d",\
+             #fname, n);                                        \
+    g_test_add_data_func(name, &opts ## n ## fname,             \
+                         test_multifd_recv_speed);
+
+    TEST_ONE(1, 0, default);
+    TEST_ONE(1, QIO_CHANNEL_READ_FLAG_WAITALL, waitall);
+    TEST_ONE(2, 0, default);
+    TEST_ONE(2, QIO_CHANNEL_READ_FLAG_WAITALL, waitall);
+    TEST_ONE(4, 0, default);
+    TEST_ONE(4, QIO_CHANNEL_READ_FLAG_WAITALL, waitall);
+    TEST_ONE(8, 0, default);
+    TEST_ONE(8, QIO_CHANNEL_READ_FLAG_WAITALL, waitall);
+
+    return g_test_run();
+}
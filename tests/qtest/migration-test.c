@@ -728,6 +728,8 @@ typedef struct {
     /* Postcopy specific fields */
     void *postcopy_data;
     bool postcopy_preempt;
+    /* Number of preempt channels, zero keeps the default */
+    unsigned postcopy_preempt_channels;
     bool postcopy_recovery_test_fail;
 } MigrateCommon;
 
@@ -1306,6 +1308,13 @@ static int migrate_postcopy_prepare(QTestState **from_ptr,
         migrate_set_capability(to, "postcopy-preempt", true);
     }
 
+    if (args->postcopy_preempt_channels) {
+        migrate_set_parameter_int(from, "postcopy-preempt-channels",
+                                  args->postcopy_preempt_channels);
+        migrate_set_parameter_int(to, "postcopy-preempt-channels",
+                                  args->postcopy_preempt_channels);
+    }
+
     migrate_ensure_non_converge(from);
 
     migrate_prepare_for_dirty_mem(from);
@@ -1387,6 +1396,16 @@ static void test_postcopy_preempt(void)
     test_postcopy_common(&args);
 }
 
+static void test_postcopy_preempt_multi(void)
+{
+    MigrateCommon args = {
+        .postcopy_preempt = true,
+        .postcopy_preempt_channels = 4,
+    };
+
+    test_postcopy_common(&args);
+}
+
 #ifdef CONFIG_GNUTLS
 static void test_postcopy_tls_psk(void)
 {
@@ -1601,6 +1620,16 @@ static void test_postcopy_preempt_recovery(void)
     test_postcopy_recovery_common(&args);
 }
 
+static void test_postcopy_preempt_multi_recovery(void)
+{
+    MigrateCommon args = {
+        .postcopy_preempt = true,
+        .postcopy_preempt_channels = 4,
+    };
+
+    test_postcopy_recovery_common(&args);
+}
+
 #ifdef CONFIG_GNUTLS
 /* This contains preempt+recovery+tls test altogether */
 static void test_postcopy_preempt_all(void)
@@ -1876,6 +1905,43 @@ static void test_precopy_unix_plain(void)
 }
 
 
+static void *
+test_migrate_parallel_device_state_start(QTestState *from, QTestState *to)
+{
+    migrate_set_capability(from, "parallel-device-state", true);
+    migrate_set_capability(to, "parallel-device-state", true);
+
+    return NULL;
+}
+
+static void
+test_migrate_parallel_device_state_finish(QTestState *from, QTestState *to,
+                                          void *opaque)
+{
+    QDict *rsp_return;
+
+    rsp_return = migrate_query(from);
+    g_assert(qdict_haskey(rsp_return, "device-state-times"));
+    qobject_unref(rsp_return);
+
+    rsp_return = migrate_query(to);
+    g_assert(qdict_haskey(rsp_return, "device-state-times"));
+    qobject_unref(rsp_return);
+}
+
+static void test_precopy_unix_parallel_device_state(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    MigrateCommon args = {
+        .listen_uri = uri,
+        .connect_uri = uri,
+        .start_hook = test_migrate_parallel_device_state_start,
+        .finish_hook = test_migrate_parallel_device_state_finish,
+    };
+
+    test_precopy_common(&args);
+}
+
 static void test_precopy_unix_dirty_ring(void)
 {
     g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
@@ -2124,6 +2190,54 @@ static void test_precopy_file_offset_bad(void)
     test_file_common(&args, false);
 }
 
+static void *migrate_mapped_ram_start(QTestState *from, QTestState *to)
+{
+    migrate_set_capability(from, "mapped-ram", true);
+    migrate_set_capability(to, "mapped-ram", true);
+
+    return NULL;
+}
+
+static void test_precopy_file_mapped_ram(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_mapped_ram_start,
+    };
+
+    test_file_common(&args, false);
+}
+
+static void *migrate_multifd_mapped_ram_start(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_mapped_ram_start(from, to);
+
+    migrate_set_parameter_int(from, "multifd-channels", 4);
+    migrate_set_parameter_int(to, "multifd-channels", 4);
+
+    migrate_set_capability(from, "multifd", true);
+    migrate_set_capability(to, "multifd", true);
+
+    return NULL;
+}
+
+static void test_multifd_file_mapped_ram(void)
+{
+    g_autofree char *uri = g_strdup_printf("file:%s/%s", tmpfs,
+                                           FILE_TEST_FILENAME);
+    MigrateCommon args = {
+        .connect_uri = uri,
+        .listen_uri = "defer",
+        .start_hook = migrate_multifd_mapped_ram_start,
+    };
+
+    test_file_common(&args, false);
+}
+
 static void *test_mode_reboot_start(QTestState *from, QTestState *to)
 {
     migrate_set_parameter_str(from, "mode", "cpr-reboot");
@@ -2556,6 +2670,38 @@ test_migrate_precopy_tcp_multifd_start(QTestState *from,
     return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
 }
 
+static void *
+test_migrate_precopy_tcp_multifd_zero_page_start(QTestState *from,
+                                                 QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-channels", 16);
+    migrate_set_parameter_int(to, "multifd-channels", 16);
+
+    migrate_set_capability(from, "multifd", true);
+    migrate_set_capability(to, "multifd", true);
+    migrate_set_capability(from, "multifd-zero-page", true);
+    migrate_set_capability(to, "multifd-zero-page", true);
+
+    /* Start incoming migration from the 1st socket */
+    migrate_incoming_qmp(to, "tcp:127.0.0.1:0", "{}");
+
+    return NULL;
+}
+
+static void *
+test_migrate_precopy_tcp_multifd_xbzrle_start(QTestState *from,
+                                              QTestState *to)
+{
+    migrate_set_parameter_int(from, "xbzrle-cache-size", 33554432);
+
+    migrate_set_capability(from, "xbzrle", true);
+    migrate_set_capability(to, "xbzrle", true);
+    migrate_set_capability(from, "multifd-zero-page", true);
+    migrate_set_capability(to, "multifd-zero-page", true);
+
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
+}
+
 static void *
 test_migrate_precopy_tcp_multifd_zlib_start(QTestState *from,
                                             QTestState *to)
@@ -2572,6 +2718,27 @@ test_migrate_precopy_tcp_multifd_zstd_start(QTestState *from,
 }
 #endif /* CONFIG_ZSTD */
 
+#ifdef CONFIG_LZ4
+static void *
+test_migrate_precopy_tcp_multifd_lz4_start(QTestState *from,
+                                           QTestState *to)
+{
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "lz4");
+}
+#endif /* CONFIG_LZ4 */
+
+#ifdef CONFIG_LINUX_IO_URING
+static void *
+test_migrate_precopy_tcp_multifd_io_uring_start(QTestState *from,
+                                                QTestState *to)
+{
+    migrate_set_capability(from, "io-uring", true);
+    migrate_set_capability(to, "io-uring", true);
+
+    return test_migrate_precopy_tcp_multifd_start_common(from, to, "none");
+}
+#endif /* CONFIG_LINUX_IO_URING */
+
 static void test_multifd_tcp_none(void)
 {
     MigrateCommon args = {
@@ -2587,6 +2754,27 @@ static void test_multifd_tcp_none(void)
     test_precopy_common(&args);
 }
 
+static void test_multifd_tcp_zero_page(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_zero_page_start,
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
+static void test_multifd_tcp_xbzrle(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_xbzrle_start,
+        .iterations = 2,
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+
 static void test_multifd_tcp_zlib(void)
 {
     MigrateCommon args = {
@@ -2607,6 +2795,30 @@ static void test_multifd_tcp_zstd(void)
 }
 #endif
 
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_lz4_start,
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+#endif
+
+#ifdef CONFIG_LINUX_IO_URING
+static void test_multifd_tcp_io_uring(void)
+{
+    MigrateCommon args = {
+        .listen_uri = "defer",
+        .start_hook = test_migrate_precopy_tcp_multifd_io_uring_start,
+        .live = true,
+    };
+    test_precopy_common(&args);
+}
+#endif
+
 #ifdef CONFIG_GNUTLS
 static void *
 test_migrate_multifd_tcp_tls_psk_start_match(QTestState *from,
@@ -3251,6 +3463,75 @@ static void test_migrate_dirty_limit(void)
     test_migrate_end(from, to, true);
 }
 
+static int64_t read_convergence_property_int(QTestState *who,
+                                             const char *property)
+{
+    QDict *rsp_return, *rsp_conv;
+    int64_t result = 0;
+
+    rsp_return = migrate_query_not_failed(who);
+    if (qdict_haskey(rsp_return, "convergence")) {
+        rsp_conv = qdict_get_qdict(rsp_return, "convergence");
+        result = qdict_get_try_int(rsp_conv, property, 0);
+    }
+    qobject_unref(rsp_return);
+    return result;
+}
+
+/*
+ * Same as test_migrate_dirty_limit(), with the vCPU limits chosen from
+ * their dirty page rates: wait for a vCPU to be throttled, check the
+ * prediction reported by query-migrate, then let the migration converge.
+ */
+static void test_migrate_dirty_limit_adaptive(void)
+{
+    g_autofree char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    QTestState *from, *to;
+    int64_t throttled_vcpus = 0;
+    MigrateCommon args = {
+        .start = {
+            .hide_stderr = true,
+            .use_dirty_ring = true,
+        },
+        .listen_uri = uri,
+        .connect_uri = uri,
+    };
+
+    if (test_migrate_start(&from, &to, args.listen_uri, &args.start)) {
+        return;
+    }
+
+    /* dirty-limit-adaptive requires dirty-limit to be enabled first */
+    migrate_dirty_limit_wait_showup(from, 1000, 1);
+    migrate_set_capability(from, "dirty-limit-adaptive", true);
+
+    migrate_qmp(from, uri, "{}");
+
+    /* Wait for the first vCPU to be throttled */
+    while (throttled_vcpus == 0) {
+        throttled_vcpus =
+            read_convergence_property_int(from, "throttled-vcpus");
+        usleep(1000 * 100);
+        g_assert_false(got_src_stop);
+    }
+    g_assert_cmpint(read_convergence_property_int(from, "bandwidth"), >, 0);
+    g_assert_cmpint(get_limit_rate(from), >=, 1);
+
+    /* Let it converge */
+    migrate_set_parameter_int(from, "downtime-limit", 250);
+    migrate_set_parameter_int(from, "max-bandwidth", 400000000);
+
+    wait_for_migration_status(from, "pre-switchover", NULL);
+    migrate_continue(from, "pre-switchover");
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+    wait_for_migration_complete(from);
+
+    test_migrate_end(from, to, true);
+}
+
 static bool kvm_dirty_ring_supported(void)
 {
 #if defined(__linux__) && defined(HOST_X86_64)
@@ -3345,6 +3626,10 @@ int main(int argc, char **argv)
         qtest_add_func("/migration/postcopy/preempt/plain", test_postcopy_preempt);
         qtest_add_func("/migration/postcopy/preempt/recovery/plain",
                        test_postcopy_preempt_recovery);
+        qtest_add_func("/migration/postcopy/preempt/multi/plain",
+                       test_postcopy_preempt_multi);
+        qtest_add_func("/migration/postcopy/preempt/multi/recovery/plain",
+                       test_postcopy_preempt_multi_recovery);
         if (getenv("QEMU_TEST_FLAKY_TESTS")) {
             qtest_add_func("/migration/postcopy/compress/plain",
                            test_postcopy_compress);
@@ -3365,6 +3650,8 @@ int main(int argc, char **argv)
     }
 #endif
     qtest_add_func("/migration/precopy/unix/plain", test_precopy_unix_plain);
+    qtest_add_func("/migration/precopy/unix/parallel-device-state",
+                   test_precopy_unix_parallel_device_state);
     qtest_add_func("/migration/precopy/unix/xbzrle", test_precopy_unix_xbzrle);
     /*
      * Compression fails from time to time.
@@ -3383,6 +3670,10 @@ int main(int argc, char **argv)
                    test_precopy_file_offset);
     qtest_add_func("/migration/precopy/file/offset/bad",
                    test_precopy_file_offset_bad);
+    qtest_add_func("/migration/precopy/file/mapped-ram",
+                   test_precopy_file_mapped_ram);
+    qtest_add_func("/migration/multifd/file/mapped-ram",
+                   test_multifd_file_mapped_ram);
 
     /*
      * Our CI system has problems with shared memory.
@@ -3464,6 +3755,8 @@ int main(int argc, char **argv)
         if (g_str_equal(arch, "x86_64") &&
             has_kvm && kvm_dirty_ring_supported()) {
             qtest_add_func("/migration/dirty_limit", test_migrate_dirty_limit);
+            qtest_add_func("/migration/dirty_limit/adaptive",
+                           test_migrate_dirty_limit_adaptive);
         }
     }
     qtest_add_func("/migration/multifd/tcp/plain/none",
@@ -3476,12 +3769,24 @@ int main(int argc, char **argv)
         qtest_add_func("/migration/multifd/tcp/plain/cancel",
                        test_multifd_tcp_cancel);
     }
+    qtest_add_func("/migration/multifd/tcp/plain/zero-page",
+                   test_multifd_tcp_zero_page);
+    qtest_add_func("/migration/multifd/tcp/plain/xbzrle",
+                   test_multifd_tcp_xbzrle);
     qtest_add_func("/migration/multifd/tcp/plain/zlib",
                    test_multifd_tcp_zlib);
 #ifdef CONFIG_ZSTD
     qtest_add_func("/migration/multifd/tcp/plain/zstd",
                    test_multifd_tcp_zstd);
 #endif
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/plain/lz4",
+                   test_multifd_tcp_lz4);
+#endif
+#ifdef CONFIG_LINUX_IO_URING
+    qtest_add_func("/migration/multifd/tcp/plain/io-uring",
+                   test_multifd_tcp_io_uring);
+#endif
 #ifdef CONFIG_GNUTLS
     qtest_add_func("/migration/multifd/tcp/tls/psk/match",
                    test_multifd_tcp_tls_psk_match);
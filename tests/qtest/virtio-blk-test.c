@@ -721,6 +721,148 @@ static void pci_hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
     qpci_unplug_acpi_device_test(qts, "drv1", PCI_SLOT_HP);
 }
 
+/* Submit a one sector read or write on @vq and wait for its completion */
+static void virtio_blk_rw_sector(QTestState *qts, QVirtioDevice *dev,
+                                 QGuestAllocator *alloc, QVirtQueue *vq,
+                                 uint32_t type, uint64_t sector, char *data)
+{
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    uint32_t free_head;
+    uint8_t status;
+
+    req.type = type;
+    req.ioprio = 1;
+    req.sector = sector;
+    req.data = g_malloc0(512);
+    if (type == VIRTIO_BLK_T_OUT) {
+        memcpy(req.data, data, 512);
+    }
+
+    req_addr = virtio_blk_request(alloc, dev, &req, 512);
+
+    g_free(req.data);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512, type == VIRTIO_BLK_T_IN, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    status = qtest_readb(qts, req_addr + 528);
+    g_assert_cmpint(status, ==, 0);
+
+    if (type == VIRTIO_BLK_T_IN) {
+        qtest_memread(qts, req_addr + 16, data, 512);
+    }
+
+    guest_free(alloc, req_addr);
+}
+
+/*
+ * Plug a disk whose virtqueues are spread over two iothreads, each of
+ * them submitting the requests of its virtqueues, and check that data
+ * written through a virtqueue of one iothread can be read back through
+ * a virtqueue of the other one.
+ */
+static void pci_hotplug_iothread_vq_mapping(void *obj, void *data,
+                                            QGuestAllocator *t_alloc)
+{
+    QVirtioPCIDevice *dev1 = obj;
+    QVirtioPCIDevice *dev;
+    QTestState *qts = dev1->pdev->bus->qts;
+    QVirtQueue *vqs[4];
+    uint64_t features;
+    uint16_t num_queues;
+    char *tmp_path;
+    char buf[512];
+    int i;
+
+    if (dev1->pdev->bus->not_hotpluggable) {
+        g_test_skip("pci bus does not support hotplug");
+        return;
+    }
+
+    qtest_qmp_assert_success(qts,
+                             "{'execute': 'object-add', 'arguments': "
+                             "{'qom-type': 'iothread', 'id': 'iothread0'}}");
+    qtest_qmp_assert_success(qts,
+                             "{'execute': 'object-add', 'arguments': "
+                             "{'qom-type': 'iothread', 'id': 'iothread1'}}");
+
+    /* drive1 drops writes, use an image that can be read back */
+    tmp_path = drive_create();
+    qtest_qmp_assert_success(qts,
+                             "{'execute': 'blockdev-add', 'arguments': "
+                             "{'driver': 'raw', 'node-name': 'drive2', "
+                             "'file': {'driver': 'file', 'filename': %s}}}",
+                             tmp_path);
+
+    /* plug secondary disk, round-robin puts virtqueues 0 and 2 on iothread0 */
+    qtest_qmp_device_add(qts, "virtio-blk-pci", "drv1",
+                         "{'addr': %s, 'drive': 'drive2', 'num-queues': 4, "
+                         "'iothread-vq-mapping': [{'iothread': 'iothread0'}, "
+                         "{'iothread': 'iothread1'}]}",
+                         stringify(PCI_SLOT_HP) ".0");
+
+    dev = virtio_pci_new(dev1->pdev->bus,
+                         &(QPCIAddress) { .devfn = QPCI_DEVFN(PCI_SLOT_HP, 0) });
+    g_assert_nonnull(dev);
+    g_assert_cmpint(dev->vdev.device_type, ==, VIRTIO_ID_BLOCK);
+
+    qos_object_start_hw(&dev->obj);
+
+    features = qvirtio_get_features(&dev->vdev);
+    g_assert_cmpint(features & (1u << VIRTIO_BLK_F_MQ), ==,
+                    1u << VIRTIO_BLK_F_MQ);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(&dev->vdev, features);
+
+    num_queues = qvirtio_config_readw(&dev->vdev,
+            offsetof(struct virtio_blk_config, num_queues));
+    g_assert_cmpint(num_queues, ==, ARRAY_SIZE(vqs));
+
+    for (i = 0; i < ARRAY_SIZE(vqs); i++) {
+        vqs[i] = qvirtqueue_setup(&dev->vdev, t_alloc, i);
+    }
+
+    qvirtio_set_driver_ok(&dev->vdev);
+
+    /* Write sector i through virtqueue i */
+    for (i = 0; i < ARRAY_SIZE(vqs); i++) {
+        memset(buf, 0, sizeof(buf));
+        snprintf(buf, sizeof(buf), "TEST%d", i);
+        virtio_blk_rw_sector(qts, &dev->vdev, t_alloc, vqs[i],
+                             VIRTIO_BLK_T_OUT, i, buf);
+    }
+
+    /* Read it back through a virtqueue of the other iothread */
+    for (i = 0; i < ARRAY_SIZE(vqs); i++) {
+        g_autofree char *expected = g_strdup_printf("TEST%d", i);
+
+        memset(buf, 0xff, sizeof(buf));
+        virtio_blk_rw_sector(qts, &dev->vdev, t_alloc,
+                             vqs[(i + 1) % ARRAY_SIZE(vqs)],
+                             VIRTIO_BLK_T_IN, i, buf);
+        g_assert_cmpstr(buf, ==, expected);
+    }
+
+    for (i = 0; i < ARRAY_SIZE(vqs); i++) {
+        qvirtqueue_cleanup(dev->vdev.bus, vqs[i], t_alloc);
+    }
+
+    qvirtio_pci_device_disable(dev);
+    qos_object_destroy((QOSGraphObject *)dev);
+
+    /* unplug secondary disk */
+    qpci_unplug_acpi_device_test(qts, "drv1", PCI_SLOT_HP);
+}
+
 /*
  * Check that setting the vring addr on a non-existent virtqueue does
  * not crash.
@@ -802,6 +944,8 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+    qos_add_test("hotplug-iothread-vq-mapping", "virtio-blk-pci",
+                 pci_hotplug_iothread_vq_mapping, &opts);
 }
 
 libqos_init(register_virtio_blk_test);
@@ -920,6 +920,76 @@ static void test_hbitmap_next_x_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_x_check(data, 0);
 }
 
+static void test_hbitmap_next_zero_full(TestHBitmapData *data,
+                                        const void *unused)
+{
+    /* Long runs of full words, with the zero bit at different alignments */
+    hbitmap_test_init(data, L3, 0);
+    hbitmap_set(data->hb, 0, L3);
+    test_hbitmap_next_x_check(data, 0);
+    test_hbitmap_next_x_check(data, L1 + 1);
+
+    hbitmap_reset(data->hb, L3 - 1, 1);
+    test_hbitmap_next_x_check(data, 0);
+    test_hbitmap_next_x_check(data, 3 * L1 + 7);
+
+    hbitmap_reset(data->hb, L2 + 9 * L1 + 5, 1);
+    test_hbitmap_next_x_check(data, 0);
+    test_hbitmap_next_x_check(data, L2);
+    test_hbitmap_next_x_check(data, L2 + 9 * L1 + 5);
+    test_hbitmap_next_x_check(data, L2 + 9 * L1 + 6);
+    test_hbitmap_next_x_check_range(data, 0, L2 + 9 * L1 + 5);
+}
+
+static void hbitmap_test_merge_do(TestHBitmapData *data, bool in_place)
+{
+    HBitmap *src;
+    HBitmapIter hbi;
+    int64_t next;
+
+    hbitmap_test_init(data, L3 * 2, 0);
+    hbitmap_test_set(data, 0, L1 + 3);
+    hbitmap_test_set(data, L2 * 3, L2);
+
+    src = hbitmap_alloc(L3 * 2, 0);
+    hbitmap_set(src, L1, L1);
+    hbitmap_set(src, L2 * 3 + 5, L2 * 2);
+    hbitmap_set(src, L3 + 1, 1);
+    hbitmap_set(src, L3 * 2 - 1, 1);
+
+    if (in_place) {
+        hbitmap_merge(data->hb, src, data->hb);
+    } else {
+        HBitmap *result = hbitmap_alloc(L3 * 2, 0);
+
+        hbitmap_merge(data->hb, src, result);
+        hbitmap_free(data->hb);
+        data->hb = result;
+    }
+
+    hbitmap_iter_init(&hbi, src, 0);
+    while ((next = hbitmap_iter_next(&hbi)) >= 0) {
+        data->bits[next >> LOG_BITS_PER_LONG] |=
+            1UL << (next & (BITS_PER_LONG - 1));
+    }
+    hbitmap_test_check(data, 0);
+    test_hbitmap_next_x_check(data, L1 + 2);
+    test_hbitmap_next_x_check(data, L3);
+
+    hbitmap_free(src);
+}
+
+static void test_hbitmap_merge(TestHBitmapData *data, const void *unused)
+{
+    hbitmap_test_merge_do(data, false);
+}
+
+static void test_hbitmap_merge_in_place(TestHBitmapData *data,
+                                        const void *unused)
+{
+    hbitmap_test_merge_do(data, true);
+}
+
 static void test_hbitmap_next_dirty_area_check_limited(TestHBitmapData *data,
                                                        int64_t offset,
                                                        int64_t count,
@@ -1103,6 +1173,10 @@ int main(int argc, char **argv)
                      test_hbitmap_next_x_4);
     hbitmap_test_add("/hbitmap/next_zero/next_x_after_truncate",
                      test_hbitmap_next_x_after_truncate);
+    hbitmap_test_add("/hbitmap/next_zero/full", test_hbitmap_next_zero_full);
+
+    hbitmap_test_add("/hbitmap/merge/general", test_hbitmap_merge);
+    hbitmap_test_add("/hbitmap/merge/in_place", test_hbitmap_merge_in_place);
 
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_0",
                      test_hbitmap_next_dirty_area_0);
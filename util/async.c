@@ -466,7 +466,7 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
         return ctx->linux_io_uring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
+    ctx->linux_io_uring = luring_init(ctx->linux_io_uring_sqpoll, errp);
     if (!ctx->linux_io_uring) {
         return NULL;
     }
@@ -770,3 +770,20 @@ void aio_context_set_thread_pool_params(AioContext *ctx, int64_t min,
         thread_pool_update_params(ctx->thread_pool, ctx);
     }
 }
+
+void aio_context_set_io_uring_params(AioContext *ctx, bool sqpoll,
+                                     Error **errp)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (ctx->linux_io_uring && ctx->linux_io_uring_sqpoll != sqpoll) {
+        error_setg(errp, "io_uring parameters cannot be changed once the "
+                   "io_uring ring is in use");
+        return;
+    }
+    ctx->linux_io_uring_sqpoll = sqpoll;
+#else
+    if (sqpoll) {
+        error_setg(errp, "io_uring support not built in");
+    }
+#endif
+}
@@ -50,8 +50,15 @@
  * extremely sparse, this is also O(m + m/W + m/W^2 + ...), so the amortized
  * cost of advancing from one bit to the next is usually constant (worst case
  * O(logB n) as in the non-amortized complexity).
+ *
+ * There is no such hierarchy for clear bits, so looking for the next zero
+ * bit scans the last level.  It does so a cache line at a time, with loops
+ * simple enough for the compiler to vectorize.
  */
 
+/* Number of bottom level words checked at once when scanning for zero bits */
+#define HB_SCAN_WORDS (64 / sizeof(unsigned long))
+
 struct HBitmap {
     /*
      * Size of the bitmap, as requested in hbitmap_alloc or in hbitmap_truncate.
@@ -217,6 +224,39 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
     return MAX(start, first_dirty_off);
 }
 
+/*
+ * Return the index of the first word in @words that is not all ones, looking
+ * from @pos to @end (exclusive).  Return @end if there is none.
+ */
+static size_t hb_find_not_full(const unsigned long *words, size_t pos,
+                               size_t end)
+{
+    while (pos < end && (pos & (HB_SCAN_WORDS - 1))) {
+        if (words[pos] != ~0UL) {
+            return pos;
+        }
+        pos++;
+    }
+
+    while (end - pos >= HB_SCAN_WORDS) {
+        unsigned long acc = ~0UL;
+        int i;
+
+        for (i = 0; i < HB_SCAN_WORDS; i++) {
+            acc &= words[pos + i];
+        }
+        if (acc != ~0UL) {
+            break;
+        }
+        pos += HB_SCAN_WORDS;
+    }
+
+    while (pos < end && words[pos] == ~0UL) {
+        pos++;
+    }
+    return pos;
+}
+
 int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
 {
     size_t pos = (start >> hb->granularity) >> BITS_PER_LEVEL;
@@ -245,10 +285,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = hb_find_not_full(last_lev, pos + 1, sz);
         if (pos >= sz) {
             return -1;
         }
@@ -408,6 +445,29 @@ static uint64_t hb_count_between(HBitmap *hb, uint64_t start, uint64_t last)
     return count;
 }
 
+/*
+ * Count the set bits in the last level, ignoring any bits past hb->size.
+ * Unlike hb_count_between, this reads the words in order without looking at
+ * the upper levels, which is faster for densely populated maps.
+ */
+static uint64_t hb_count_all(const HBitmap *hb)
+{
+    const unsigned long *words = hb->levels[HBITMAP_LEVELS - 1];
+    uint64_t n = hb->size >> BITS_PER_LEVEL;
+    unsigned tail = hb->size & (BITS_PER_LONG - 1);
+    uint64_t count = 0;
+    uint64_t i;
+
+    for (i = 0; i < n; i++) {
+        count += ctpopl(words[i]);
+    }
+    if (tail) {
+        count += ctpopl(words[n] & ((1UL << tail) - 1));
+    }
+
+    return count;
+}
+
 /* Setting starts at the last layer and propagates up if an element
  * changes.
  */
@@ -682,6 +742,12 @@ void hbitmap_serialize_part(const HBitmap *hb, uint8_t *buf,
     serialization_chunk(hb, start, count, &cur, &el_count);
     end = cur + el_count;
 
+    if (!HOST_BIG_ENDIAN) {
+        /* The serialized format is the in-memory layout of little endian */
+        memcpy(buf, cur, el_count * sizeof(unsigned long));
+        return;
+    }
+
     while (cur != end) {
         unsigned long el =
             (BITS_PER_LONG == 32 ? cpu_to_le32(*cur) : cpu_to_le64(*cur));
@@ -705,6 +771,11 @@ void hbitmap_deserialize_part(HBitmap *hb, uint8_t *buf,
     serialization_chunk(hb, start, count, &cur, &el_count);
     end = cur + el_count;
 
+    if (!HOST_BIG_ENDIAN) {
+        memcpy(cur, buf, el_count * sizeof(unsigned long));
+        cur = end;
+    }
+
     while (cur != end) {
         memcpy(cur, buf, sizeof(*cur));
 
@@ -761,24 +832,31 @@ void hbitmap_deserialize_finish(HBitmap *bitmap)
     int64_t i, size, prev_size;
     int lev;
 
-    /* restore levels starting from penultimate to zero level, assuming
-     * that the last level is ok */
+    /*
+     * restore levels starting from penultimate to zero level, assuming
+     * that the last level is ok; each word of a level is built from the
+     * BITS_PER_LONG words below it
+     */
     size = MAX((bitmap->size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
     for (lev = HBITMAP_LEVELS - 1; lev-- > 0; ) {
         prev_size = size;
         size = MAX((size + BITS_PER_LONG - 1) >> BITS_PER_LEVEL, 1);
-        memset(bitmap->levels[lev], 0, size * sizeof(unsigned long));
 
-        for (i = 0; i < prev_size; ++i) {
-            if (bitmap->levels[lev + 1][i]) {
-                bitmap->levels[lev][i >> BITS_PER_LEVEL] |=
-                    1UL << (i & (BITS_PER_LONG - 1));
+        for (i = 0; i < prev_size; i += BITS_PER_LONG) {
+            const unsigned long *lower = &bitmap->levels[lev + 1][i];
+            int n = MIN(BITS_PER_LONG, prev_size - i);
+            unsigned long word = 0;
+            int j;
+
+            for (j = 0; j < n; j++) {
+                word |= (unsigned long)(lower[j] != 0) << j;
             }
+            bitmap->levels[lev][i >> BITS_PER_LEVEL] = word;
         }
     }
 
     bitmap->levels[0][0] |= 1UL << (BITS_PER_LONG - 1);
-    bitmap->count = hb_count_between(bitmap, 0, bitmap->size - 1);
+    bitmap->count = hb_count_all(bitmap);
 }
 
 void hbitmap_free(HBitmap *hb)
@@ -892,6 +970,42 @@ static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
     }
 }
 
+/**
+ * hbitmap_merge_into: performs dst = dst | src
+ * for bitmaps with the same granularity.  Only the nonzero words of src are
+ * visited, so the cost depends on how populated src is, not on its size.
+ */
+static void hbitmap_merge_into(HBitmap *dst, const HBitmap *src)
+{
+    unsigned long *last_lev = dst->levels[HBITMAP_LEVELS - 1];
+    size_t last_pos = (dst->size - 1) >> BITS_PER_LEVEL;
+    unsigned tail = dst->size & (BITS_PER_LONG - 1);
+    HBitmapIter hbi;
+    unsigned long cur;
+    size_t pos;
+
+    hbitmap_iter_init(&hbi, src, 0);
+    while ((pos = hbitmap_iter_next_word(&hbi, &cur)) != (size_t)-1) {
+        unsigned long old = last_lev[pos];
+        unsigned long val;
+
+        if (pos == last_pos && tail) {
+            cur &= (1UL << tail) - 1;
+        }
+        val = old | cur;
+        if (val == old) {
+            continue;
+        }
+
+        dst->count += ctpopl(val) - ctpopl(old);
+        last_lev[pos] = val;
+        if (!old) {
+            /* The word became nonzero, tell the upper levels */
+            hb_set_between(dst, HBITMAP_LEVELS - 2, pos, pos);
+        }
+    }
+}
+
 /**
  * Given HBitmaps A and B, let R := A (BITOR) B.
  * Bitmaps A and B will not be modified,
@@ -929,11 +1043,20 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
         return;
     }
 
+    assert(a->size == b->size);
+
+    /* Merging into one of the operands only needs to look at the other */
+    if (result == a && b != result) {
+        hbitmap_merge_into(result, b);
+        return;
+    }
+    if (result == b && a != result) {
+        hbitmap_merge_into(result, a);
+        return;
+    }
+
     /* This merge is O(size), as BITS_PER_LONG and HBITMAP_LEVELS are constant.
-     * It may be possible to improve running times for sparsely populated maps
-     * by using hbitmap_iter_next, but this is suboptimal for dense maps.
      */
-    assert(a->size == b->size);
     for (i = HBITMAP_LEVELS - 1; i >= 0; i--) {
         for (j = 0; j < a->sizes[i]; j++) {
             result->levels[i][j] = a->levels[i][j] | b->levels[i][j];
@@ -941,7 +1064,7 @@ void hbitmap_merge(const HBitmap *a, const HBitmap *b, HBitmap *result)
     }
 
     /* Recompute the dirty count */
-    result->count = hb_count_between(result, 0, result->size - 1);
+    result->count = hb_count_all(result);
 }
 
 char *hbitmap_sha256(const HBitmap *bitmap, Error **errp)